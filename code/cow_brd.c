@@ -45,6 +45,9 @@ struct brd_device {
   // Denotes whether or not a cow_ram is writable and snapshots are active.
   bool  is_writable;
   bool  is_snapshot;
+  // Checkpoints are read-only snapshots of a disk (or of another checkpoint)
+  // that snapshot devices can be restored to instead of the disk itself.
+  bool  is_checkpoint;
 
   struct request_queue  *brd_queue;
   struct gendisk    *brd_disk;
@@ -88,6 +91,23 @@ static struct page *brd_lookup_page(struct brd_device *brd, sector_t sector)
   return page;
 }
 
+/*
+ * Look up and return the page for a given sector from the closest ancestor of
+ * brd that has one. Checkpoints can be stacked on top of each other, so this
+ * may walk through several devices before reaching the disk itself.
+ */
+static struct page *brd_lookup_parent_page(struct brd_device *brd,
+    sector_t sector)
+{
+  struct brd_device *parent;
+  struct page *page = NULL;
+
+  for (parent = brd->parent_brd; parent && !page; parent = parent->parent_brd)
+    page = brd_lookup_page(parent, sector);
+
+  return page;
+}
+
 /*
  * Look up and return a brd's page for a given sector.
  * If one does not exist, allocate an empty page, and insert that. Then
@@ -143,7 +163,7 @@ static struct page *brd_insert_page(struct brd_device *brd, sector_t sector)
   // Copy over the data in the parent's page to the snapshot page if the parent
   // has a page in this sector address.
   if (brd->parent_brd) {
-    parent_page = brd_lookup_page(brd->parent_brd, sector);
+    parent_page = brd_lookup_parent_page(brd, sector);
     // This page may not have originally existed in the parent.
     if (parent_page) {
       // Map both the parent and snapshot pages so that the kernel can access
@@ -220,6 +240,50 @@ static void brd_free_pages(struct brd_device *brd)
   } while (nr_pages == FREE_BATCH);
 }
 
+/*
+ * Copy the indices of populated pages to userspace for COW_BRD_GET_PAGES.
+ * Only the pages in this device's radix tree are returned, so the result is
+ * only the whole disk for devices without a parent.
+ */
+static int brd_get_pages(struct brd_device *brd,
+    struct cow_brd_pages __user *arg)
+{
+  struct cow_brd_pages req;
+  struct page *pages[FREE_BATCH];
+  unsigned long indices[FREE_BATCH];
+  unsigned long pos;
+  unsigned int found = 0;
+  int nr_pages;
+  int i;
+
+  if (copy_from_user(&req, arg, sizeof(req)))
+    return -EFAULT;
+
+  pos = req.start;
+  while (found < req.max_pages) {
+    // The pages can't be touched after dropping the rcu lock, so pull out
+    // their indices before copying them to userspace.
+    rcu_read_lock();
+    nr_pages = radix_tree_gang_lookup(&brd->brd_pages, (void **)pages, pos,
+        min_t(unsigned int, FREE_BATCH, req.max_pages - found));
+    for (i = 0; i < nr_pages; i++)
+      indices[i] = pages[i]->index;
+    rcu_read_unlock();
+
+    if (nr_pages == 0)
+      break;
+    if (copy_to_user(req.pages + found, indices,
+          nr_pages * sizeof(indices[0])))
+      return -EFAULT;
+    found += nr_pages;
+    pos = indices[nr_pages - 1] + 1;
+  }
+
+  if (copy_to_user(&arg->num_pages, &found, sizeof(found)))
+    return -EFAULT;
+  return 0;
+}
+
 /*
  * copy_to_brd_setup must be called before copy_to_brd. It may sleep.
  */
@@ -286,7 +350,7 @@ static void copy_to_brd(struct brd_device *brd, const void *src,
     dst = kmap_atomic(page);
     // Copy over the rest of the page from the parent brd if it exists.
     if (brd->parent_brd) {
-      parent_page = brd_lookup_page(brd->parent_brd, sector);
+      parent_page = brd_lookup_parent_page(brd, sector);
       // This page may not have originally existed in the parent.
       if (parent_page) {
         parent_src = kmap_atomic(parent_page);
@@ -319,7 +383,7 @@ static void copy_from_brd(void *dst, struct brd_device *brd, sector_t sector,
     memcpy(dst, src + offset, copy);
     kunmap_atomic(src);
   } else if (brd->parent_brd &&
-      (page = brd_lookup_page(brd->parent_brd, sector))) {
+      (page = brd_lookup_parent_page(brd, sector))) {
     // Present in the old radix tree so this page has not been modified.
     src = kmap_atomic(page);
     memcpy(dst, src + offset, copy);
@@ -331,6 +395,8 @@ static void copy_from_brd(void *dst, struct brd_device *brd, sector_t sector,
   }
 
   if (copy < n) {
+    // The rest of the read starts at the beginning of the next page, whichever
+    // radix tree it comes from.
     dst += copy;
     sector += copy >> SECTOR_SHIFT;
     copy = n - copy;
@@ -341,10 +407,10 @@ static void copy_from_brd(void *dst, struct brd_device *brd, sector_t sector,
       memcpy(dst, src, copy);
       kunmap_atomic(src);
     } else if (brd->parent_brd &&
-        (page = brd_lookup_page(brd->parent_brd, sector))) {
+        (page = brd_lookup_parent_page(brd, sector))) {
       // Present in the old radix tree so this page has not been modified.
       src = kmap_atomic(page);
-      memcpy(dst, src + offset, copy);
+      memcpy(dst, src, copy);
       kunmap_atomic(src);
     } else {
       // Page doesn't exist in either radix tree so it must never have been
@@ -469,12 +535,15 @@ static int brd_direct_access(struct block_device *bdev, sector_t sector,
 }
 #endif
 
+static struct brd_device *brd_find_checkpoint(struct brd_device *brd,
+    unsigned long checkpoint);
+
 static int brd_ioctl(struct block_device *bdev, fmode_t mode,
       unsigned int cmd, unsigned long arg)
 {
   int error = 0;
   struct brd_device *brd = bdev->bd_disk->private_data;
-  struct brd_device *snapshots;
+  struct brd_device *parent;
 
   switch (cmd) {
     case COW_BRD_SNAPSHOT:
@@ -494,6 +563,26 @@ static int brd_ioctl(struct block_device *bdev, fmode_t mode,
         return -ENOTTY;
       }
       brd_free_pages(brd);
+      // The snapshot may have last been restored to a checkpoint.
+      brd->parent_brd = brd_find_checkpoint(brd, 0);
+      break;
+    case COW_BRD_RESTORE_CHECKPOINT:
+      if (!brd->is_snapshot && !brd->is_checkpoint) {
+        return -ENOTTY;
+      }
+      parent = brd_find_checkpoint(brd, arg);
+      if (!parent || parent == brd) {
+        return -EINVAL;
+      }
+      // Checkpoints may only be stacked on older checkpoints so that we never
+      // make a cycle of parents.
+      if (brd->is_checkpoint && parent->is_checkpoint &&
+          parent->brd_number > brd->brd_number) {
+        return -EINVAL;
+      }
+      brd_free_pages(brd);
+      brd->parent_brd = parent;
+      brd->is_writable = true;
       break;
     case COW_BRD_WIPE:
       if (brd->is_snapshot) {
@@ -502,6 +591,11 @@ static int brd_ioctl(struct block_device *bdev, fmode_t mode,
       // Assumes no snapshots are being used right now.
       brd_free_pages(brd);
       break;
+    case COW_BRD_GET_PAGES:
+      if (brd->is_snapshot || brd->is_checkpoint) {
+        return -ENOTTY;
+      }
+      return brd_get_pages(brd, (struct cow_brd_pages __user *) arg);
     default:
       error = -ENOTTY;
   }
@@ -523,6 +617,7 @@ static const struct block_device_operations brd_fops = {
 int major_num = 0;
 static int num_disks = 1;
 static int num_snapshots = 1;
+static int num_checkpoints = 0;
 int disk_size = DEFAULT_COW_RD_SIZE;
 static int max_part;
 static int part_shift;
@@ -531,6 +626,9 @@ MODULE_PARM_DESC(num_disks, "Maximum number of ram block devices");
 module_param(num_snapshots, int, S_IRUGO);
 MODULE_PARM_DESC(num_snapshots, "Number of ram block snapshot devices where "
     "each disk gets it's own snapshot");
+module_param(num_checkpoints, int, S_IRUGO);
+MODULE_PARM_DESC(num_checkpoints, "Number of ram block checkpoint devices per "
+    "disk that snapshots can be restored to");
 module_param(disk_size, int, S_IRUGO);
 MODULE_PARM_DESC(disk_size, "Size of each RAM disk in kbytes.");
 module_param(max_part, int, S_IRUGO);
@@ -555,6 +653,33 @@ __setup("ramdisk_size=", ramdisk_size);
 static LIST_HEAD(brd_devices);
 static DEFINE_MUTEX(brd_devices_mutex);
 
+/*
+ * Find the device for the given checkpoint of the disk brd belongs to.
+ * Checkpoint 0 is the disk itself, the rest are numbered from 1.
+ */
+static struct brd_device *brd_find_checkpoint(struct brd_device *brd,
+    unsigned long checkpoint)
+{
+  struct brd_device *cur, *found = NULL;
+  int target = brd->brd_number % num_disks;
+
+  if (checkpoint > num_checkpoints)
+    return NULL;
+  if (checkpoint > 0)
+    target += num_disks * (num_snapshots + checkpoint);
+
+  mutex_lock(&brd_devices_mutex);
+  list_for_each_entry(cur, &brd_devices, brd_list) {
+    if (cur->brd_number == target) {
+      found = cur;
+      break;
+    }
+  }
+  mutex_unlock(&brd_devices_mutex);
+
+  return found;
+}
+
 static struct brd_device *brd_alloc(int i)
 {
   struct brd_device *brd;
@@ -567,7 +692,8 @@ static struct brd_device *brd_alloc(int i)
 
   // True on disks until "snapshot" ioctl is called.
   brd->is_writable  = true;
-  brd->is_snapshot  = i >= num_disks;
+  brd->is_snapshot  = i >= num_disks && i < num_disks * (1 + num_snapshots);
+  brd->is_checkpoint  = i >= num_disks * (1 + num_snapshots);
 
   spin_lock_init(&brd->brd_lock);
   INIT_RADIX_TREE(&brd->brd_pages, GFP_ATOMIC);
@@ -596,6 +722,9 @@ static struct brd_device *brd_alloc(int i)
   if (brd->is_snapshot) {
     sprintf(disk->disk_name, "cow_ram_snapshot%d_%d", i / num_disks,
         i % num_disks);
+  } else if (brd->is_checkpoint) {
+    sprintf(disk->disk_name, "cow_ram_checkpoint%d_%d",
+        i / num_disks - num_snapshots, i % num_disks);
   } else {
     sprintf(disk->disk_name, "cow_ram%d", i);
   }
@@ -674,7 +803,7 @@ static struct kobject *brd_probe(dev_t dev, int *part, void *data)
 static int __init brd_init(void)
 {
   int i;
-  const int nr = num_disks * (1 + num_snapshots);
+  const int nr = num_disks * (1 + num_snapshots + num_checkpoints);
   unsigned long range;
   struct brd_device *brd, *next, *parent_brd;
 
@@ -724,8 +853,8 @@ static int __init brd_init(void)
 
   range = nr << part_shift;
 
-  // The first num_disks devices are the actual disks, the rest are snapshot
-  // devices.
+  // The first num_disks devices are the actual disks, followed by the snapshot
+  // devices and then the checkpoint devices.
   for (i = 0; i < nr; i++) {
     brd = brd_alloc(i);
     if (!brd) {
@@ -754,8 +883,9 @@ static int __init brd_init(void)
   blk_register_region(MKDEV(RAMDISK_MAJOR, 0), range,
           THIS_MODULE, brd_probe, NULL, NULL);
 
-  printk(KERN_INFO DEVICE_NAME ": module loaded with %d disks and %d snapshots"
-      "\n", num_disks, num_disks * num_snapshots);
+  printk(KERN_INFO DEVICE_NAME ": module loaded with %d disks, %d snapshots, "
+      "and %d checkpoints\n", num_disks, num_disks * num_snapshots,
+      num_disks * num_checkpoints);
   return 0;
 
 out_free:
@@ -773,7 +903,7 @@ static void __exit brd_exit(void)
   unsigned long range;
   struct brd_device *brd, *next;
 
-  range = (num_disks * (1 + num_snapshots)) << part_shift;
+  range = (num_disks * (1 + num_snapshots + num_checkpoints)) << part_shift;
 
   list_for_each_entry_safe(brd, next, &brd_devices, brd_list)
     brd_del_one(brd);
@@ -4,6 +4,7 @@
 #include <linux/init.h>
 #include <linux/ioctl.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
@@ -47,6 +48,8 @@ static struct hwm_device {
   u8* data;
   struct gendisk* gd;
   bool log_on;
+  // When the last bio came through, so user-land can tell writeback is done.
+  atomic64_t last_bio_ns;
   struct block_device* target_dev;
   // Pointer to first write op in the chain.
   struct disk_write_op* writes;
@@ -75,6 +78,7 @@ static int disk_wrapper_ioctl(struct block_device* bdev, fmode_t mode,
     unsigned int cmd, unsigned long arg) {
   int ret = 0;
   unsigned int not_copied;
+  unsigned long long last_bio_ns;
 
   switch (cmd) {
     case HWM_LOG_OFF:
@@ -139,6 +143,12 @@ static int disk_wrapper_ioctl(struct block_device* bdev, fmode_t mode,
       printk(KERN_INFO "hwm: clearing data logs\n");
       free_logs();
       break;
+    case HWM_GET_LAST_BIO:
+      last_bio_ns = atomic64_read(&Device.last_bio_ns);
+      if (copy_to_user((void*) arg, &last_bio_ns, sizeof(last_bio_ns))) {
+        return -EFAULT;
+      }
+      break;
     default:
       ret = -EINVAL;
   }
@@ -178,6 +188,8 @@ static void disk_wrapper_bio(struct request_queue* q, struct bio* bio) {
       " has flags:\n", bio->BI_SIZE, bio->BI_SECTOR * 512, bio->BI_SECTOR);
   print_rw_flags(bio->bi_rw, bio->bi_flags);
   */
+  atomic64_set(&Device.last_bio_ns, ktime_to_ns(ktime_get()));
+
   // Log information about writes, fua, and flush/flush_seq events in kernel
   // memory.
   if (Device.log_on) {
@@ -287,6 +299,7 @@ static int __init disk_wrapper_init(void) {
       target_device_path, flags_device_path);
   // Get memory for our starting disk epoch node.
   Device.log_on = false;
+  atomic64_set(&Device.last_bio_ns, 0);
 
   // Get registered.
   major_num = register_blkdev(major_num, "hwm");
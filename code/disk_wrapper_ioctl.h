@@ -12,6 +12,14 @@
 #define COW_BRD_UNSNAPSHOT        0xff07
 #define COW_BRD_RESTORE_SNAPSHOT  0xff08
 #define COW_BRD_WIPE              0xff09
+#define COW_BRD_RESTORE_CHECKPOINT 0xff0a
+// Copies the CLOCK_MONOTONIC time in ns of the last bio the wrapper saw, or 0
+// if it hasn't seen one, into the unsigned long long pointed to by arg.
+#define HWM_GET_LAST_BIO          0xff0b
+// Fills in the indices of the populated pages of a cow_brd disk, see struct
+// cow_brd_pages. Not supported on snapshot or checkpoint
+// devices.
+#define COW_BRD_GET_PAGES         0xff0c
 
 // For ease of transferring data to user-land.
 struct disk_write_op_meta {
@@ -21,4 +29,16 @@ struct disk_write_op_meta {
   unsigned int size;
 };
 
+// Argument of COW_BRD_GET_PAGES.
+struct cow_brd_pages {
+  // Lowest page index to return.
+  unsigned long start;
+  // Filled in with up to max_pages page indices in increasing order.
+  unsigned long *pages;
+  unsigned int max_pages;
+  // Set to the number of indices filled in. Fewer than max_pages means there
+  // are no populated pages past the last one.
+  unsigned int num_pages;
+};
+
 #endif
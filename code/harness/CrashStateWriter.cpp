@@ -0,0 +1,366 @@
+#include <limits.h>
+#include <sys/uio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "CrashStateWriter.h"
+
+namespace fs_testing {
+
+using std::memcpy;
+using std::sort;
+using std::vector;
+
+using fs_testing::utils::disk_write;
+using fs_testing::utils::LogView;
+
+namespace {
+
+static const unsigned int kSectorSize = 512;
+// O_DIRECT needs buffers aligned to the logical block size of the device, which
+// is a sector for every device we test on. Keep the whole copy page aligned.
+static const unsigned int kBaseAlign = 4096;
+static const unsigned int kRingEntries = 4096;
+// Writes are limited to what fits in an unsigned int.
+static const unsigned long int kMaxFixedRun = 1 << 30;
+
+}  // namespace
+
+WriteStats& WriteStats::operator+=(const WriteStats& other) {
+  syscalls += other.syscalls;
+  bytes += other.bytes;
+  return *this;
+}
+
+AlignedLog::~AlignedLog() {
+  free(base_);
+}
+
+bool AlignedLog::Init(vector<disk_write>& log) {
+  free(base_);
+  base_ = NULL;
+  size_ = 0;
+  offsets_.clear();
+
+  for (disk_write& dw : log) {
+    const char* data = dw.get_data();
+    if (data == NULL || offsets_.count(data) != 0) {
+      continue;
+    }
+    offsets_[data] = size_;
+    size_ += (dw.metadata.size + kSectorSize - 1) / kSectorSize * kSectorSize;
+  }
+  if (size_ == 0) {
+    return true;
+  }
+  void* base;
+  if (posix_memalign(&base, kBaseAlign, size_) != 0) {
+    size_ = 0;
+    offsets_.clear();
+    return false;
+  }
+  base_ = (char*) base;
+  for (disk_write& dw : log) {
+    const char* data = dw.get_data();
+    if (data != NULL) {
+      memcpy(base_ + offsets_[data], data, dw.metadata.size);
+    }
+  }
+  return true;
+}
+
+void* AlignedLog::Base() const {
+  return base_;
+}
+
+size_t AlignedLog::Size() const {
+  return size_;
+}
+
+char* AlignedLog::Find(disk_write& dw) const {
+  return Find(dw.get_data());
+}
+
+char* AlignedLog::Find(const char* data) const {
+  const auto offset = offsets_.find(data);
+  if (offset == offsets_.end()) {
+    return NULL;
+  }
+  return base_ + offset->second;
+}
+
+bool CrashStateWriter::InitUring(const AlignedLog* log) {
+  if (log->Base() == NULL
+      || !ring_.Init(kRingEntries, log->Base(), log->Size())) {
+    return false;
+  }
+  aligned_log_ = log;
+  return true;
+}
+
+bool CrashStateWriter::UsingUring() const {
+  return aligned_log_ != NULL;
+}
+
+bool CrashStateWriter::AddExtent(const unsigned long int sector,
+    const unsigned int size, const unsigned int index, const char* data) {
+  const unsigned long int byte_addr = sector * kSectorSize;
+  if (aligned_log_ != NULL) {
+    data = aligned_log_->Find(data);
+    if (data == NULL) {
+      return false;
+    }
+  }
+  // Only ever read from, iovecs just don't take const data.
+  extents_.push_back({byte_addr, byte_addr + size, index, (char*) data});
+  return true;
+}
+
+bool CrashStateWriter::Write(const int disk_fd,
+    const vector<disk_write>::iterator& start,
+    const vector<disk_write>::iterator& end,
+    WriteStats* stats) {
+  extents_.clear();
+  unsigned int index = 0;
+  for (auto current = start; current != end; ++current, ++index) {
+    // Operation is not a write so skip it.
+    if (!(current->has_write_flag()) || current->metadata.size == 0) {
+      continue;
+    }
+    if (!AddExtent(current->metadata.write_sector, current->metadata.size,
+          index, current->get_data())) {
+      return false;
+    }
+  }
+  return WriteExtents(disk_fd, stats);
+}
+
+bool CrashStateWriter::Write(const int disk_fd, const LogView& log,
+    const size_t start, const size_t end, WriteStats* stats) {
+  extents_.clear();
+  for (size_t i = start; i < end; ++i) {
+    if (!log.Is(i, LogView::kWrite) || log.Bytes(i) == 0) {
+      continue;
+    }
+    if (!AddExtent(log.Sector(i), log.Bytes(i), i - start, log.Data(i))) {
+      return false;
+    }
+  }
+  return WriteExtents(disk_fd, stats);
+}
+
+bool CrashStateWriter::Write(const int disk_fd, const LogView& log,
+    const vector<unsigned int>::const_iterator& start,
+    const vector<unsigned int>::const_iterator& end,
+    WriteStats* stats) {
+  extents_.clear();
+  unsigned int index = 0;
+  for (auto entry = start; entry != end; ++entry, ++index) {
+    if (!log.Writes(*entry)) {
+      continue;
+    }
+    const size_t i = LogView::Index(*entry);
+    if (!AddExtent(log.Sector(i), log.Bytes(i), index, log.Data(i))) {
+      return false;
+    }
+  }
+  return WriteExtents(disk_fd, stats);
+}
+
+bool CrashStateWriter::WriteExtents(const int disk_fd, WriteStats* stats) {
+  run_.clear();
+  fixed_run_.data = NULL;
+  sort(extents_.begin(), extents_.end(),
+      [](const extent& a, const extent& b) {
+        return a.start < b.start || (a.start == b.start && a.index < b.index);
+      });
+
+  // Sweep over the sorted extents, grouping together extents that overlap.
+  // Groups of one can go anywhere in a run, but groups of more than one need to
+  // be written in their original order.
+  auto group_start = extents_.begin();
+  while (group_start != extents_.end()) {
+    auto group_end = group_start + 1;
+    unsigned long int group_max = group_start->end;
+    while (group_end != extents_.end() && group_end->start < group_max) {
+      group_max = std::max(group_max, group_end->end);
+      ++group_end;
+    }
+
+    if (aligned_log_ != NULL && group_end - group_start == 1) {
+      if (!AddToFixedRun(disk_fd, *group_start, stats)) {
+        return false;
+      }
+    } else if (aligned_log_ != NULL) {
+      overlapping_.assign(group_start, group_end);
+      sort(overlapping_.begin(), overlapping_.end(),
+          [](const extent& a, const extent& b) {
+            return a.index < b.index;
+          });
+      if (!QueueGroup(disk_fd, overlapping_, stats)) {
+        return false;
+      }
+    } else if (group_end - group_start == 1) {
+      if (!AddToRun(disk_fd, *group_start, stats)) {
+        return false;
+      }
+    } else {
+      // Groups don't overlap each other, so there is no need to flush the
+      // current run before writing this one.
+      overlapping_.assign(group_start, group_end);
+      sort(overlapping_.begin(), overlapping_.end(),
+          [](const extent& a, const extent& b) {
+            return a.index < b.index;
+          });
+      // Extents only join a run when they start where it ends, so an extent
+      // that overlaps the run always flushes it first.
+      for (const extent& e : overlapping_) {
+        if (!AddToRun(disk_fd, e, stats)) {
+          return false;
+        }
+      }
+    }
+    group_start = group_end;
+  }
+  if (aligned_log_ != NULL) {
+    return QueueFixedRun(disk_fd, stats) && DrainRing(stats);
+  }
+  return FlushRun(disk_fd, stats);
+}
+
+bool CrashStateWriter::Follows(const extent& run, const extent& e) {
+  return e.start == run.end && e.data == run.data + (run.end - run.start)
+    && e.end - run.start <= kMaxFixedRun;
+}
+
+bool CrashStateWriter::AddToFixedRun(const int disk_fd, const extent& e,
+    WriteStats* stats) {
+  // Bios next to each other in the log are next to each other in the aligned
+  // copy too, so a sequential stream of bios turns into a single write.
+  if (fixed_run_.data != NULL && Follows(fixed_run_, e)) {
+    fixed_run_.end = e.end;
+    return true;
+  }
+  if (!QueueFixedRun(disk_fd, stats)) {
+    return false;
+  }
+  fixed_run_ = e;
+  return true;
+}
+
+bool CrashStateWriter::QueueFixedRun(const int disk_fd, WriteStats* stats) {
+  if (fixed_run_.data == NULL) {
+    return true;
+  }
+  if (ring_.Space() == 0 && !DrainRing(stats)) {
+    return false;
+  }
+  const bool res = ring_.QueueWrite(disk_fd, fixed_run_.data,
+      fixed_run_.end - fixed_run_.start, fixed_run_.start, false);
+  fixed_run_.data = NULL;
+  return res;
+}
+
+bool CrashStateWriter::QueueGroup(const int disk_fd, vector<extent>& group,
+    WriteStats* stats) {
+  // Writes in the chain that pick up where the one before them left off can
+  // still be merged without changing the outcome.
+  auto merged = group.begin();
+  for (auto e = group.begin() + 1; e != group.end(); ++e) {
+    if (Follows(*merged, *e)) {
+      merged->end = e->end;
+    } else {
+      *(++merged) = *e;
+    }
+  }
+  group.erase(merged + 1, group.end());
+
+  // Try not to split a chain of overlapping writes across submissions. Chains
+  // longer than the ring have to be split, but waiting for everything before
+  // the split to finish keeps the writes in order.
+  if (ring_.Space() < group.size() && !DrainRing(stats)) {
+    return false;
+  }
+  for (unsigned int i = 0; i < group.size(); ++i) {
+    if (ring_.Space() == 0 && !DrainRing(stats)) {
+      return false;
+    }
+    // Don't leave a link hanging off the last write in a submission.
+    const bool link = i + 1 < group.size() && ring_.Space() > 1;
+    const extent& e = group.at(i);
+    if (!ring_.QueueWrite(disk_fd, e.data, e.end - e.start, e.start, link)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CrashStateWriter::DrainRing(WriteStats* stats) {
+  unsigned long int syscalls = 0;
+  const long int res = ring_.SubmitAndWait(&syscalls);
+  if (stats != NULL) {
+    stats->syscalls += syscalls;
+    if (res > 0) {
+      stats->bytes += res;
+    }
+  }
+  if (!ring_.IsOpen()) {
+    // The ring is gone, so fall back to pwritev instead of failing every
+    // crash state from here on.
+    aligned_log_ = NULL;
+  }
+  return res >= 0;
+}
+
+bool CrashStateWriter::AddToRun(const int disk_fd, const extent& e,
+    WriteStats* stats) {
+  if (!run_.empty() && (e.start != run_end_ || run_.size() >= IOV_MAX)) {
+    if (!FlushRun(disk_fd, stats)) {
+      return false;
+    }
+  }
+  if (run_.empty()) {
+    run_start_ = e.start;
+    run_end_ = e.start;
+  }
+  run_.push_back({e.data, e.end - e.start});
+  run_end_ = e.end;
+  return true;
+}
+
+bool CrashStateWriter::FlushRun(const int disk_fd, WriteStats* stats) {
+  struct iovec* iov = run_.data();
+  int iov_count = run_.size();
+  unsigned long int offset = run_start_;
+  while (iov_count > 0) {
+    const ssize_t res = pwritev(disk_fd, iov, iov_count, offset);
+    if (res < 0) {
+      return false;
+    }
+    if (stats != NULL) {
+      ++stats->syscalls;
+      stats->bytes += res;
+    }
+    offset += res;
+
+    // Skip past whatever was written in case this was a short write.
+    size_t written = res;
+    while (iov_count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --iov_count;
+    }
+    if (iov_count > 0) {
+      iov->iov_base = (void*) ((unsigned long) iov->iov_base + written);
+      iov->iov_len -= written;
+    }
+  }
+  run_.clear();
+  return true;
+}
+
+}  // namespace fs_testing
@@ -0,0 +1,113 @@
+#ifndef HARNESS_CRASH_STATE_WRITER_H
+#define HARNESS_CRASH_STATE_WRITER_H
+
+#include <sys/uio.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "../utils/IoUring.h"
+#include "../utils/LogView.h"
+#include "../utils/utils.h"
+
+namespace fs_testing {
+
+// Counters for the work done writing crash states out to disk.
+struct WriteStats {
+  unsigned long int syscalls = 0;
+  unsigned long int bytes = 0;
+
+  WriteStats& operator+=(const WriteStats& other);
+};
+
+// Copy of every payload in a log packed into one block aligned buffer. Used as
+// the source of O_DIRECT writes and registered as a fixed buffer with io_uring.
+// Readonly after Init, so it can be shared between threads.
+class AlignedLog {
+ public:
+  ~AlignedLog();
+  bool Init(std::vector<fs_testing::utils::disk_write>& log);
+  void* Base() const;
+  size_t Size() const;
+  // Aligned copy of the payload of dw or NULL if dw isn't in the log.
+  char* Find(fs_testing::utils::disk_write& dw) const;
+  char* Find(const char* data) const;
+
+ private:
+  char* base_ = NULL;
+  size_t size_ = 0;
+  // Payloads are shared between copies of a disk_write, so key on the data.
+  std::unordered_map<const char*, unsigned long int> offsets_;
+};
+
+// Writes a crash state to a block device with as few system calls as possible.
+// Bios that don't overlap any other bio in the crash state are sorted by sector
+// and runs of adjacent bios are written with a single pwritev. Bios that do
+// overlap are written in the order they appear in the crash state, so the disk
+// ends up the same as if every bio had been written in order.
+//
+// After InitUring, writes are instead queued on an io_uring from the aligned
+// copy of the log. Bios that are adjacent both on disk and in the log are
+// merged into a single write. Overlapping bios are linked so that they still
+// complete in order, and the ring is drained every time it fills up.
+// *** This is not a thread-safe class. ***
+class CrashStateWriter {
+ public:
+  bool Write(const int disk_fd,
+      const std::vector<fs_testing::utils::disk_write>::iterator& start,
+      const std::vector<fs_testing::utils::disk_write>::iterator& end,
+      WriteStats* stats);
+  // Write bios [start, end) of log in log order.
+  bool Write(const int disk_fd, const fs_testing::utils::LogView& log,
+      const std::size_t start, const std::size_t end, WriteStats* stats);
+  // Write the bios named by log entries [start, end) of a crash state.
+  bool Write(const int disk_fd, const fs_testing::utils::LogView& log,
+      const std::vector<unsigned int>::const_iterator& start,
+      const std::vector<unsigned int>::const_iterator& end,
+      WriteStats* stats);
+  // Switch to writing through io_uring from log. Returns false, leaving the
+  // writer as it was, if io_uring isn't usable on this kernel.
+  bool InitUring(const AlignedLog* log);
+  // Goes back to false if the ring breaks. Later writes then go through
+  // pwritev from the log itself, so the disk must not be opened O_DIRECT.
+  bool UsingUring() const;
+
+ private:
+  struct extent {
+    unsigned long int start;
+    unsigned long int end;
+    unsigned int index;
+    char* data;
+  };
+
+  // Add a bio to extents_, using the aligned copy of its data if there is one.
+  bool AddExtent(const unsigned long int sector, const unsigned int size,
+      const unsigned int index, const char* data);
+  // Write out everything in extents_.
+  bool WriteExtents(const int disk_fd, WriteStats* stats);
+  bool AddToRun(const int disk_fd, const extent& e, WriteStats* stats);
+  bool FlushRun(const int disk_fd, WriteStats* stats);
+  // True if e can be written as part of the same fixed buffer write as run.
+  static bool Follows(const extent& run, const extent& e);
+  bool AddToFixedRun(const int disk_fd, const extent& e, WriteStats* stats);
+  bool QueueFixedRun(const int disk_fd, WriteStats* stats);
+  bool QueueGroup(const int disk_fd, std::vector<extent>& group,
+      WriteStats* stats);
+  bool DrainRing(WriteStats* stats);
+
+  // Reused between calls so that writing a crash state doesn't allocate.
+  std::vector<extent> extents_;
+  std::vector<extent> overlapping_;
+  std::vector<struct iovec> run_;
+  unsigned long int run_start_ = 0;
+  unsigned long int run_end_ = 0;
+
+  const AlignedLog* aligned_log_ = NULL;
+  // Sequential writes waiting to be queued on the ring. Empty if data is NULL.
+  extent fixed_run_ = {0, 0, 0, NULL};
+  fs_testing::utils::IoUring ring_;
+};
+
+}  // namespace fs_testing
+
+#endif  // HARNESS_CRASH_STATE_WRITER_H
@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <sched.h>
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
@@ -7,6 +8,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 
 #include <algorithm>
@@ -14,9 +16,12 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <thread>
 
 #include "../disk_wrapper_ioctl.h"
 #include "Tester.h"
+#include "../utils/LogArena.h"
+#include "../utils/ProfileLog.h"
 
 #define TEST_CLASS_FACTORY        "test_case_get_instance"
 #define TEST_CLASS_DEFACTORY      "test_case_delete_instance"
@@ -35,11 +40,10 @@
 #define MNT_WRAPPER_DEV_PATH FULL_WRAPPER_PATH
 #define MNT_MNT_POINT        "/mnt/snapshot"
 
-#define PART_PART_DRIVE   "fdisk "
-#define PART_PART_DRIVE_2 " << EOF\no\nn\np\n1\n\n\nw\nEOF\n"
-#define PART_DEL_PART_DRIVE   "fdisk "
-#define PART_DEL_PART_DRIVE_2 " << EOF\no\nw\nEOF\n"
-#define FMT_FMT_DRIVE   "mkfs -t "
+#define PART_PART_DRIVE       "fdisk"
+#define PART_PART_INPUT       "o\nn\np\n1\n\n\nw\n"
+#define PART_DEL_PART_INPUT   "o\nw\n"
+#define FMT_FMT_DRIVE         "mkfs"
 
 #define WRAPPER_MODULE_NAME "../build/disk_wrapper.ko"
 #define WRAPPER_INSMOD      "insmod " WRAPPER_MODULE_NAME " target_device_path="
@@ -50,19 +54,36 @@
 #define COW_BRD_INSMOD      "insmod " COW_BRD_MODULE_NAME " num_disks="
 #define COW_BRD_INSMOD2      " num_snapshots="
 #define COW_BRD_INSMOD3      " disk_size="
+#define COW_BRD_INSMOD4      " num_checkpoints="
 #define COW_BRD_RMMOD       "rmmod " COW_BRD_MODULE_NAME
 #define NUM_DISKS           "1"
-#define NUM_SNAPSHOTS       "1"
 #define SNAPSHOT_PATH       "/dev/cow_ram_snapshot1_0"
+#define SNAPSHOT_PATH_BASE  "/dev/cow_ram_snapshot"
+#define SNAPSHOT_PATH_DISK  "_0"
+#define CHECKPOINT_PATH_BASE "/dev/cow_ram_checkpoint"
+#define BASE_IMAGE_SUFFIX   ".img"
+// Bump when anything about how base images are made changes.
+#define BASE_IMAGE_VERSION  "2"
 #define COW_BRD_PATH        "/dev/cow_ram0"
 
+#define DISK_IMAGE_MAGIC    "CMDISKIM"
+#define DISK_IMAGE_VERSION  1
+// Pages copied between the device and an image at a time.
+#define DISK_IMAGE_CHUNK_PAGES 256
+// Populated page indices asked of cow_brd at a time.
+#define DISK_IMAGE_INDEX_BATCH 4096
+
 #define DEV_SECTORS_PATH    "/sys/block/"
 #define DEV_SECTORS_PATH_2  "/size"
 
 #define SECTOR_SIZE 512
 
-// TODO(ashmrtn): Expand to work with other file system types.
-#define TEST_CASE_FSCK "fsck -T -t "
+// Run the file system specific checker directly instead of going through the
+// fsck wrapper.
+#define TEST_CASE_FSCK "fsck."
+
+// Most output kept from a single command run by the harness.
+#define COMMAND_OUTPUT_SIZE (16 * 1024)
 
 namespace fs_testing {
 
@@ -70,6 +91,7 @@ using std::calloc;
 using std::cerr;
 using std::chrono::steady_clock;
 using std::chrono::duration_cast;
+using std::chrono::microseconds;
 using std::chrono::milliseconds;
 using std::chrono::time_point;
 using std::cout;
@@ -79,7 +101,10 @@ using std::ifstream;
 using std::ostream;
 using std::ofstream;
 using std::shared_ptr;
+using std::lock_guard;
+using std::mutex;
 using std::string;
+using std::thread;
 using std::vector;
 
 using fs_testing::tests::test_create_t;
@@ -87,10 +112,93 @@ using fs_testing::tests::test_destroy_t;
 using fs_testing::permuter::Permuter;
 using fs_testing::permuter::permuter_create_t;
 using fs_testing::permuter::permuter_destroy_t;
+using fs_testing::permuter::CrashStateEntries;
+using fs_testing::permuter::CrashStateSignature;
+using fs_testing::tests::DataTestResult;
 using fs_testing::utils::disk_write;
+using fs_testing::utils::Fingerprint;
+using fs_testing::utils::FingerprintBuilder;
+using fs_testing::utils::LatencyHistogram;
+using fs_testing::utils::LogArena;
+using fs_testing::utils::ProcessResult;
+using fs_testing::utils::communication::HarnessStats;
+
+namespace {
+
+// Disk images are a disk_image_header followed by num_extents extents, each a
+// disk_image_extent and then the data of its num_pages pages. Pages of the disk
+// in no extent are all zero.
+struct disk_image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint64_t device_bytes;
+  uint64_t num_extents;
+};
+
+struct disk_image_extent {
+  uint64_t first_page;
+  uint64_t num_pages;
+};
+
+bool pread_all(const int fd, void* buf, const size_t len, const off_t off) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t res = pread(fd, (char*) buf + done, len - done, off + done);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    } else if (res <= 0) {
+      return false;
+    }
+    done += res;
+  }
+  return true;
+}
+
+bool pwrite_all(const int fd, const void* buf, const size_t len,
+    const off_t off) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t res =
+      pwrite(fd, (const char*) buf + done, len - done, off + done);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    } else if (res < 0) {
+      return false;
+    }
+    done += res;
+  }
+  return true;
+}
+
+bool is_zero(const char* buf, const size_t len) {
+  return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+// Copy a disk image without a header, the start of the device byte for byte,
+// onto a wiped device. Zero chunks are already zero on the device.
+bool copy_raw_image(const int image_fd, const int device_fd,
+    const uint64_t size) {
+  vector<char> buf(DISK_IMAGE_CHUNK_PAGES * sysconf(_SC_PAGESIZE));
+  for (uint64_t done = 0; done < size;) {
+    const size_t len = std::min((uint64_t) buf.size(), size - done);
+    if (!pread_all(image_fd, buf.data(), len, done)) {
+      return false;
+    }
+    if (!is_zero(buf.data(), len)
+        && !pwrite_all(device_fd, buf.data(), len, done)) {
+      return false;
+    }
+    done += len;
+  }
+  return true;
+}
+
+}  // namespace
 
 Tester::Tester(const unsigned int dev_size, const bool verbosity)
-  : device_size(dev_size), verbose(verbosity) {}
+  : device_size(dev_size), verbose(verbosity),
+    command_runner(COMMAND_OUTPUT_SIZE) {}
 
 void Tester::set_fs_type(const string type) {
   fs_type = type;
@@ -105,6 +213,55 @@ void Tester::set_flag_device(const std::string device_path) {
   flags_device = device_path;
 }
 
+void Tester::set_num_workers(const unsigned int workers) {
+  num_workers = workers;
+}
+
+void Tester::set_num_checkpoints(const unsigned int checkpoints) {
+  num_checkpoints = checkpoints;
+}
+
+void Tester::set_use_uring(const bool uring) {
+  use_uring = uring;
+}
+
+int Tester::open_result_log(const string& path) {
+  if (!result_writer.Open(path)) {
+    return RESULT_LOG_ERR;
+  }
+  return SUCCESS;
+}
+
+void Tester::set_base_image_cache(const string& dir, const string& opts) {
+  base_image_dir = dir;
+  base_image_opts = opts;
+}
+
+void Tester::set_time_budget(const std::chrono::seconds budget) {
+  time_budget = budget;
+}
+
+void Tester::set_min_new_state_rate(const double rate) {
+  min_new_state_rate = rate;
+}
+
+void Tester::set_shard(const unsigned int id, const unsigned int shards,
+    const unsigned int seed) {
+  shard_id = id;
+  num_shards = shards;
+  permuter_seed = seed;
+}
+
+void Tester::set_result_cache(const string& path, const string& opts) {
+  result_cache_path = path;
+  result_cache_opts = opts;
+}
+
+string Tester::snapshot_path(const unsigned int worker) {
+  // cow_brd numbers snapshots starting at 1.
+  return SNAPSHOT_PATH_BASE + std::to_string(worker + 1) + SNAPSHOT_PATH_DISK;
+}
+
 int Tester::clone_device() {
   std::cout << "cloning device " << device_raw << std::endl;
   if (ioctl(cow_brd_fd, COW_BRD_SNAPSHOT) < 0) {
@@ -173,9 +330,11 @@ int Tester::insert_cow_brd() {
     string command(COW_BRD_INSMOD);
     command += NUM_DISKS;
     command += COW_BRD_INSMOD2;
-    command += NUM_SNAPSHOTS;
+    command += std::to_string(num_workers);
     command += COW_BRD_INSMOD3;
     command += std::to_string(device_size);
+    command += COW_BRD_INSMOD4;
+    command += std::to_string(num_checkpoints);
     if (!verbose) {
       command += SILENT;
     }
@@ -215,7 +374,7 @@ int Tester::insert_wrapper() {
   if (!wrapper_inserted) {
     string command(WRAPPER_INSMOD);
     // TODO(ashmrtn): Make this much MUCH cleaner...
-    command += "/dev/cow_ram_snapshot1_0";
+    command += SNAPSHOT_PATH;
     command += WRAPPER_INSMOD2;
     command += flags_device;
     if (!verbose) {
@@ -256,6 +415,44 @@ void Tester::put_wrapper_ioctl() {
   }
 }
 
+int Tester::quiesce_wrapper(const milliseconds idle,
+    const milliseconds timeout) {
+  unsigned long long last_bio_ns;
+  if (ioctl_fd == -1 || ioctl(ioctl_fd, HWM_GET_LAST_BIO, &last_bio_ns) < 0) {
+    return QUIESCE_ERR;
+  }
+  const int mount_fd = open(MNT_MNT_POINT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (mount_fd < 0) {
+    return QUIESCE_ERR;
+  }
+  const int sync_res = syncfs(mount_fd);
+  close(mount_fd);
+  if (sync_res < 0) {
+    return QUIESCE_ERR;
+  }
+
+  // The wrapper stamps bios with the monotonic clock, which is what
+  // steady_clock reads on Linux.
+  const time_point<steady_clock> deadline = steady_clock::now() + timeout;
+  while (true) {
+    if (ioctl(ioctl_fd, HWM_GET_LAST_BIO, &last_bio_ns) < 0) {
+      return QUIESCE_ERR;
+    }
+    const time_point<steady_clock> now = steady_clock::now();
+    const std::chrono::nanoseconds since_bio =
+      now.time_since_epoch() - std::chrono::nanoseconds(last_bio_ns);
+    if (since_bio >= idle) {
+      return SUCCESS;
+    }
+    if (now >= deadline) {
+      return QUIESCE_TIMEOUT_ERR;
+    }
+    // Nothing can change the answer before the window would end.
+    std::this_thread::sleep_for(
+        std::min<std::chrono::nanoseconds>(idle - since_bio, deadline - now));
+  }
+}
+
 void Tester::begin_wrapper_logging() {
   if (ioctl_fd != -1) {
     ioctl(ioctl_fd, HWM_LOG_ON);
@@ -284,7 +481,13 @@ int Tester::get_wrapper_log() {
         }
       }
 
-      char* data = new char[meta.size];
+      // Have the wrapper copy the data straight into the arena.
+      char* data = LogArena::Default().Allocate(meta.size);
+      if (data == NULL && meta.size > 0) {
+        cerr << "unable to allocate log data\n";
+        log_data.clear();
+        return WRAPPER_MEM_ERR;
+      }
       result = ioctl(ioctl_fd, HWM_GET_LOG_DATA, data);
       if (result == -1) {
         if (errno == ENODATA) {
@@ -297,8 +500,9 @@ int Tester::get_wrapper_log() {
           return WRAPPER_MEM_ERR;
         }
       }
-      log_data.emplace_back(meta, data);
-      delete[] data;
+      log_data.emplace_back();
+      log_data.back().metadata = meta;
+      log_data.back().assign_data(data);
 
       result = ioctl(ioctl_fd, HWM_NEXT_ENT);
       if (result == -1) {
@@ -314,6 +518,7 @@ int Tester::get_wrapper_log() {
       }
     }
   }
+  log_view.Build(log_data);
   std::cout << "fetched " << log_data.size() << " log data entries"
       << std::endl;
   return SUCCESS;
@@ -326,6 +531,7 @@ void Tester::clear_wrapper_log() {
 }
 
 int Tester::test_load_class(const char* path) {
+  test_path = path;
   return test_loader.load_class<test_create_t *>(path, TEST_CLASS_FACTORY,
       TEST_CLASS_DEFACTORY);
 }
@@ -390,16 +596,25 @@ bool Tester::write_dirty_expire_time(const int fd, const char* time) {
   return true;
 }
 
+int Tester::run_command(const vector<string>& args, const string& input,
+    ProcessResult* result) {
+  if (command_runner.Run(args, input, result) < 0) {
+    cerr << "error running " << args.front() << endl;
+    return -1;
+  }
+  if (verbose) {
+    cout << result->output;
+  }
+  return result->status;
+}
+
 int Tester::partition_drive() {
   if (device_raw.empty()) {
     return PART_PART_ERR;
   }
-  string command(PART_PART_DRIVE + device_raw);
-  if (!verbose) {
-    command += SILENT;
-  }
-  command += PART_PART_DRIVE_2;
-  if (system(command.c_str()) != 0) {
+  ProcessResult result;
+  if (run_command({PART_PART_DRIVE, device_raw}, PART_PART_INPUT, &result)
+      != 0) {
     return PART_PART_ERR;
   }
   // Since we added a parition on the drive we should use the first partition.
@@ -411,12 +626,9 @@ int Tester::wipe_partitions() {
   if (device_raw.empty()) {
     return PART_PART_ERR;
   }
-  string command(PART_DEL_PART_DRIVE + device_raw);
-  if (!verbose) {
-    command += SILENT;
-  }
-  command += PART_DEL_PART_DRIVE_2;
-  if (system(command.c_str()) != 0) {
+  ProcessResult result;
+  if (run_command({PART_PART_DRIVE, device_raw}, PART_DEL_PART_INPUT, &result)
+      != 0) {
     return PART_PART_ERR;
   }
   return SUCCESS;
@@ -426,11 +638,9 @@ int Tester::format_drive() {
   if (device_raw.empty()) {
     return PART_PART_ERR;
   }
-  string command(FMT_FMT_DRIVE + fs_type + " " +  device_mount);
-  if (!verbose) {
-    command += SILENT;
-  }
-  if (system(command.c_str()) != 0) {
+  ProcessResult result;
+  if (run_command({FMT_FMT_DRIVE, "-t", fs_type, device_mount}, "", &result)
+      != 0) {
     return FMT_FMT_ERR;
   }
   return SUCCESS;
@@ -448,126 +658,615 @@ int Tester::test_check_random_permutations(const int num_rounds) {
   time_point<steady_clock> start_time = steady_clock::now();
   TestSuiteResult test_suite;
   Permuter *p = permuter_loader.get_instance();
-  p->InitDataVector(&log_data);
-  vector<disk_write> permutes;
-  for (int rounds = 0; rounds < num_rounds; ++rounds) {
-    // Print status every 1024 iterations.
-    if (rounds & (~((1 << 10) - 1)) && !(rounds & ((1 << 10) - 1))) {
-      cout << rounds << std::endl;
-    }
-
-    /***************************************************************************
-     * Generate and write out a crash state.
-     **************************************************************************/
-
-    // Begin permute timing.
-    time_point<steady_clock> permute_start_time = steady_clock::now();
-    bool new_state = p->GenerateCrashState(permutes);
-    time_point<steady_clock> permute_end_time = steady_clock::now();
-    timing_stats[PERMUTE_TIME] +=
-        duration_cast<milliseconds>(permute_end_time - permute_start_time);
-    // End permute timing.
-
-    if (!new_state) {
-      break;
-    }
+  p->InitShard(shard_id, num_shards, permuter_seed);
+  p->InitDataVector(&log_data, log_view);
+  if (make_checkpoints(p) != SUCCESS) {
+    cerr << "error making checkpoints, replaying crash states from the start"
+      << endl;
+    checkpoint_epochs.resize(1);
+    checkpoint_ops.resize(1);
+  }
 
-    SingleTestInfo test_info;
+  if (!result_cache_path.empty() && open_result_cache() != SUCCESS) {
+    cerr << "error opening result cache " << result_cache_path
+      << ", checking every crash state" << endl;
+  }
 
-    //cout << '.' << std::flush;
+  check_state shared;
+  shared.num_rounds = num_rounds;
+  shared.recent_new.assign(DISCOVERY_WINDOW, false);
+  if (time_budget.count() > 0) {
+    shared.has_deadline = true;
+    shared.deadline = start_time + time_budget;
+  }
 
-    // Restore disk clone.
-    int cow_brd_snapshot_fd = open(SNAPSHOT_PATH, O_WRONLY);
-    if (cow_brd_snapshot_fd < 0) {
-      cerr << "error opening snapshot to write permuted bios" << endl;
-      test_info.fs_test.SetError(FileSystemTestResult::kSnapshotRestore);
-      continue;
+  progress.completed = 0;
+  progress.reused = 0;
+  progress.cached = 0;
+  progress.passed = 0;
+  progress.passed_fixed = 0;
+  progress.failed = 0;
+  progress.old_file_persisted = 0;
+  progress.file_missing = 0;
+  progress.file_data_corrupted = 0;
+  progress.file_metadata_corrupted = 0;
+  progress.other = 0;
+  for (unsigned int i = 0; i < TOTAL_TIME; ++i) {
+    progress.stage_us[i] = 0;
+  }
+  progress.states_target = num_rounds;
+  progress.end_ns = 0;
+  progress.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      start_time.time_since_epoch()).count();
+  if (use_uring) {
+    if (aligned_log.Init(log_data)) {
+      shared.aligned_log = &aligned_log;
+    } else {
+      cerr << "error making aligned copy of log, writing crash states with "
+        << "pwritev" << endl;
     }
-    // Begin snapshot timing.
-    time_point<steady_clock> snapshot_start_time = steady_clock::now();
-    if (clone_device_restore(cow_brd_snapshot_fd, false) != SUCCESS) {
-      test_info.fs_test.SetError(FileSystemTestResult::kSnapshotRestore);
-      test_suite.AddCompletedTest(test_info);
-      continue;
+  }
+  vector<worker_result> worker_results(num_workers);
+  if (num_workers == 1) {
+    test_check_worker(0, &shared, &worker_results.at(0));
+  } else {
+    vector<thread> workers;
+    for (unsigned int i = 0; i < num_workers; ++i) {
+      workers.emplace_back(&Tester::test_check_worker, this, i, &shared,
+          &worker_results.at(i));
     }
-    time_point<steady_clock> snapshot_end_time = steady_clock::now();
-    timing_stats[SNAPSHOT_TIME] +=
-        duration_cast<milliseconds>(snapshot_end_time - snapshot_start_time);
-    // End snapshot timing.
-
-    // Write recorded data out to block device in different orders so that we
-    // can if they are all valid or not.
-    time_point<steady_clock> bio_write_start_time = steady_clock::now();
-    const int write_data_res =
-      test_write_data(cow_brd_snapshot_fd, permutes.begin(), permutes.end());
-    time_point<steady_clock> bio_write_end_time = steady_clock::now();
-    timing_stats[BIO_WRITE_TIME] +=
-        duration_cast<milliseconds>(bio_write_end_time - bio_write_start_time);
-    if (!write_data_res) {
-      test_info.fs_test.SetError(FileSystemTestResult::kBioWrite);
-      test_suite.AddCompletedTest(test_info);
-      close(cow_brd_snapshot_fd);
-      continue;
+    for (auto& worker : workers) {
+      worker.join();
     }
-    close(cow_brd_snapshot_fd);
+  }
+  if (shared.failed_workers == num_workers) {
+    cerr << "no worker was able to check crash states" << endl;
+    return WORKER_ERR;
+  }
 
-    /***************************************************************************
-     * Begin testing the crash state that was just written out.
-     **************************************************************************/
+  // Fold the results of all workers back together.
+  for (const worker_result& result : worker_results) {
+    test_suite.Merge(result.test_suite);
+    for (unsigned int j = 0; j < NUM_TIME; ++j) {
+      timing_stats[j].Merge(result.timing_stats[j]);
+    }
+    write_stats += result.write_stats;
+  }
 
-    string command(TEST_CASE_FSCK + fs_type + " " + SNAPSHOT_PATH
-        + " -- -y");
-    if (!verbose) {
-      command += SILENT;
+  if (result_writer.IsOpen() && !result_writer.Flush()) {
+    cerr << "error writing to result log" << endl;
+  }
+  // Left over if no crash state with their signature was checked without a
+  // harness error before the run stopped.
+  unsigned int unchecked = 0;
+  for (const auto& waiting : shared.waiting) {
+    unchecked += waiting.second.size();
+  }
+  if (unchecked > 0) {
+    cerr << unchecked << " crash states left unchecked after harness errors"
+      << endl;
+  }
+
+  //cout << endl;
+  test_results_.push_back(test_suite);
+  time_point<steady_clock> end_time = steady_clock::now();
+  timing_stats[TOTAL_TIME].Record(end_time - start_time);
+  progress.end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end_time.time_since_epoch()).count();
+
+  last_stop_reason = shared.reason;
+  last_coverage = (shared.generated == 0)
+    ? 0 : 1.0 - (double) shared.singletons / shared.generated;
+  cout << "=============== Stopped at " << test_suite.GetCompleted()
+    << " tests: " << last_stop_reason << ", estimated "
+    << last_coverage * 100 << "% of crash states covered ==============="
+    << endl << endl;
+  return SUCCESS;
+}
+
+int Tester::open_result_cache() {
+  result_cache_open = false;
+  if (!result_cache.Open(result_cache_path)) {
+    return RESULT_CACHE_ERR;
+  }
+
+  // The result of a crash state depends on the profile, the base image it is
+  // replayed on, the file system and how it is mounted, and the test case that
+  // checks it.
+  FingerprintBuilder builder;
+  builder.Update(fs_type);
+  builder.Update(result_cache_opts);
+  for (disk_write& dw : log_data) {
+    builder.Update(&dw.metadata.bi_flags, sizeof(dw.metadata.bi_flags));
+    builder.Update(&dw.metadata.bi_rw, sizeof(dw.metadata.bi_rw));
+    builder.Update(&dw.metadata.write_sector,
+        sizeof(dw.metadata.write_sector));
+    builder.Update(&dw.metadata.size, sizeof(dw.metadata.size));
+    if (dw.get_data() != NULL) {
+      builder.Update(dw.get_data(), dw.metadata.size);
     }
-    // Begin fsck timing.
-    time_point<steady_clock> fsck_start_time = steady_clock::now();
-    test_info.fs_test.fs_check_return = system(command.c_str());
-    time_point<steady_clock> fsck_end_time = steady_clock::now();
-    timing_stats[FSCK_TIME] +=
-        duration_cast<milliseconds>(fsck_end_time - fsck_start_time);
-    // End fsck timing.
-    if (!(test_info.fs_test.fs_check_return == 0
-          || WEXITSTATUS(test_info.fs_test.fs_check_return) == 1)) {
-      /*
-      cerr << "Error running fsck on snapshot file system: " <<
-        WEXITSTATUS(fsck_res) << "\n";
-      */
-      test_info.fs_test.SetError(FileSystemTestResult::kCheck);
-      test_suite.AddCompletedTest(test_info);
-      continue;
+  }
+
+  vector<char> buf(1024 * 1024);
+  const int base_fd = open(snapshot_path(0).c_str(), O_RDONLY);
+  if (base_fd < 0) {
+    return RESULT_CACHE_ERR;
+  }
+  if (clone_device_restore(base_fd, false) != SUCCESS) {
+    close(base_fd);
+    return RESULT_CACHE_ERR;
+  }
+  ssize_t res;
+  while ((res = read(base_fd, buf.data(), buf.size())) > 0) {
+    builder.Update(buf.data(), res);
+  }
+  close(base_fd);
+  if (res < 0) {
+    return RESULT_CACHE_ERR;
+  }
+
+  const int test_fd = open(test_path.c_str(), O_RDONLY);
+  if (test_fd < 0) {
+    return RESULT_CACHE_ERR;
+  }
+  while ((res = read(test_fd, buf.data(), buf.size())) > 0) {
+    builder.Update(buf.data(), res);
+  }
+  close(test_fd);
+  if (res < 0) {
+    return RESULT_CACHE_ERR;
+  }
+
+  profile_fingerprint = builder.Digest();
+  result_cache_open = true;
+  cout << "loaded " << result_cache.Size() << " cached results" << endl;
+  return SUCCESS;
+}
+
+Fingerprint Tester::result_cache_key(const CrashStateSignature& signature) {
+  FingerprintBuilder builder;
+  builder.Update(&profile_fingerprint, sizeof(profile_fingerprint));
+  builder.Update(signature.data(),
+      signature.size() * sizeof(CrashStateSignature::value_type));
+  return builder.Digest();
+}
+
+int Tester::make_checkpoints(Permuter* p) {
+  checkpoint_epochs.assign(1, 0);
+  checkpoint_ops.assign(1, 0);
+  if (num_checkpoints == 0) {
+    return SUCCESS;
+  }
+
+  // Spread the checkpoints evenly over the epoch boundaries. There is no point
+  // in a checkpoint after the final epoch as no crash state starts there.
+  const unsigned int num_epochs = p->GetNumEpochs();
+  const unsigned int interval =
+    std::max(1u, (num_epochs + num_checkpoints) / (num_checkpoints + 1));
+  vector<disk_write> epoch_data;
+  for (unsigned int i = 1; i <= num_checkpoints; ++i) {
+    const unsigned int end_epoch = i * interval;
+    if (end_epoch >= num_epochs) {
+      break;
     }
-    // TODO(ashmrtn): Consider mounting with options specified for test
-    // profile?
-    if (mount_device(SNAPSHOT_PATH, NULL) != SUCCESS) {
-      test_info.fs_test.SetError(FileSystemTestResult::kUnmountable);
-      test_suite.AddCompletedTest(test_info);
-      continue;
+    const string path = CHECKPOINT_PATH_BASE + std::to_string(i)
+      + SNAPSHOT_PATH_DISK;
+    const int checkpoint_fd = open(path.c_str(), O_WRONLY);
+    if (checkpoint_fd < 0) {
+      return CHECKPOINT_ERR;
+    }
+    // Stack this checkpoint on the previous one so that it only has to hold
+    // the bios since then.
+    if (ioctl(checkpoint_fd, COW_BRD_RESTORE_CHECKPOINT, i - 1) < 0) {
+      close(checkpoint_fd);
+      return CHECKPOINT_ERR;
+    }
+    p->GetEpochData(checkpoint_epochs.back(), end_epoch, epoch_data);
+    if (!test_write_data(checkpoint_fd, epoch_data.begin(), epoch_data.end())
+        || fsync(checkpoint_fd) < 0
+        || ioctl(checkpoint_fd, COW_BRD_SNAPSHOT) < 0) {
+      close(checkpoint_fd);
+      return CHECKPOINT_ERR;
+    }
+    close(checkpoint_fd);
+    checkpoint_ops.push_back(checkpoint_ops.back() + epoch_data.size());
+    checkpoint_epochs.push_back(end_epoch);
+  }
+  cout << "made " << checkpoint_epochs.size() - 1 << " checkpoints every "
+    << interval << " epochs" << endl;
+  return SUCCESS;
+}
+
+void Tester::test_check_worker(const unsigned int worker, check_state* shared,
+    worker_result* result) {
+  Permuter *p = permuter_loader.get_instance();
+  CrashStateWriter writer;
+  CrashStateEntries permutes;
+  unsigned int checkpoint = 0;
+
+  int snapshot_flags = O_WRONLY;
+  if (shared->aligned_log != NULL) {
+    if (writer.InitUring(shared->aligned_log)) {
+      snapshot_flags |= O_DIRECT;
     } else {
-      // Begin test case timing.
-      time_point<steady_clock> test_case_start_time = steady_clock::now();
-      const int test_check_res =
-          test_loader.get_instance()->check_test(&test_info.data_test);
-      time_point<steady_clock> test_case_end_time = steady_clock::now();
-      timing_stats[TEST_CASE_TIME] += duration_cast<milliseconds>(
-        test_case_end_time - test_case_start_time);
-      // End test case timing.
-
-      if (test_check_res == 0 && test_info.fs_test.fs_check_return != 0) {
-        test_info.fs_test.SetError(FileSystemTestResult::kFixed);
+      cerr << "worker " << worker << " unable to set up io_uring, writing "
+        << "crash states with pwritev" << endl;
+    }
+  }
+
+  if (num_workers > 1) {
+    // Test cases expect the crash state to be mounted at MNT_MNT_POINT, so give
+    // each worker its own private mount namespace. That way every worker can
+    // mount its snapshot at the same path without seeing the others.
+    if (unshare(CLONE_NEWNS) < 0
+        || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0) {
+      cerr << "worker " << worker << " unable to make private mount namespace"
+        << endl;
+      lock_guard<mutex> failed_guard(shared->lock);
+      ++shared->failed_workers;
+      return;
+    }
+  }
+
+  while (true) {
+    signature_result* signature = NULL;
+    Fingerprint signature_key;
+    Fingerprint cache_key;
+    uint64_t state_id;
+    {
+      // The permuter is not thread safe, so only one worker may generate a
+      // crash state at a time.
+      lock_guard<mutex> permute_guard(shared->lock);
+      if (shared->done || shared->rounds >= shared->num_rounds) {
+        break;
+      }
+      if (shared->has_deadline && steady_clock::now() >= shared->deadline) {
+        shared->reason = STOP_TIME_BUDGET;
+        shared->done = true;
+        break;
+      }
+      const int rounds = shared->rounds++;
+      state_id = rounds;
+      // Print status every 1024 iterations.
+      if (rounds & (~((1 << 10) - 1)) && !(rounds & ((1 << 10) - 1))) {
+        cout << rounds << std::endl;
+      }
+
+      // Begin permute timing.
+      time_point<steady_clock> permute_start_time = steady_clock::now();
+      bool new_state = p->GenerateCrashState(permutes);
+      time_point<steady_clock> permute_end_time = steady_clock::now();
+      record_time(result, PERMUTE_TIME, permute_end_time - permute_start_time);
+      // End permute timing.
+
+      if (!new_state) {
+        shared->reason = STOP_EXHAUSTED;
+        shared->done = true;
+        break;
+      }
+
+      // Skip crash states that leave the disk the same as one that was already
+      // checked. If the other one is still being checked, its worker hands out
+      // the result when it is done.
+      FingerprintBuilder signature_builder;
+      signature_builder.Update(p->GetCrashStateSignature().data(),
+          p->GetCrashStateSignature().size()
+          * sizeof(CrashStateSignature::value_type));
+      signature_key = signature_builder.Digest();
+      auto inserted =
+        shared->signatures.emplace(signature_key, signature_result());
+      signature = &inserted.first->second;
+      if (signature->seen == 0) {
+        ++shared->singletons;
+      } else if (signature->seen == 1) {
+        --shared->singletons;
+      }
+      ++signature->seen;
+      ++shared->generated;
+      if (min_new_state_rate > 0 && count_discovery(shared, inserted.second)) {
+        shared->reason = STOP_DISCOVERY_RATE;
+        shared->done = true;
+      }
+      if (signature->done) {
+        reuse_result(signature_key, *signature, state_id,
+            ResultRecord::kReused, result);
+        continue;
+      } else if (signature->checking) {
+        shared->waiting[signature_key].push_back(state_id);
+        continue;
+      }
+      signature->checking = true;
+
+      // Failing that, an earlier run may have checked it. A signature checked
+      // again after a harness error already missed the cache.
+      CachedResult cached;
+      if (result_cache_open) {
+        cache_key = result_cache_key(p->GetCrashStateSignature());
+        if (inserted.second && result_cache.Lookup(cache_key, &cached)) {
+          signature->fs_check_return = cached.fs_check_return;
+          signature->fs_error = cached.fs_error;
+          signature->data_error = cached.data_error;
+          signature->done = true;
+          reuse_result(signature_key, *signature, state_id,
+              ResultRecord::kCached, result);
+          continue;
+        }
+      }
+
+      // Start from the latest checkpoint that the crash state agrees with.
+      const unsigned int unpermuted = p->GetUnpermutedEpochs();
+      checkpoint = checkpoint_epochs.size() - 1;
+      while (checkpoint_epochs.at(checkpoint) > unpermuted) {
+        --checkpoint;
       }
-      test_suite.AddCompletedTest(test_info);
     }
-    umount_device();
+
+    SingleTestInfo test_info;
+    microseconds stage_times[ResultRecord::kNumStages] = {};
+    const int check_res = test_check_state(worker, snapshot_flags, &writer,
+        permutes, checkpoint, result, &test_info, stage_times);
+    if ((snapshot_flags & O_DIRECT) && !writer.UsingUring()) {
+      cerr << "worker " << worker << " lost its io_uring, writing crash "
+        << "states with pwritev" << endl;
+      snapshot_flags &= ~O_DIRECT;
+    }
+    result->test_suite.AddCompletedTest(test_info);
+    count_progress(test_info, ResultRecord::kChecked);
+
+    lock_guard<mutex> result_guard(shared->lock);
+    // Problems in the harness itself say nothing about the crash state, so
+    // check the next crash state with the signature instead of reusing the
+    // result, and leave it out of the cache so it is tried again next time.
+    const unsigned int harness_errors = FileSystemTestResult::kSnapshotRestore
+      | FileSystemTestResult::kBioWrite;
+    signature->fs_check_return = test_info.fs_test.fs_check_return;
+    signature->fs_error = test_info.fs_test.GetError();
+    signature->data_error = test_info.data_test.GetError();
+    signature->checking = false;
+    signature->done = !(signature->fs_error & harness_errors);
+    ResultRecord record = make_record(signature_key, *signature);
+    for (unsigned int i = 0; i < ResultRecord::kNumStages; ++i) {
+      record.stage_us[i] = stage_times[i].count();
+    }
+    log_result(&record, state_id, ResultRecord::kChecked,
+        test_info.fs_test.fs_check_log);
+    signature->fsck_log_offset = record.fsck_log_offset;
+    signature->fsck_log_size = record.fsck_log_size;
+    auto waiting = shared->waiting.find(signature_key);
+    if (signature->done && waiting != shared->waiting.end()) {
+      for (const uint64_t waiting_id : waiting->second) {
+        reuse_result(signature_key, *signature, waiting_id,
+            ResultRecord::kReused, result);
+      }
+      shared->waiting.erase(waiting);
+    }
+    if (result_cache_open && signature->done) {
+      CachedResult cached;
+      cached.fs_check_return = test_info.fs_test.fs_check_return;
+      cached.fs_error = test_info.fs_test.GetError();
+      cached.data_error = test_info.data_test.GetError();
+      if (!result_cache.Append(cache_key, cached)) {
+        cerr << "error saving result to cache" << endl;
+      }
+    }
+    if (check_res != SUCCESS) {
+      // The crash state is still mounted, so any other crash state this worker
+      // checked would fail to mount or be checked against stale data.
+      cerr << "worker " << worker << " unable to unmount crash state, stopping"
+        << endl;
+      break;
+    }
+  }
+}
+
+bool Tester::count_discovery(check_state* shared, const bool new_signature) {
+  const unsigned int slot = shared->rounds % DISCOVERY_WINDOW;
+  shared->recent_new_count += new_signature;
+  shared->recent_new_count -= shared->recent_new.at(slot);
+  shared->recent_new.at(slot) = new_signature;
+  return shared->rounds >= DISCOVERY_WINDOW
+    && shared->recent_new_count < min_new_state_rate * DISCOVERY_WINDOW;
+}
+
+void Tester::count_progress(const SingleTestInfo& test_info,
+    const ResultRecord::Source source) {
+  ++progress.completed;
+  if (source == ResultRecord::kReused) {
+    ++progress.reused;
+  } else if (source == ResultRecord::kCached) {
+    ++progress.cached;
   }
-  //cout << endl;
-  test_results_.push_back(test_suite);
-  time_point<steady_clock> end_time = steady_clock::now();
-  timing_stats[TOTAL_TIME] = duration_cast<milliseconds>(end_time - start_time);
 
-  if (test_suite.GetCompleted() < num_rounds) {
-    cout << "=============== Unable to find new unique state, stopping at "
-      << test_suite.GetCompleted() << " tests ===============" << endl << endl;
+  const unsigned int fs_error = test_info.fs_test.GetError();
+  const unsigned int data_error = test_info.data_test.GetError();
+  if (fs_error == FileSystemTestResult::kClean
+      && data_error == DataTestResult::kClean) {
+    ++progress.passed;
+  } else if (fs_error == FileSystemTestResult::kFixed
+      && data_error == DataTestResult::kClean) {
+    ++progress.passed_fixed;
+  } else {
+    ++progress.failed;
+    switch (data_error) {
+      case DataTestResult::kOldFilePersisted:
+        ++progress.old_file_persisted;
+        break;
+      case DataTestResult::kFileMissing:
+        ++progress.file_missing;
+        break;
+      case DataTestResult::kFileDataCorrupted:
+        ++progress.file_data_corrupted;
+        break;
+      case DataTestResult::kFileMetadataCorrupted:
+        ++progress.file_metadata_corrupted;
+        break;
+      case DataTestResult::kOther:
+        ++progress.other;
+        break;
+    }
+  }
+}
+
+void Tester::record_time(worker_result* result, const time_stats stage,
+    const std::chrono::nanoseconds time) {
+  result->timing_stats[stage].Record(time);
+  progress.stage_us[stage] += duration_cast<microseconds>(time).count();
+}
+
+ResultRecord Tester::make_record(const Fingerprint& signature_key,
+    const signature_result& signature) {
+  ResultRecord record;
+  memset(&record, 0, sizeof(record));
+  record.signature_lo = signature_key.lo;
+  record.signature_hi = signature_key.hi;
+  record.fs_check_return = signature.fs_check_return;
+  record.fs_error = signature.fs_error;
+  record.data_error = signature.data_error;
+  record.fsck_log_offset = signature.fsck_log_offset;
+  record.fsck_log_size = signature.fsck_log_size;
+  return record;
+}
+
+void Tester::reuse_result(const Fingerprint& signature_key,
+    const signature_result& signature, const uint64_t state_id,
+    const ResultRecord::Source source, worker_result* result) {
+  SingleTestInfo info;
+  info.fs_test.SetError((FileSystemTestResult::ErrorType) signature.fs_error);
+  info.fs_test.fs_check_return = signature.fs_check_return;
+  info.data_test.SetError((DataTestResult::ErrorType) signature.data_error);
+  if (source == ResultRecord::kCached) {
+    result->test_suite.AddCachedTest(info);
+  } else {
+    result->test_suite.AddReusedTest(info);
+  }
+  count_progress(info, source);
+  ResultRecord record = make_record(signature_key, signature);
+  log_result(&record, state_id, source, "");
+}
+
+void Tester::log_result(ResultRecord* record, const uint64_t state_id,
+    const ResultRecord::Source source, const string& fsck_log) {
+  if (!result_writer.IsOpen()) {
+    return;
+  }
+  record->state_id = state_id;
+  record->source = source;
+  if (source != ResultRecord::kChecked) {
+    memset(record->stage_us, 0, sizeof(record->stage_us));
+  }
+  if (!result_writer.Append(record, fsck_log)) {
+    cerr << "error writing to result log, no longer logging results" << endl;
+    result_writer.Close();
+  }
+}
+
+int Tester::test_check_state(const unsigned int worker,
+    const int snapshot_flags, CrashStateWriter* writer,
+    const CrashStateEntries& crash_state, const unsigned int checkpoint,
+    worker_result* result, SingleTestInfo* test_info,
+    microseconds* stage_times) {
+  const string snapshot = snapshot_path(worker);
+
+  // Restore disk clone.
+  int cow_brd_snapshot_fd = open(snapshot.c_str(), snapshot_flags);
+  if (cow_brd_snapshot_fd < 0) {
+    cerr << "error opening snapshot to write permuted bios" << endl;
+    test_info->fs_test.SetError(FileSystemTestResult::kSnapshotRestore);
+    return SUCCESS;
+  }
+  // Begin snapshot timing.
+  time_point<steady_clock> snapshot_start_time = steady_clock::now();
+  const int restore_res = (checkpoint == 0)
+    ? clone_device_restore(cow_brd_snapshot_fd, false)
+    : ioctl(cow_brd_snapshot_fd, COW_BRD_RESTORE_CHECKPOINT, checkpoint);
+  if (restore_res != SUCCESS) {
+    test_info->fs_test.SetError(FileSystemTestResult::kSnapshotRestore);
+    close(cow_brd_snapshot_fd);
+    return SUCCESS;
+  }
+  time_point<steady_clock> snapshot_end_time = steady_clock::now();
+  stage_times[ResultRecord::kSnapshotStage] =
+      duration_cast<microseconds>(snapshot_end_time - snapshot_start_time);
+  record_time(result, SNAPSHOT_TIME, stage_times[ResultRecord::kSnapshotStage]);
+  // End snapshot timing.
+
+  // Write recorded data out to block device in different orders so that we
+  // can if they are all valid or not.
+  time_point<steady_clock> bio_write_start_time = steady_clock::now();
+  // Everything before the checkpoint is already on the snapshot.
+  const int write_data_res = writer->Write(cow_brd_snapshot_fd, log_view,
+      crash_state.begin() + checkpoint_ops.at(checkpoint), crash_state.end(),
+      &result->write_stats);
+  time_point<steady_clock> bio_write_end_time = steady_clock::now();
+  stage_times[ResultRecord::kBioWriteStage] =
+      duration_cast<microseconds>(bio_write_end_time - bio_write_start_time);
+  record_time(result, BIO_WRITE_TIME,
+      stage_times[ResultRecord::kBioWriteStage]);
+  close(cow_brd_snapshot_fd);
+  if (!write_data_res) {
+    test_info->fs_test.SetError(FileSystemTestResult::kBioWrite);
+    return SUCCESS;
+  }
+
+  /***************************************************************************
+   * Begin testing the crash state that was just written out.
+   **************************************************************************/
+
+  // Begin fsck timing.
+  time_point<steady_clock> fsck_start_time = steady_clock::now();
+  ProcessResult fsck_result;
+  test_info->fs_test.fs_check_return =
+    run_command({TEST_CASE_FSCK + fs_type, "-y", snapshot}, "", &fsck_result);
+  time_point<steady_clock> fsck_end_time = steady_clock::now();
+  stage_times[ResultRecord::kFsckStage] =
+      duration_cast<microseconds>(fsck_end_time - fsck_start_time);
+  record_time(result, FSCK_TIME, stage_times[ResultRecord::kFsckStage]);
+  // End fsck timing.
+  // Keep what fsck said about any state it had to touch so that it can be
+  // looked at later without recreating the state.
+  if (test_info->fs_test.fs_check_return != 0) {
+    test_info->fs_test.fs_check_log = fsck_result.output;
+  }
+  if (!(test_info->fs_test.fs_check_return == 0
+        || WEXITSTATUS(test_info->fs_test.fs_check_return) == 1)) {
+    test_info->fs_test.SetError(FileSystemTestResult::kCheck);
+    return SUCCESS;
+  }
+  // TODO(ashmrtn): Consider mounting with options specified for test
+  // profile?
+  // Workers mount directly instead of going through mount_device so that
+  // they don't race on disk_mounted.
+  time_point<steady_clock> mount_start_time = steady_clock::now();
+  const int mount_res =
+      mount(snapshot.c_str(), MNT_MNT_POINT, fs_type.c_str(), 0, NULL);
+  record_time(result, MOUNT_TIME, steady_clock::now() - mount_start_time);
+  if (mount_res < 0) {
+    test_info->fs_test.SetError(FileSystemTestResult::kUnmountable);
+    return SUCCESS;
+  }
+  // Begin test case timing.
+  time_point<steady_clock> test_case_start_time = steady_clock::now();
+  int test_check_res;
+  {
+    lock_guard<mutex> check_test_guard(check_test_lock);
+    test_check_res =
+        test_loader.get_instance()->check_test(&test_info->data_test);
+  }
+  time_point<steady_clock> test_case_end_time = steady_clock::now();
+  stage_times[ResultRecord::kTestCaseStage] = duration_cast<microseconds>(
+    test_case_end_time - test_case_start_time);
+  record_time(result, TEST_CASE_TIME,
+      stage_times[ResultRecord::kTestCaseStage]);
+  // End test case timing.
+
+  if (test_check_res == 0 && test_info->fs_test.fs_check_return != 0) {
+    test_info->fs_test.SetError(FileSystemTestResult::kFixed);
+  }
+  time_point<steady_clock> umount_start_time = steady_clock::now();
+  const int umount_res = umount(MNT_MNT_POINT);
+  record_time(result, UMOUNT_TIME, steady_clock::now() - umount_start_time);
+  if (umount_res < 0) {
+    return MNT_UMNT_ERR;
   }
   return SUCCESS;
 }
@@ -620,7 +1319,8 @@ int Tester::test_restore_log() {
     cout << endl;
     return TEST_CASE_FILE_ERR;
   }
-  if (!test_write_data(sn_fd, log_data.begin(), log_data.end())) {
+  CrashStateWriter writer;
+  if (!writer.Write(sn_fd, log_view, 0, log_view.Size(), NULL)) {
     cout << "test errored in writing data" << endl;
     close(sn_fd);
     return TEST_TEST_ERR;
@@ -631,32 +1331,10 @@ int Tester::test_restore_log() {
 
 bool Tester::test_write_data(const int disk_fd,
     const vector<disk_write>::iterator& start,
-    const vector<disk_write>::iterator& end) {
-  for (auto current = start; current != end; ++current) {
-    // Operation is not a write so skip it.
-    if (!(current->has_write_flag())) {
-      continue;
-    }
-
-    const unsigned long int byte_addr =
-      current->metadata.write_sector * SECTOR_SIZE;
-    if (lseek(disk_fd, byte_addr, SEEK_SET) < 0) {
-      return false;
-    }
-    unsigned int bytes_written = 0;
-    shared_ptr<void> data = current->get_data();
-    void* data_base_addr = data.get();
-    do {
-      int res = write(disk_fd,
-          (void*) ((unsigned long) data_base_addr + bytes_written),
-          current->metadata.size - bytes_written);
-      if (res < 0) {
-        return false;
-      }
-      bytes_written += res;
-    } while (bytes_written < current->metadata.size);
-  }
-  return true;
+    const vector<disk_write>::iterator& end,
+    WriteStats* stats) {
+  CrashStateWriter writer;
+  return writer.Write(disk_fd, start, end, stats);
 }
 
 void Tester::cleanup_harness() {
@@ -705,103 +1383,311 @@ int Tester::clear_caches() {
 }
 
 int Tester::log_profile_save(string log_file) {
-  // TODO(ashmrtn): What happens if this fails?
-  // Open with append flags. We should remove the log file argument and use a
-  // class specific one that is set at class creation time. That way people
-  // don't break our logging system.
   std::cout << "saving " << log_data.size() << " disk operations" << endl;
-  ofstream log(log_file, std::ofstream::trunc);
-  for (const disk_write& dw : log_data) {
-    disk_write::serialize(log, dw);
+  if (!fs_testing::utils::SaveProfile(log_file, fs_type, log_data)) {
+    std::cout << "error " << strerror(errno) << std::endl;
+    return LOG_CLONE_ERR;
   }
-  log.close();
   return SUCCESS;
 }
 
 int Tester::log_profile_load(string log_file) {
-  ifstream log(log_file);
-  while (log.peek() != EOF) {
-    log_data.push_back(disk_write::deserialize(log));
-  }
-  bool err = log.fail();
-  int errnum = errno;
-  log.close();
-  if (err) {
-    std::cout << "error " << strerror(errnum) << std::endl;
+  string profile_fs_type = fs_type;
+  string error;
+  if (!fs_testing::utils::LoadProfile(log_file, &profile_fs_type, &log_data,
+        &error)) {
+    std::cout << "error loading " << log_file << ": " << error << std::endl;
+    return LOG_CLONE_ERR;
+  }
+  if (profile_fs_type != fs_type) {
+    std::cout << "error loading " << log_file << ": recorded on "
+      << profile_fs_type << " but testing " << fs_type << std::endl;
     return LOG_CLONE_ERR;
   }
+  log_view.Build(log_data);
   std::cout << "loaded " << log_data.size() << " disk operations" << endl;
   return SUCCESS;
 }
 
 int Tester::log_snapshot_save(string log_file) {
-  // TODO(ashmrtn): What happens if this fails?
-  // TODO(ashmrtn): Change device_clone to be an mmap of the disk we need to get
-  // stuff on.
-  char device_clone[device_size];
-  unsigned int bytes_read = 0;
-  do {
-    int res = read(cow_brd_fd, device_clone + bytes_read,
-        device_size - bytes_read);
-    if (res < 0) {
-      cerr << "error reading from raw device to log disk snapshot" << endl;
-      break;
-    }
-    bytes_read += res;
-  } while (bytes_read < device_size);
-  ofstream log(log_file, std::ofstream::trunc);
-  log.write(device_clone, device_size);
-  bool err = log.fail();
-  log.flush();
-  log.close();
-  if (err) {
+  if (device_image_save(log_file) != SUCCESS) {
+    cerr << "error saving disk snapshot to " << log_file << endl;
     return LOG_CLONE_ERR;
   }
   return SUCCESS;
 }
 
 int Tester::log_snapshot_load(string log_file) {
-  // TODO(ashmrtn): What happens if this fails?
-  int res = ioctl(cow_brd_fd, COW_BRD_WIPE);
-  if (res < 0) {
-    cerr << "error wiping old disk snapshot" << endl;
-  }
-  ifstream log(log_file);
-  char device_clone[device_size];
-  log.read(device_clone, device_size);
-  bool err = log.fail();
-  int errnum = errno;
-  assert(log.peek() == EOF);
-  log.close();
-  if (err) {
-    std::cout << "error " << strerror(errnum) << std::endl;
+  if (device_image_load(log_file) != SUCCESS) {
+    cerr << "error loading disk snapshot from " << log_file << endl;
+    return LOG_CLONE_ERR;
+  }
+  if (ioctl(cow_brd_fd, COW_BRD_SNAPSHOT) < 0) {
+    cerr << "error restoring snapshot from log" << endl;
     return LOG_CLONE_ERR;
   }
-  // TODO(ashmrtn): Change device_clone to be an mmap of the disk we need to put
-  // stuff on.
-  int device_fd = open(COW_BRD_PATH, O_WRONLY);
-  res = lseek(device_fd, 0, SEEK_SET);
+  return SUCCESS;
+}
+
+string Tester::base_image_path() {
+  // The test case is hashed whole as its setup method can't be picked out of
+  // it.
+  FingerprintBuilder builder;
+  builder.Update(BASE_IMAGE_VERSION);
+  builder.Update(fs_type);
+  builder.Update(&device_size, sizeof(device_size));
+  builder.Update(base_image_opts);
+  vector<char> buf(1024 * 1024);
+  const int test_fd = open(test_path.c_str(), O_RDONLY);
+  if (test_fd < 0) {
+    return "";
+  }
+  ssize_t res;
+  while ((res = read(test_fd, buf.data(), buf.size())) > 0) {
+    builder.Update(buf.data(), res);
+  }
+  close(test_fd);
   if (res < 0) {
-    cerr << "error seeking to start of test device" << endl;
+    return "";
   }
-  unsigned int bytes_written = 0;
-  do {
-    int res = write(device_fd, (void*) (device_clone + bytes_written),
-        device_size - bytes_written);
-    if (res < 0) {
-      int err = errno;
-      cerr << "error writing snapshot to test device " << errno << endl;
-      cerr << "aborting copy after " << bytes_written << endl;
+
+  const Fingerprint key = builder.Digest();
+  char name[2 * sizeof(key) + 1];
+  snprintf(name, sizeof(name), "%016llx%016llx",
+      (unsigned long long) key.hi, (unsigned long long) key.lo);
+  return base_image_dir + "/" + fs_type + "_" + name + BASE_IMAGE_SUFFIX;
+}
+
+int Tester::base_image_load() {
+  if (base_image_dir.empty()) {
+    return BASE_IMAGE_ERR;
+  }
+  const string path = base_image_path();
+  if (path.empty() || access(path.c_str(), R_OK) < 0) {
+    return BASE_IMAGE_ERR;
+  }
+  if (device_image_load(path) != SUCCESS) {
+    cerr << "error loading base image " << path << endl;
+    return BASE_IMAGE_ERR;
+  }
+  cout << "loaded base image " << path << endl;
+  return clone_device();
+}
+
+int Tester::base_image_save() {
+  if (base_image_dir.empty()) {
+    return BASE_IMAGE_ERR;
+  }
+  const string path = base_image_path();
+  if (path.empty()) {
+    return BASE_IMAGE_ERR;
+  }
+  // Other runs may be using the same cache, so only ever rename whole images
+  // into place.
+  const string temp_path = path + "." + std::to_string(getpid());
+  if (device_image_save(temp_path) != SUCCESS
+      || rename(temp_path.c_str(), path.c_str()) < 0) {
+    unlink(temp_path.c_str());
+    return BASE_IMAGE_ERR;
+  }
+  return SUCCESS;
+}
+
+int Tester::populated_pages(const unsigned long start,
+    vector<unsigned long>* pages) {
+  pages->resize(DISK_IMAGE_INDEX_BATCH);
+  struct cow_brd_pages req;
+  req.start = start;
+  req.pages = pages->data();
+  req.max_pages = pages->size();
+  req.num_pages = 0;
+  if (ioctl(cow_brd_fd, COW_BRD_GET_PAGES, &req) < 0) {
+    pages->clear();
+    return BASE_IMAGE_ERR;
+  }
+  pages->resize(req.num_pages);
+  return SUCCESS;
+}
+
+int Tester::device_image_save(const string& path) {
+  const int device_fd = open(COW_BRD_PATH, O_RDONLY);
+  if (device_fd < 0) {
+    return BASE_IMAGE_ERR;
+  }
+  const int image_fd =
+    open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (image_fd < 0) {
+    close(device_fd);
+    return BASE_IMAGE_ERR;
+  }
+
+  disk_image_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DISK_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = DISK_IMAGE_VERSION;
+  header.page_size = sysconf(_SC_PAGESIZE);
+  // device_size is in KB.
+  header.device_bytes = (uint64_t) device_size * 1024;
+  const uint64_t page_size = header.page_size;
+  const uint64_t total_pages =
+    (header.device_bytes + page_size - 1) / page_size;
+
+  vector<char> buf(DISK_IMAGE_CHUNK_PAGES * page_size);
+  vector<unsigned long> pages;
+  off_t image_off = sizeof(header);
+  unsigned long next = 0;
+  int res = SUCCESS;
+  while (res == SUCCESS && next < total_pages) {
+    if (populated_pages(next, &pages) != SUCCESS) {
+      // Older cow_brd modules can't list their pages, so look at all of them.
+      for (unsigned long i = next;
+          i < total_pages && pages.size() < DISK_IMAGE_INDEX_BATCH; ++i) {
+        pages.push_back(i);
+      }
     }
-    bytes_written += res;
-  } while (bytes_written < device_size);
-  fsync(device_fd);
+    if (pages.empty()) {
+      break;
+    }
+    next = pages.back() + 1;
+
+    // Read runs of consecutive pages from the device a chunk at a time and
+    // write out the ones that aren't all zero.
+    for (size_t i = 0; i < pages.size() && res == SUCCESS;) {
+      const uint64_t first = pages.at(i);
+      size_t run = 1;
+      while (i + run < pages.size() && run < DISK_IMAGE_CHUNK_PAGES
+          && pages.at(i + run) == first + run) {
+        ++run;
+      }
+      i += run;
+      if (first >= total_pages) {
+        break;
+      }
+      run = std::min((uint64_t) run, total_pages - first);
+
+      // The last page may run past the end of the device.
+      const off_t device_off = first * page_size;
+      memset(buf.data(), 0, run * page_size);
+      if (!pread_all(device_fd, buf.data(),
+            std::min(run * page_size, header.device_bytes - device_off),
+            device_off)) {
+        res = BASE_IMAGE_ERR;
+        break;
+      }
+      for (size_t p = 0; p < run;) {
+        if (is_zero(buf.data() + p * page_size, page_size)) {
+          ++p;
+          continue;
+        }
+        size_t p_end = p + 1;
+        while (p_end < run
+            && !is_zero(buf.data() + p_end * page_size, page_size)) {
+          ++p_end;
+        }
+        const disk_image_extent extent = {first + p, p_end - p};
+        const size_t len = extent.num_pages * page_size;
+        if (!pwrite_all(image_fd, &extent, sizeof(extent), image_off)
+            || !pwrite_all(image_fd, buf.data() + p * page_size, len,
+              image_off + sizeof(extent))) {
+          res = BASE_IMAGE_ERR;
+          break;
+        }
+        image_off += sizeof(extent) + len;
+        ++header.num_extents;
+        p = p_end;
+      }
+    }
+  }
   close(device_fd);
-  res = ioctl(cow_brd_fd, COW_BRD_SNAPSHOT);
-  if (res < 0) {
-    cerr << "error restoring snapshot from log" << endl;
+
+  // The header goes in last so a partly written image never looks whole.
+  if (res == SUCCESS
+      && (!pwrite_all(image_fd, &header, sizeof(header), 0)
+        || fsync(image_fd) < 0)) {
+    res = BASE_IMAGE_ERR;
   }
-  return SUCCESS;
+  close(image_fd);
+  return res;
+}
+
+int Tester::device_image_load(const string& path) {
+  const int image_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (image_fd < 0) {
+    return BASE_IMAGE_ERR;
+  }
+  struct stat image_stat;
+  if (fstat(image_fd, &image_stat) < 0) {
+    close(image_fd);
+    return BASE_IMAGE_ERR;
+  }
+  disk_image_header header;
+  const uint64_t device_bytes = (uint64_t) device_size * 1024;
+  // Snapshots saved before images had a header are a raw copy of the start of
+  // the device, so load anything without the magic that way.
+  const bool raw = (uint64_t) image_stat.st_size < sizeof(header)
+    || !pread_all(image_fd, &header, sizeof(header), 0)
+    || memcmp(header.magic, DISK_IMAGE_MAGIC, sizeof(header.magic)) != 0;
+  if (raw ? (uint64_t) image_stat.st_size > device_bytes
+      : (header.version != DISK_IMAGE_VERSION
+        || header.page_size == 0 || header.page_size % SECTOR_SIZE != 0
+        || header.device_bytes != device_bytes)) {
+    close(image_fd);
+    return BASE_IMAGE_ERR;
+  }
+  // A wiped device reads back as zeros, so only the extents in the image have
+  // to be written.
+  if (ioctl(cow_brd_fd, COW_BRD_WIPE) < 0) {
+    close(image_fd);
+    return BASE_IMAGE_ERR;
+  }
+  const int device_fd = open(COW_BRD_PATH, O_WRONLY);
+  if (device_fd < 0) {
+    close(image_fd);
+    return BASE_IMAGE_ERR;
+  }
+
+  if (raw) {
+    const int res = (copy_raw_image(image_fd, device_fd, image_stat.st_size)
+        && fsync(device_fd) == 0) ? SUCCESS : BASE_IMAGE_ERR;
+    close(device_fd);
+    close(image_fd);
+    return res;
+  }
+
+  const uint64_t page_size = header.page_size;
+  const uint64_t total_pages = (device_bytes + page_size - 1) / page_size;
+  vector<char> buf(DISK_IMAGE_CHUNK_PAGES * page_size);
+  off_t image_off = sizeof(header);
+  int res = SUCCESS;
+  for (uint64_t e = 0; e < header.num_extents && res == SUCCESS; ++e) {
+    disk_image_extent extent;
+    if (!pread_all(image_fd, &extent, sizeof(extent), image_off)
+        || extent.first_page >= total_pages
+        || extent.num_pages > total_pages - extent.first_page) {
+      res = BASE_IMAGE_ERR;
+      break;
+    }
+    image_off += sizeof(extent);
+    for (uint64_t done = 0; done < extent.num_pages;) {
+      const uint64_t n = std::min((uint64_t) DISK_IMAGE_CHUNK_PAGES,
+          extent.num_pages - done);
+      const off_t device_off = (extent.first_page + done) * page_size;
+      if (!pread_all(image_fd, buf.data(), n * page_size, image_off)
+          || !pwrite_all(device_fd, buf.data(),
+            std::min(n * page_size, device_bytes - device_off), device_off)) {
+        res = BASE_IMAGE_ERR;
+        break;
+      }
+      image_off += n * page_size;
+      done += n;
+    }
+  }
+  if (fsync(device_fd) < 0) {
+    res = BASE_IMAGE_ERR;
+  }
+  close(device_fd);
+  close(image_fd);
+  return res;
 }
 
 void Tester::PrintTestStats(std::ostream& os) {
@@ -810,10 +1696,106 @@ void Tester::PrintTestStats(std::ostream& os) {
   }
 }
 
+Tester::stop_reason Tester::get_stop_reason() {
+  return last_stop_reason;
+}
+
+double Tester::get_estimated_coverage() {
+  return last_coverage;
+}
+
 std::chrono::milliseconds Tester::get_timing_stat(time_stats timing_stat) {
+  return duration_cast<milliseconds>(timing_stats[timing_stat].Total());
+}
+
+const LatencyHistogram& Tester::get_timing_histogram(time_stats timing_stat) {
   return timing_stats[timing_stat];
 }
 
+void Tester::PrintTimingStats(std::ostream& os) {
+  unsigned int num_states = 0;
+  for (const auto& suite : test_results_) {
+    num_states += suite.GetCompleted();
+  }
+
+  for (unsigned int i = 0; i < NUM_TIME; ++i) {
+    const LatencyHistogram& hist = timing_stats[i];
+    os << "\t" << (time_stats) i << ": "
+      << duration_cast<milliseconds>(hist.Total()).count() << " ms";
+    if (hist.Count() > 0) {
+      os << " (p50 "
+        << duration_cast<microseconds>(hist.Percentile(50)).count()
+        << " us, p90 "
+        << duration_cast<microseconds>(hist.Percentile(90)).count()
+        << " us, p99 "
+        << duration_cast<microseconds>(hist.Percentile(99)).count()
+        << " us, max "
+        << duration_cast<microseconds>(hist.Max()).count() << " us over "
+        << hist.Count() << ")";
+    }
+    os << endl;
+    if (i == BIO_WRITE_TIME) {
+      os << "\t\tbio write syscalls: " << write_stats.syscalls;
+      if (num_states > 0) {
+        os << " (" << write_stats.syscalls / num_states << " per state)";
+      }
+      os << "\n\t\tbio write bytes: " << write_stats.bytes;
+      if (num_states > 0) {
+        os << " (" << write_stats.bytes / num_states << " per state)";
+      }
+      os << endl;
+    }
+  }
+}
+
+void Tester::get_progress(HarnessStats* stats) {
+  static_assert((int) HarnessStats::kNumStages == (int) TOTAL_TIME,
+      "HarnessStats stages must match time_stats");
+  memset(stats, 0, sizeof(HarnessStats));
+  const int64_t start_ns = progress.start_ns;
+  if (start_ns != 0) {
+    int64_t end_ns = progress.end_ns;
+    if (end_ns == 0) {
+      end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          steady_clock::now().time_since_epoch()).count();
+    }
+    stats->elapsed_ms = (end_ns - start_ns) / 1000000;
+  }
+  stats->states_target = progress.states_target;
+  stats->completed = progress.completed;
+  stats->reused = progress.reused;
+  stats->cached = progress.cached;
+  stats->passed = progress.passed;
+  stats->passed_fixed = progress.passed_fixed;
+  stats->failed = progress.failed;
+  stats->old_file_persisted = progress.old_file_persisted;
+  stats->file_missing = progress.file_missing;
+  stats->file_data_corrupted = progress.file_data_corrupted;
+  stats->file_metadata_corrupted = progress.file_metadata_corrupted;
+  stats->other = progress.other;
+  for (unsigned int i = 0; i < HarnessStats::kNumStages; ++i) {
+    stats->stage_us[i] = progress.stage_us[i];
+  }
+}
+
+int Tester::export_timing_stats(const string& path) {
+  ofstream out(path, std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    return TIMING_EXPORT_ERR;
+  }
+  out << "{";
+  for (unsigned int i = 0; i < NUM_TIME; ++i) {
+    if (i != 0) {
+      out << ",";
+    }
+    out << "\n  \"" << (time_stats) i << "\": ";
+    timing_stats[i].PrintJson(out);
+  }
+  out << "\n}" << endl;
+  out.close();
+  return out.fail() ? TIMING_EXPORT_ERR : SUCCESS;
+}
+
 std::ostream& operator<<(std::ostream& os, Tester::time_stats time) {
   switch (time) {
     case fs_testing::Tester::PERMUTE_TIME:
@@ -828,9 +1810,15 @@ std::ostream& operator<<(std::ostream& os, Tester::time_stats time) {
     case fs_testing::Tester::FSCK_TIME:
       os << "fsck time";
       break;
+    case fs_testing::Tester::MOUNT_TIME:
+      os << "mount time";
+      break;
     case fs_testing::Tester::TEST_CASE_TIME:
       os << "test case time";
       break;
+    case fs_testing::Tester::UMOUNT_TIME:
+      os << "umount time";
+      break;
     case fs_testing::Tester::TOTAL_TIME:
       os << "total time";
       break;
@@ -840,4 +1828,24 @@ std::ostream& operator<<(std::ostream& os, Tester::time_stats time) {
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, Tester::stop_reason reason) {
+  switch (reason) {
+    case fs_testing::Tester::STOP_ROUNDS:
+      os << "ran requested number of crash states";
+      break;
+    case fs_testing::Tester::STOP_EXHAUSTED:
+      os << "unable to find new unique state";
+      break;
+    case fs_testing::Tester::STOP_TIME_BUDGET:
+      os << "time budget used up";
+      break;
+    case fs_testing::Tester::STOP_DISCOVERY_RATE:
+      os << "new crash states below minimum rate";
+      break;
+    default:
+      os.setstate(std::ios_base::failbit);
+  }
+  return os;
+}
+
 }  // namespace fs_testing
@@ -1,13 +1,23 @@
 #ifndef TESTER_H
 #define TESTER_H
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "CrashStateWriter.h"
 #include "../utils/ClassLoader.h"
+#include "../utils/LatencyHistogram.h"
+#include "../utils/LogView.h"
+#include "../utils/ProcessRunner.h"
+#include "../utils/communication/SocketUtils.h"
 #include "../permuter/Permuter.h"
+#include "../results/ResultCache.h"
+#include "../results/ResultLog.h"
 #include "../results/TestSuiteResult.h"
 #include "../tests/BaseTestCase.h"
 #include "../utils/utils.h"
@@ -30,10 +40,20 @@
 #define WRAPPER_MEM_ERR          -20
 #define CLEAR_CACHE_ERR          -21
 #define PART_PART_ERR            -22
+#define CHECKPOINT_ERR           -23
+#define RESULT_CACHE_ERR         -24
+#define RESULT_LOG_ERR           -25
+#define TIMING_EXPORT_ERR        -26
+#define BASE_IMAGE_ERR           -27
+#define QUIESCE_ERR              -28
+#define QUIESCE_TIMEOUT_ERR      -29
+#define WORKER_ERR               -30
 
 #define FMT_EXT4               0
 
 #define DIRTY_EXPIRE_TIME_SIZE 10
+// Number of recent crash states the min new state rate is measured over.
+#define DISCOVERY_WINDOW 1000
 
 namespace fs_testing {
 #ifdef TEST_CASE
@@ -53,16 +73,63 @@ class Tester {
     SNAPSHOT_TIME,
     BIO_WRITE_TIME,
     FSCK_TIME,
+    MOUNT_TIME,
     TEST_CASE_TIME,
+    UMOUNT_TIME,
     TOTAL_TIME,
     NUM_TIME,
   };
 
+  // Why the last call to test_check_random_permutations stopped.
+  enum stop_reason {
+    STOP_ROUNDS,
+    // The permuter could not find another crash state it hadn't made.
+    STOP_EXHAUSTED,
+    STOP_TIME_BUDGET,
+    STOP_DISCOVERY_RATE,
+  };
+
   Tester(const unsigned int device_size, const bool verbosity);
   const bool verbose = false;
   void set_fs_type(const std::string type);
   void set_device(const std::string device_path);
   void set_flag_device(const std::string device_path);
+  // Number of workers to use when checking crash states. Each worker gets its
+  // own cow_brd snapshot device, so this must be set before inserting cow_brd.
+  void set_num_workers(const unsigned int workers);
+  // Number of checkpoint devices to spread across the epochs of the log so that
+  // crash states only need to replay the bios after the closest checkpoint.
+  // Must also be set before inserting cow_brd.
+  void set_num_checkpoints(const unsigned int checkpoints);
+  // Write crash states with O_DIRECT through io_uring instead of pwritev. Falls
+  // back to pwritev if the kernel doesn't support io_uring.
+  void set_use_uring(const bool uring);
+  // Keep the results of checked crash states in the cache file at path so that
+  // later runs over the same profile, file system, and mount options can skip
+  // them.
+  void set_result_cache(const std::string& path, const std::string& opts);
+  // Stream a record of every crash state checked to the file at path.
+  int open_result_log(const std::string& path);
+  // Keep base disk images in dir after pre-test setup, keyed by the file
+  // system type, disk size, mount options, and test case, so that later runs
+  // with the same key can load one instead of formatting and running setup.
+  void set_base_image_cache(const std::string& dir, const std::string& opts);
+  // Load the cached base image for this run into the test device and snapshot
+  // it. Returns BASE_IMAGE_ERR if there isn't one. Must be called after the
+  // test case is loaded.
+  int base_image_load();
+  int base_image_save();
+  // Stop checking crash states once budget has passed. Zero means no limit.
+  void set_time_budget(const std::chrono::seconds budget);
+  // Stop checking crash states once fewer than rate of the last
+  // DISCOVERY_WINDOW crash states generated leave the disk in a state not seen
+  // before. Zero means never stop for this.
+  void set_min_new_state_rate(const double rate);
+  // Only check shard shard_id of num_shards of the crash states, with the
+  // permuter seeded with seed. Runs over the same profile with the same
+  // num_shards and different shard_ids check disjoint sets of disk states.
+  void set_shard(const unsigned int shard_id, const unsigned int num_shards,
+      const unsigned int seed);
 
   const char* update_dirty_expire_time(const char* time);
 
@@ -96,21 +163,41 @@ class Tester {
   int get_wrapper_ioctl();
   void put_wrapper_ioctl();
   void begin_wrapper_logging();
+  // Flush the file system at the mount point and wait until the wrapper device
+  // has seen no bios for idle. Returns QUIESCE_ERR if the wrapper can't say
+  // when it last saw a bio and QUIESCE_TIMEOUT_ERR if it was never idle for
+  // that long before timeout passed. Needs the wrapper ioctl fd.
+  int quiesce_wrapper(const std::chrono::milliseconds idle,
+      const std::chrono::milliseconds timeout);
   void end_wrapper_logging();
   int get_wrapper_log();
   void clear_wrapper_log();
 
   int clear_caches();
   void cleanup_harness();
-  // TODO(ashmrtn): Save the fstype in the log file so that we don't
-  // accidentally mix logs of one fs type with mount options for another?
+  // Profiles record the file system they were made on and loading one made on
+  // a different file system than the one being tested is an error.
   int log_profile_save(std::string log_file);
   int log_profile_load(std::string log_file);
   int log_snapshot_save(std::string log_file);
   int log_snapshot_load(std::string log_file);
 
+  // Total time spent in a stage over all runs of
+  // test_check_random_permutations.
   std::chrono::milliseconds get_timing_stat(time_stats timing_stat);
+  const fs_testing::utils::LatencyHistogram& get_timing_histogram(
+      time_stats timing_stat);
   void PrintTimingStats(std::ostream& os);
+  stop_reason get_stop_reason();
+  // Good-Turing estimate of the fraction of distinct crash states the last run
+  // found, weighted by how likely the permuter is to make them.
+  double get_estimated_coverage();
+  // Progress of the current or last run of test_check_random_permutations.
+  // Safe to call from another thread while it runs, and never blocks the
+  // workers.
+  void get_progress(fs_testing::utils::communication::HarnessStats* stats);
+  // Write the latency histogram of every stage to a JSON file.
+  int export_timing_stats(const std::string& path);
   void PrintTestStats(std::ostream& os);
 
   // TODO(ashmrtn): Figure out why making these private slows things down a lot.
@@ -126,6 +213,7 @@ class Tester {
   std::string device_mount;
   std::string flags_device;
 
+  const fs_testing::utils::ProcessRunner command_runner;
 
   bool wrapper_inserted = false;
   bool cow_brd_inserted = false;
@@ -135,23 +223,197 @@ class Tester {
 
   int ioctl_fd = -1;
   std::vector<fs_testing::utils::disk_write> log_data;
+  // Columnar copy of log_data, rebuilt whenever log_data is loaded.
+  fs_testing::utils::LogView log_view;
+
+  unsigned int num_workers = 1;
+  // Test cases aren't written to be called from more than one thread, so
+  // workers take turns running check_test.
+  std::mutex check_test_lock;
+
+  unsigned int shard_id = 0;
+  unsigned int num_shards = 1;
+  unsigned int permuter_seed = 42;
+
+  unsigned int num_checkpoints = 0;
+  // Epoch each checkpoint was taken at and how many ops precede it in a crash
+  // state. Index 0 is the base snapshot which is taken at epoch 0.
+  std::vector<unsigned int> checkpoint_epochs;
+  std::vector<unsigned int> checkpoint_ops;
+
+  bool use_uring = false;
+  AlignedLog aligned_log;
+
+  std::string test_path;
+  std::string result_cache_path;
+  std::string result_cache_opts;
+  ResultCache result_cache;
+  bool result_cache_open = false;
+  // Covers everything other than the crash state that goes into a result.
+  fs_testing::utils::Fingerprint profile_fingerprint;
+
+  ResultWriter result_writer;
+
+  std::string base_image_dir;
+  std::string base_image_opts;
+
+  std::chrono::seconds time_budget{0};
+  double min_new_state_rate = 0;
+  stop_reason last_stop_reason = STOP_ROUNDS;
+  double last_coverage = 0;
+
+  // Running counts for get_progress. Workers only ever add to these, so they
+  // can be read at any time without taking a lock.
+  struct progress_stats {
+    std::atomic<int64_t> start_ns{0};
+    // Zero while a run is in progress.
+    std::atomic<int64_t> end_ns{0};
+    std::atomic<uint64_t> states_target{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> reused{0};
+    std::atomic<uint64_t> cached{0};
+    std::atomic<uint64_t> passed{0};
+    std::atomic<uint64_t> passed_fixed{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> old_file_persisted{0};
+    std::atomic<uint64_t> file_missing{0};
+    std::atomic<uint64_t> file_data_corrupted{0};
+    std::atomic<uint64_t> file_metadata_corrupted{0};
+    std::atomic<uint64_t> other{0};
+    std::atomic<uint64_t> stage_us[TOTAL_TIME] = {};
+  };
+  progress_stats progress;
+
+  // Result of checking the first crash state seen with a given signature. One
+  // is kept for every signature generated, so it only holds what is needed to
+  // hand the result out again.
+  struct signature_result {
+    int32_t fs_check_return = 0;
+    uint32_t fs_error = 0;
+    uint32_t data_error = 0;
+    // Where the fsck output of the check is in the result log, so that reused
+    // results can point at it.
+    uint64_t fsck_log_offset = 0;
+    uint32_t fsck_log_size = 0;
+    // Number of crash states generated with this signature.
+    uint32_t seen = 0;
+    // Set while a worker checks a crash state with this signature.
+    bool checking = false;
+    bool done = false;
+  };
+
+  // State shared by all workers for a single call to
+  // test_check_random_permutations. Everything in here is protected by lock.
+  struct check_state {
+    std::mutex lock;
+    int num_rounds;
+    int rounds = 0;
+    bool done = false;
+    stop_reason reason = STOP_ROUNDS;
+    // Workers that gave up before checking any crash states.
+    unsigned int failed_workers = 0;
+    bool has_deadline = false;
+    std::chrono::time_point<std::chrono::steady_clock> deadline;
+    // Crash states generated and signatures generated exactly once so far, for
+    // the coverage estimate.
+    unsigned int generated = 0;
+    unsigned int singletons = 0;
+    // Whether each of the last DISCOVERY_WINDOW generated crash states had a
+    // new signature.
+    std::vector<bool> recent_new;
+    unsigned int recent_new_count = 0;
+    // Set if workers should write crash states through io_uring.
+    const AlignedLog* aligned_log = NULL;
+    // Keyed on the fingerprint of the signature.
+    std::unordered_map<fs_testing::utils::Fingerprint, signature_result,
+      fs_testing::utils::FingerprintHash> signatures;
+    // Ids of crash states waiting on a signature that is still being checked.
+    // Dropped once its result is in. If the check fails in the harness they
+    // wait for the next crash state with the signature to be checked instead.
+    std::unordered_map<fs_testing::utils::Fingerprint, std::vector<uint64_t>,
+      fs_testing::utils::FingerprintHash> waiting;
+  };
+
+  // Results gathered by a single worker. Merged once all workers are done.
+  struct worker_result {
+    TestSuiteResult test_suite;
+    fs_testing::utils::LatencyHistogram timing_stats[NUM_TIME];
+    WriteStats write_stats;
+  };
 
   int mount_device(const char* dev, const char* opts);
+  // Run a command without a shell. Returns the wait status of the command or
+  // -1 if it could not be run.
+  int run_command(const std::vector<std::string>& args,
+      const std::string& input, fs_testing::utils::ProcessResult* result);
+  std::string snapshot_path(const unsigned int worker);
+  int make_checkpoints(fs_testing::permuter::Permuter* p);
+  int open_result_cache();
+  std::string base_image_path();
+  // Fill pages with the next batch of populated page indices of the test
+  // device, starting at start. Fails on cow_brd modules without
+  // COW_BRD_GET_PAGES.
+  int populated_pages(const unsigned long start,
+      std::vector<unsigned long>* pages);
+  // Copy the test device to and from a disk image holding only its pages that
+  // are populated and not all zero. Data is streamed a chunk at a time. Images
+  // without a header are loaded as a raw copy of the start of the device.
+  int device_image_save(const std::string& path);
+  int device_image_load(const std::string& path);
+  fs_testing::utils::Fingerprint result_cache_key(
+      const fs_testing::permuter::CrashStateSignature& signature);
+
+  void test_check_worker(const unsigned int worker, check_state* shared,
+      worker_result* result);
+  // Restore a worker's snapshot, write crash_state out to it, and check it.
+  // Returns MNT_UMNT_ERR if the crash state could not be unmounted afterwards,
+  // in which case the worker can't mount another one.
+  int test_check_state(const unsigned int worker, const int snapshot_flags,
+      CrashStateWriter* writer,
+      const fs_testing::permuter::CrashStateEntries& crash_state,
+      const unsigned int checkpoint, worker_result* result,
+      SingleTestInfo* test_info, std::chrono::microseconds* stage_times);
+  // Note whether the latest crash state generated had a new signature. Returns
+  // true if new signatures have become rarer than min_new_state_rate. Must
+  // hold the lock of shared.
+  bool count_discovery(check_state* shared, const bool new_signature);
+  void count_progress(const SingleTestInfo& test_info,
+      const ResultRecord::Source source);
+  // Record how long a stage took for one crash state.
+  void record_time(worker_result* result, const time_stats stage,
+      const std::chrono::nanoseconds time);
+  // Record of the result of a signature, without stage times.
+  static ResultRecord make_record(
+      const fs_testing::utils::Fingerprint& signature_key,
+      const signature_result& signature);
+  // Count and log the result of a signature for another crash state with it.
+  // Must hold the lock of the check_state.
+  void reuse_result(const fs_testing::utils::Fingerprint& signature_key,
+      const signature_result& signature, const uint64_t state_id,
+      const ResultRecord::Source source, worker_result* result);
+  // Write a record of a crash state to the result log, if there is one, and
+  // point record at where fsck_log went. Must hold the lock of the check_state.
+  void log_result(ResultRecord* record, const uint64_t state_id,
+      const ResultRecord::Source source, const std::string& fsck_log);
 
   bool read_dirty_expire_time(int fd);
   bool write_dirty_expire_time(int fd, const char* time);
 
   bool test_write_data(const int disk_fd,
       const std::vector<fs_testing::utils::disk_write>::iterator& start,
-      const std::vector<fs_testing::utils::disk_write>::iterator& end);
+      const std::vector<fs_testing::utils::disk_write>::iterator& end,
+      WriteStats* stats = NULL);
 
   std::vector<TestSuiteResult> test_results_;
-  std::chrono::milliseconds timing_stats[NUM_TIME] =
-      {std::chrono::milliseconds(0)};
+  // One sample per crash state for each stage, one sample per call of
+  // test_check_random_permutations for TOTAL_TIME.
+  fs_testing::utils::LatencyHistogram timing_stats[NUM_TIME];
+  WriteStats write_stats;
 
 };
 
 std::ostream& operator<<(std::ostream& os, Tester::time_stats time);
+std::ostream& operator<<(std::ostream& os, Tester::stop_reason reason);
 
 }  // namespace fs_testing
 
@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <getopt.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -7,8 +8,12 @@
 #include <unistd.h>
 #include <wait.h>
 
+#include <atomic>
+#include <deque>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "../tests/BaseTestCase.h"
@@ -23,11 +28,14 @@
 #define TEST_DIRTY_EXPIRE_TIME "500"
 #define WRITE_DELAY 20
 #define MOUNT_DELAY 3
+// Milliseconds the wrapper device must see no bios for before the file system
+// is considered quiet.
+#define QUIESCE_WINDOW 1000
 
 #define DIRECTORY_PERMS \
   (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
 
-#define OPTS_STRING "bd:f:e:l:m:np:r:s:t:v"
+#define OPTS_STRING "bC:c:d:f:e:g:i:j:L:l:m:no:p:q:R:r:S:s:T:t:uv"
 
 namespace {
   unsigned int kSocketQueueDepth;
@@ -38,6 +46,7 @@ using std::cout;
 using std::endl;
 using std::string;
 using fs_testing::Tester;
+using fs_testing::utils::communication::HarnessStats;
 using fs_testing::utils::communication::kSocketNameOutbound;
 using fs_testing::utils::communication::ServerSocket;
 using fs_testing::utils::communication::SocketError;
@@ -45,20 +54,98 @@ using fs_testing::utils::communication::SocketMessage;
 
 static const option long_options[] = {
   {"background", no_argument, NULL, 'b'},
+  {"result-cache", required_argument, NULL, 'C'},
+  {"checkpoints", required_argument, NULL, 'c'},
   {"test-dev", required_argument, NULL, 'd'},
   {"disk_size", required_argument, NULL, 'e'},
   {"flag-device", required_argument, NULL, 'f'},
+  {"seed", required_argument, NULL, 'g'},
+  {"base-image-cache", required_argument, NULL, 'i'},
+  {"jobs", required_argument, NULL, 'j'},
+  {"time-budget", required_argument, NULL, 'L'},
   {"log-file", required_argument, NULL, 'l'},
   {"mount-opts", required_argument, NULL, 'm'},
   {"dry-run", no_argument, NULL, 'n'},
+  {"result-log", required_argument, NULL, 'o'},
   {"permuter", required_argument, NULL, 'p'},
+  {"quiesce-window", required_argument, NULL, 'q'},
+  {"min-new-state-rate", required_argument, NULL, 'R'},
   {"reload-log-file", required_argument, NULL, 'r'},
+  {"shard", required_argument, NULL, 'S'},
   {"iterations", required_argument, NULL, 's'},
+  {"timing-json", required_argument, NULL, 'T'},
   {"fs-type", required_argument, NULL, 't'},
+  {"uring", no_argument, NULL, 'u'},
   {"verbose", no_argument, NULL, 'v'},
   {0, 0, 0, 0},
 };
 
+// Flush the file system under test and wait for the wrapper device to see no
+// bios for window_ms. Waiting longer than the fixed delay it replaces is no
+// better than the delay, so give up after that long. Returns an error only if
+// the caller should sleep instead.
+static int quiesce(Tester* harness, const int window_ms,
+    const unsigned int max_delay) {
+  if (window_ms == 0) {
+    return QUIESCE_ERR;
+  }
+  const int res = harness->quiesce_wrapper(
+      std::chrono::milliseconds(window_ms), std::chrono::seconds(max_delay));
+  if (res == QUIESCE_TIMEOUT_ERR) {
+    cout << "Wrapper device still busy after " << max_delay << " seconds"
+      << endl;
+    return SUCCESS;
+  }
+  return res;
+}
+
+// Answer stats queries on the background socket until done is set. A sample of
+// the completed count is kept every second for the last few seconds so that
+// the reply has the current rate and not just the average over the run.
+static void serve_stats(ServerSocket* com, Tester* harness,
+    const std::atomic<bool>* done) {
+  const unsigned int kPollMs = 200;
+  const uint64_t kSampleMs = 1000;
+  const unsigned int kWindowSamples = 10;
+  // Pairs of elapsed_ms and completed.
+  std::deque<std::pair<uint64_t, uint64_t>> samples;
+  while (!*done) {
+    SocketMessage query;
+    const SocketError res = com->WaitForQuery(&query, kPollMs);
+
+    HarnessStats stats;
+    harness->get_progress(&stats);
+    if (samples.empty()
+        || stats.elapsed_ms >= samples.back().first + kSampleMs) {
+      samples.emplace_back(stats.elapsed_ms, stats.completed);
+      if (samples.size() > kWindowSamples + 1) {
+        samples.pop_front();
+      }
+    }
+
+    if (res == SocketError::kTimeout) {
+      continue;
+    } else if (res != SocketError::kNone) {
+      cerr << "Error waiting for stats query" << endl;
+      continue;
+    }
+
+    SocketMessage reply;
+    if (query.type == SocketMessage::kStats) {
+      reply.type = SocketMessage::kStatsDone;
+      stats.window_ms = stats.elapsed_ms - samples.front().first;
+      stats.window_completed = stats.completed - samples.front().second;
+      reply.stats_value = stats;
+    } else {
+      reply.type = SocketMessage::kInvalidCommand;
+    }
+    reply.size = 0;
+    if (com->SendQueryReply(reply) != SocketError::kNone) {
+      cerr << "Error replying to stats query" << endl;
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   string dirty_expire_time_centisecs(TEST_DIRTY_EXPIRE_TIME);
   unsigned long int test_sleep_delay = WRITE_DELAY;
@@ -68,13 +155,27 @@ int main(int argc, char** argv) {
   string mount_opts("");
   string log_file_save("");
   string log_file_load("");
+  string result_cache("");
+  string base_image_cache("");
+  string result_log("");
+  string timing_json("");
   string permuter(PERMUTER_SO_PATH "RandomPermuter.so");
   bool background = false;
   bool dry_run = false;
   bool no_lvm = false;
+  bool uring = false;
   bool verbose = false;
   int iterations = 1000;
   int disk_size = 10240;
+  int jobs = 1;
+  int checkpoints = 0;
+  int time_budget = 0;
+  int quiesce_window = QUIESCE_WINDOW;
+  int seed = 42;
+  bool seed_given = false;
+  int shard_id = 0;
+  int num_shards = 1;
+  double min_new_state_rate = 0;
   int option_idx = 0;
   ServerSocket* background_com;
 
@@ -86,6 +187,12 @@ int main(int argc, char** argv) {
       case 'b':
         background = true;
         break;
+      case 'C':
+        result_cache = string(optarg);
+        break;
+      case 'c':
+        checkpoints = atoi(optarg);
+        break;
       case 'f':
         flags_dev = string(optarg);
         break;
@@ -95,6 +202,19 @@ int main(int argc, char** argv) {
       case 'e':
         disk_size = atoi(optarg);
         break;
+      case 'g':
+        seed = atoi(optarg);
+        seed_given = true;
+        break;
+      case 'i':
+        base_image_cache = string(optarg);
+        break;
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      case 'L':
+        time_budget = atoi(optarg);
+        break;
       case 'l':
         log_file_save = string(optarg);
         break;
@@ -104,18 +224,39 @@ int main(int argc, char** argv) {
       case 'n':
         dry_run = 1;
         break;
+      case 'o':
+        result_log = string(optarg);
+        break;
       case 'p':
         permuter = string(optarg);
         break;
+      case 'q':
+        quiesce_window = atoi(optarg);
+        break;
+      case 'R':
+        min_new_state_rate = atof(optarg);
+        break;
       case 'r':
         log_file_load = string(optarg);
         break;
+      case 'S':
+        if (sscanf(optarg, "%d/%d", &shard_id, &num_shards) != 2) {
+          cerr << "Please give a shard as <shard>/<number of shards>" << endl;
+          return -1;
+        }
+        break;
       case 's':
         iterations = atoi(optarg);
         break;
+      case 'T':
+        timing_json = string(optarg);
+        break;
       case 't':
         fs_type = string(optarg);
         break;
+      case 'u':
+        uring = true;
+        break;
       case 'v':
         verbose = true;
         break;
@@ -154,6 +295,42 @@ int main(int argc, char** argv) {
     return -1;
   }
 
+  if (checkpoints < 0) {
+    cerr << "Please give a non-negative number of checkpoints to use" << endl;
+    return -1;
+  }
+
+  if (quiesce_window < 0) {
+    cerr << "Please give a non-negative quiesce window in milliseconds" << endl;
+    return -1;
+  }
+
+  if (time_budget < 0) {
+    cerr << "Please give a non-negative time budget in seconds" << endl;
+    return -1;
+  }
+
+  if (min_new_state_rate < 0 || min_new_state_rate > 1) {
+    cerr << "Please give a minimum new state rate between 0 and 1" << endl;
+    return -1;
+  }
+
+  if (num_shards <= 0 || shard_id < 0 || shard_id >= num_shards) {
+    cerr << "Please give a shard between 0 and the number of shards" << endl;
+    return -1;
+  }
+  // Shards drop every crash state that isn't theirs, so shards drawing from
+  // the same stream would spend most of their draws on each other's states.
+  if (!seed_given) {
+    seed += shard_id;
+  }
+
+  if (jobs <= 0) {
+    cerr << "Please give a positive number of jobs to check crash states with"
+      << endl;
+    return -1;
+  }
+
 
   // Create a socket to coordinate with the outside world.
   if (background) {
@@ -217,6 +394,25 @@ int main(int argc, char** argv) {
   }
 
   Tester test_harness(disk_size, verbose);
+  test_harness.set_num_workers(jobs);
+  test_harness.set_num_checkpoints(checkpoints);
+  test_harness.set_use_uring(uring);
+  test_harness.set_time_budget(std::chrono::seconds(time_budget));
+  test_harness.set_min_new_state_rate(min_new_state_rate);
+  test_harness.set_shard(shard_id, num_shards, seed);
+  if (!result_cache.empty()) {
+    test_harness.set_result_cache(result_cache, mount_opts);
+  }
+  // In background mode the user runs setup themselves, so there is nothing to
+  // key an image on.
+  if (!base_image_cache.empty() && !background) {
+    test_harness.set_base_image_cache(base_image_cache, mount_opts);
+  }
+  if (!result_log.empty()
+      && test_harness.open_result_log(result_log) != SUCCESS) {
+    cerr << "Error opening result log " << result_log << endl;
+    return -1;
+  }
 
   cout << "Inserting RAM disk module" << endl;
   if (test_harness.insert_cow_brd() != SUCCESS) {
@@ -282,92 +478,110 @@ int main(int argc, char** argv) {
     // Device flags only need set if we are logging requests.
     test_harness.set_flag_device(flags_dev);
 
-    // Format test drive to desired type.
-    cout << "Formatting test drive" << endl;
-    if (test_harness.format_drive() != SUCCESS) {
-      cerr << "Error formatting test drive" << endl;
-      test_harness.cleanup_harness();
-      return -1;
-    }
-
-    // Mount test file system for pre-test setup.
-    cout << "Mounting test file system for pre-test setup\n";
-    if (test_harness.mount_device_raw(mount_opts.c_str()) != SUCCESS) {
-      cerr << "Error mounting test device" << endl;
-      test_harness.cleanup_harness();
-      return -1;
-    }
-
-    // TODO(ashmrtn): Close startup socket fd here.
+    // A cached base image stands in for formatting and pre-test setup.
+    const bool cached_base_image =
+      !base_image_cache.empty() && !background
+      && test_harness.base_image_load() == SUCCESS;
+    if (!cached_base_image) {
+      // Format test drive to desired type.
+      cout << "Formatting test drive" << endl;
+      if (test_harness.format_drive() != SUCCESS) {
+        cerr << "Error formatting test drive" << endl;
+        test_harness.cleanup_harness();
+        return -1;
+      }
 
-    if (background) {
-      cout << "+++++ Please run any needed pre-test setup +++++" << endl;
-      /*************************************************************************
-       * Background mode user setup. Wait for the user to tell use that they
-       * have finished the pre-test setup phase.
-       ************************************************************************/
-      SocketMessage command;
-      do {
-        if (background_com->WaitForMessage(&command) != SocketError::kNone) {
-          cerr << "Error getting message from socket" << endl;
-          delete background_com;
-          test_harness.cleanup_harness();
-          return -1;
-        }
+      // Mount test file system for pre-test setup.
+      cout << "Mounting test file system for pre-test setup\n";
+      if (test_harness.mount_device_raw(mount_opts.c_str()) != SUCCESS) {
+        cerr << "Error mounting test device" << endl;
+        test_harness.cleanup_harness();
+        return -1;
+      }
 
-        if (command.type != SocketMessage::kBeginLog) {
-          if (background_com->SendCommand(SocketMessage::kInvalidCommand) !=
-              SocketError::kNone) {
-            cerr << "Error sending response to client" << endl;
+      // TODO(ashmrtn): Close startup socket fd here.
+
+      if (background) {
+        cout << "+++++ Please run any needed pre-test setup +++++" << endl;
+        /***********************************************************************
+         * Background mode user setup. Wait for the user to tell use that they
+         * have finished the pre-test setup phase.
+         **********************************************************************/
+        SocketMessage command;
+        do {
+          if (background_com->WaitForMessage(&command) != SocketError::kNone) {
+            cerr << "Error getting message from socket" << endl;
             delete background_com;
             test_harness.cleanup_harness();
             return -1;
           }
-          background_com->CloseClient();
-        }
-      } while (command.type != SocketMessage::kBeginLog);
-    } else {
-      /*************************************************************************
-       * Standalone mode user setup. Run the pre-test "setup()" method defined
-       * in the test case. Run as a separate process for the sake of
-       * cleanliness.
-       ************************************************************************/
-      cout << "Running pre-test setup\n";
-      {
-        const pid_t child = fork();
-        if (child < 0) {
-          cerr << "Error creating child process to run pre-test setup\n";
-          test_harness.cleanup_harness();
-        } else if (child != 0) {
-          // Parent process should wait for child to terminate before proceeding.
-          pid_t status;
-          wait(&status);
-          if (status != 0) {
-            cerr << "Error in pre-test setup\n";
+
+          if (command.type != SocketMessage::kBeginLog) {
+            if (background_com->SendCommand(SocketMessage::kInvalidCommand) !=
+                SocketError::kNone) {
+              cerr << "Error sending response to client" << endl;
+              delete background_com;
+              test_harness.cleanup_harness();
+              return -1;
+            }
+            background_com->CloseClient();
+          }
+        } while (command.type != SocketMessage::kBeginLog);
+      } else {
+        /***********************************************************************
+         * Standalone mode user setup. Run the pre-test "setup()" method defined
+         * in the test case. Run as a separate process for the sake of
+         * cleanliness.
+         **********************************************************************/
+        cout << "Running pre-test setup\n";
+        {
+          const pid_t child = fork();
+          if (child < 0) {
+            cerr << "Error creating child process to run pre-test setup\n";
             test_harness.cleanup_harness();
+          } else if (child != 0) {
+            // Parent process should wait for child to terminate before
+            // proceeding.
+            pid_t status;
+            wait(&status);
+            if (status != 0) {
+              cerr << "Error in pre-test setup\n";
+              test_harness.cleanup_harness();
+            }
+          } else {
+            return test_harness.test_setup();
           }
-        } else {
-          return test_harness.test_setup();
         }
       }
-    }
 
-    /***************************************************************************
-     * Pre-test setup complete. Unmount the test file system and snapshot the
-     * disk for use in workload and tests.
-     **************************************************************************/
-    // Unmount the test file system after pre-test setup.
-    cout << "Unmounting test file system after pre-test setup\n";
-    if (test_harness.umount_device() != SUCCESS) {
-      test_harness.cleanup_harness();
-      return -1;
-    }
+      /*************************************************************************
+       * Pre-test setup complete. Unmount the test file system and snapshot the
+       * disk for use in workload and tests.
+       ************************************************************************/
+      // Unmount the test file system after pre-test setup.
+      cout << "Unmounting test file system after pre-test setup\n";
+      if (test_harness.umount_device() != SUCCESS) {
+        test_harness.cleanup_harness();
+        return -1;
+      }
 
-    // Create snapshot of disk for testing.
-    cout << "Making new snapshot\n";
-    if (test_harness.clone_device() != SUCCESS) {
-      test_harness.cleanup_harness();
-      return -1;
+      // Create snapshot of disk for testing.
+      cout << "Making new snapshot\n";
+      if (test_harness.clone_device() != SUCCESS) {
+        test_harness.cleanup_harness();
+        return -1;
+      }
+
+      // Keep the image around for later runs of the same test case.
+      if (!base_image_cache.empty() && !background) {
+        cout << "Saving base image to cache" << endl;
+        if (test_harness.base_image_save() != SUCCESS) {
+          cerr << "Error saving base image to cache" << endl;
+        }
+      }
+    } else {
+      cout << "Loaded base image from cache, skipping format and setup"
+        << endl;
     }
 
     // If we're logging this test run then also save the snapshot.
@@ -444,13 +658,6 @@ int main(int argc, char** argv) {
       return -1;
     }
 
-    // TODO(ashmrtn): Can probably remove this...
-    cout << "Sleeping after mount" << endl;
-    unsigned int to_sleep = MOUNT_DELAY;
-    do {
-      to_sleep = sleep(to_sleep);
-    } while (to_sleep > 0);
-
     // Get access to wrapper module ioctl functions via FD.
     cout << "Getting wrapper device ioctl fd\n";
     if (test_harness.get_wrapper_ioctl() != SUCCESS) {
@@ -459,6 +666,17 @@ int main(int argc, char** argv) {
       return -1;
     }
 
+    // Let anything the mount started reach the disk before logging. Only sleep
+    // if the wrapper can't tell us when it goes quiet.
+    cout << "Waiting for wrapper device to go quiet after mount" << endl;
+    if (quiesce(&test_harness, quiesce_window, MOUNT_DELAY) != SUCCESS) {
+      cout << "Sleeping after mount" << endl;
+      unsigned int to_sleep = MOUNT_DELAY;
+      do {
+        to_sleep = sleep(to_sleep);
+      } while (to_sleep > 0);
+    }
+
     // Clear wrapper module logs prior to test profiling.
     cout << "Clearing wrapper device logs\n";
     test_harness.clear_wrapper_log();
@@ -542,10 +760,14 @@ int main(int argc, char** argv) {
      * Worload complete, Clean up things and end logging.
      **************************************************************************/
 
-    // Wait a small amount of time for writes to propogate to the block
-    // layer and then stop logging writes.
-    cout << "Waiting for writeback delay\n";
-    sleep(WRITE_DELAY);
+    // Wait for writes to propogate to the block layer and then stop logging
+    // writes. Fall back to a fixed delay if the wrapper can't tell us when it
+    // goes quiet.
+    cout << "Waiting for wrapper device to go quiet after workload\n";
+    if (quiesce(&test_harness, quiesce_window, WRITE_DELAY) != SUCCESS) {
+      cout << "Waiting for writeback delay\n";
+      sleep(WRITE_DELAY);
+    }
 
     cout << "Disabling wrapper device logging" << std::endl;
     test_harness.end_wrapper_logging();
@@ -666,16 +888,38 @@ int main(int argc, char** argv) {
      * Run tests and print the results of said tests.
      **************************************************************************/
     cout << "Writing profiled data to block device and checking with fsck\n";
-    test_harness.test_check_random_permutations(iterations);
+    // The client that sent kRunTests waits for kRunTestsDone on its own
+    // connection, so stats queries are answered on connections of their own
+    // while the tests run.
+    std::atomic<bool> tests_done(false);
+    std::thread stats_server;
+    if (background) {
+      stats_server =
+        std::thread(serve_stats, background_com, &test_harness, &tests_done);
+    }
+    const int check_res = test_harness.test_check_random_permutations(
+        iterations);
+    tests_done = true;
+    if (stats_server.joinable()) {
+      stats_server.join();
+    }
     test_harness.remove_cow_brd();
+    if (check_res != SUCCESS) {
+      cerr << "Error checking crash states" << endl;
+      if (background) {
+        delete background_com;
+      }
+      test_harness.cleanup_harness();
+      return -1;
+    }
 
     test_harness.PrintTestStats(cout);
     cout << endl;
 
-    for (unsigned int i = 0; i < Tester::NUM_TIME; ++i) {
-      cout << "\t" << (Tester::time_stats) i << ": "
-        << test_harness.get_timing_stat((Tester::time_stats) i).count() << " ms"
-        << endl;
+    test_harness.PrintTimingStats(cout);
+    if (!timing_json.empty()
+        && test_harness.export_timing_stats(timing_json) != SUCCESS) {
+      cerr << "Error writing timing stats to " << timing_json << endl;
     }
   }
 
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "EnumerationPermuter.h"
+#include "Permuter.h"
+
+namespace fs_testing {
+namespace permuter {
+
+using std::iota;
+using std::mt19937;
+using std::swap;
+using std::uniform_int_distribution;
+using std::uniform_real_distribution;
+using std::vector;
+
+using fs_testing::utils::disk_write;
+
+const uint64_t EnumerationPermuter::kInOrderStates;
+
+EnumerationPermuter::EnumerationPermuter() {
+  rand = mt19937(42);
+}
+
+EnumerationPermuter::EnumerationPermuter(vector<disk_write> *) {
+  rand = mt19937(42);
+}
+
+uint64_t EnumerationPermuter::NumStates() const {
+  return num_states_;
+}
+
+void EnumerationPermuter::init_seed(const unsigned int seed) {
+  rand.seed(seed);
+}
+
+void EnumerationPermuter::init_data(vector<epoch> *data) {
+  log_entries_.clear();
+  epoch_start_.clear();
+  blocks_.clear();
+  block_weights_.clear();
+  num_states_ = 0;
+  next_state_ = 0;
+
+  bool too_many = false;
+  unsigned int max_slots = 0;
+  for (unsigned int e = 0; e < data->size(); ++e) {
+    epoch& current = data->at(e);
+    epoch_start_.push_back(log_entries_.size());
+    for (epoch_op& op : current.ops) {
+      log_entries_.push_back(GetLogEntry(op));
+    }
+
+    const unsigned int slots = current.ops.size() - current.has_barrier;
+    max_slots = std::max(max_slots, slots);
+    // Orderings of k of the slots bios, slots! / (slots - k)!.
+    uint64_t orderings = 1;
+    for (unsigned int k = 1; k <= slots; ++k) {
+      const uint64_t choices = slots - k + 1;
+      if (orderings > UINT64_MAX / choices) {
+        too_many = true;
+      }
+      orderings *= choices;
+      blocks_.push_back({e, slots, k, false, num_states_});
+      if (num_states_ > UINT64_MAX - orderings) {
+        too_many = true;
+      }
+      num_states_ += orderings;
+    }
+    if (current.has_barrier) {
+      blocks_.push_back({e, slots, slots, true, num_states_});
+      if (num_states_ > UINT64_MAX - orderings) {
+        too_many = true;
+      }
+      num_states_ += orderings;
+    }
+  }
+
+  slots_.resize(max_slots);
+  iota(slots_.begin(), slots_.end(), 0);
+  digits_.clear();
+
+  if (too_many) {
+    // Weight each block by how many crash states it has, working with logs of
+    // the counts relative to the biggest one since the counts don't fit.
+    num_states_ = 0;
+    vector<double> log_counts(blocks_.size());
+    double max_log_count = 0;
+    for (unsigned int i = 0; i < blocks_.size(); ++i) {
+      const block& b = blocks_.at(i);
+      log_counts.at(i) = std::lgamma(b.num_slots + 1.0)
+        - std::lgamma(b.num_slots - b.num_ops + 1.0);
+      max_log_count = std::max(max_log_count, log_counts.at(i));
+    }
+    double total = 0;
+    block_weights_.resize(blocks_.size());
+    for (unsigned int i = 0; i < blocks_.size(); ++i) {
+      total += std::exp(log_counts.at(i) - max_log_count);
+      block_weights_.at(i) = total;
+    }
+    for (double& weight : block_weights_) {
+      weight /= total;
+    }
+  } else if (num_states_ > kInOrderStates) {
+    order_.Init(num_states_, rand);
+  }
+}
+
+bool EnumerationPermuter::gen_one_state_entries(CrashStateEntries& res) {
+  if (blocks_.empty()) {
+    res.clear();
+    return false;
+  }
+
+  if (!block_weights_.empty()) {
+    uniform_real_distribution<double> pick_block(0, 1);
+    const unsigned int i = std::min<unsigned int>(blocks_.size() - 1,
+        std::lower_bound(block_weights_.begin(), block_weights_.end(),
+          pick_block(rand)) - block_weights_.begin());
+    const block& b = blocks_.at(i);
+    digits_.resize(b.num_ops);
+    for (unsigned int j = 0; j < b.num_ops; ++j) {
+      uniform_int_distribution<unsigned int> pick_slot(0,
+          b.num_slots - j - 1);
+      digits_[j] = pick_slot(rand);
+    }
+    Fill(b, res);
+    return true;
+  }
+
+  if (next_state_ >= num_states_) {
+    res.clear();
+    return false;
+  }
+  const uint64_t state = (num_states_ > kInOrderStates)
+    ? order_.At(next_state_) : next_state_;
+  ++next_state_;
+
+  const block& b = *(std::upper_bound(blocks_.begin(), blocks_.end(), state,
+        [](const uint64_t s, const block& other) {
+          return s < other.first_state;
+        }) - 1);
+  // Read the ordering of the bios off in a mixed radix number, one digit per
+  // bio placed.
+  uint64_t ordering = state - b.first_state;
+  digits_.resize(b.num_ops);
+  for (unsigned int j = 0; j < b.num_ops; ++j) {
+    const unsigned int left = b.num_slots - j;
+    digits_[j] = ordering % left;
+    ordering /= left;
+  }
+  Fill(b, res);
+  return true;
+}
+
+void EnumerationPermuter::Fill(const block& b, CrashStateEntries& res) {
+  const unsigned int start = epoch_start_.at(b.epoch);
+  res.assign(log_entries_.begin(), log_entries_.begin() + start);
+  // Same partial Fisher-Yates shuffle as RandomPermuter, with the picks given.
+  for (unsigned int j = 0; j < b.num_ops; ++j) {
+    swap(slots_[j], slots_[j + digits_[j]]);
+    res.push_back(log_entries_[start + slots_[j]]);
+  }
+  for (unsigned int j = b.num_ops; j > 0; --j) {
+    swap(slots_[j - 1], slots_[j - 1 + digits_[j - 1]]);
+  }
+  if (b.barrier) {
+    res.push_back(log_entries_[start + b.num_slots]);
+  }
+}
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+extern "C" fs_testing::permuter::Permuter* permuter_get_instance(
+    std::vector<fs_testing::utils::disk_write> *data) {
+  return new fs_testing::permuter::EnumerationPermuter(data);
+}
+
+extern "C" void permuter_delete_instance(fs_testing::permuter::Permuter* p) {
+  delete p;
+}
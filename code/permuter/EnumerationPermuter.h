@@ -0,0 +1,77 @@
+#ifndef ENUMERATION_PERMUTER_H
+#define ENUMERATION_PERMUTER_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Permuter.h"
+#include "../utils/RandomPermutation.h"
+#include "../utils/utils.h"
+
+namespace fs_testing {
+namespace permuter {
+
+// Numbers every crash state instead of drawing them at random and throwing
+// away the ones already seen. A crash state is every epoch before some epoch e
+// in log order, followed by an ordering of k of the bios of e. If e ends in a
+// barrier, the barrier only goes in after all the other bios of e.
+//
+// When there are at most kInOrderStates crash states they are handed out in
+// order. Otherwise, while they can still be numbered in 64 bits, they are
+// handed out in the order of a random permutation of their numbers, which
+// visits each once. Past that, crash states are drawn uniformly at random;
+// the space is then so large that repeats practically never happen.
+class EnumerationPermuter : public Permuter {
+ public:
+  EnumerationPermuter();
+  EnumerationPermuter(std::vector<fs_testing::utils::disk_write> *data);
+
+  // Number of crash states, or 0 if there are too many to number.
+  uint64_t NumStates() const;
+
+  static const uint64_t kInOrderStates = 1 << 16;
+
+ private:
+  // Crash states that place num_ops of the bios of an epoch, followed by its
+  // barrier if barrier is set.
+  struct block {
+    unsigned int epoch;
+    // Bios of the epoch other than its barrier.
+    unsigned int num_slots;
+    unsigned int num_ops;
+    bool barrier;
+    // Number of the first crash state in the block.
+    uint64_t first_state;
+  };
+
+  virtual void init_data(std::vector<epoch> *data);
+  virtual void init_seed(const unsigned int seed);
+  virtual bool gen_one_state_entries(CrashStateEntries& res);
+  // Fill res with the crash state of block b whose bios of the last epoch are
+  // picked by digits_. The i-th digit is less than the number of bios still
+  // left to pick from after the first i picks.
+  void Fill(const block& b, CrashStateEntries& res);
+
+  std::mt19937 rand;
+  // Log entries of every epoch in log order and where each epoch starts.
+  std::vector<unsigned int> log_entries_;
+  std::vector<unsigned int> epoch_start_;
+  std::vector<block> blocks_;
+  uint64_t num_states_ = 0;
+  uint64_t next_state_ = 0;
+  // Used when there are too many crash states to number. Chance of drawing a
+  // crash state from each block, accumulated over blocks_.
+  std::vector<double> block_weights_;
+  // Order crash states are handed out in if there are more than
+  // kInOrderStates.
+  fs_testing::utils::RandomPermutation order_;
+  // Reused between crash states so that picking bios doesn't allocate.
+  std::vector<unsigned int> slots_;
+  std::vector<unsigned int> digits_;
+};
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+#endif  // ENUMERATION_PERMUTER_H
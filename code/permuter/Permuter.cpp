@@ -1,124 +1,186 @@
-#include <list>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include "Permuter.h"
+#include "../utils/Fingerprint.h"
+#include "../utils/LogView.h"
 #include "../utils/utils.h"
 
 namespace fs_testing {
 namespace permuter {
 
-using std::list;
-using std::size_t;
+using std::map;
 using std::vector;
 
 using fs_testing::utils::disk_write;
+using fs_testing::utils::Fingerprint;
+using fs_testing::utils::FingerprintBuilder;
+using fs_testing::utils::LogView;
 
 namespace {
 
-struct range {
-  unsigned int start;
-  unsigned int end;
+// Sectors [start, end) written by the op at index op of an epoch.
+struct op_extent {
+  unsigned long int start;
+  unsigned long int end;
+  unsigned int op;
 };
 
 static const unsigned int kRetryMultiplier = 2;
 static const unsigned int kMinRetries = 1000;
+static const unsigned int kSectorSize = 512;
+// Most crash states generated are new, so put a Bloom filter in front of the
+// completed crash states. Costs a byte per slot.
+static const unsigned int kBloomBitsPerSlot = 8;
 
-}  // namespace
+Fingerprint FingerprintEntries(const CrashStateEntries& entries) {
+  FingerprintBuilder builder;
+  builder.Update(entries.data(), entries.size() * sizeof(unsigned int));
+  return builder.Digest();
+}
 
+// True if a bio with these flags is split into a flush and its data, which go
+// in different epochs.
+bool SplitsFlush(const uint8_t flags) {
+  return (flags & (LogView::kFlush | LogView::kFlushSeq))
+    && (flags & LogView::kWrite) && !(flags & LogView::kFUA);
+}
 
-size_t BioVectorHash::operator() (const vector<unsigned int>& permutation)
-    const {
-  unsigned int seed = permutation.size();
-  for (const auto& bio_pos : permutation) {
-    seed ^= bio_pos + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+void AddExtent(const unsigned long int sector, const unsigned int bytes,
+    const unsigned int op, vector<op_extent>* extents) {
+  if (bytes > 0) {
+    extents->push_back(
+        {sector, sector + (bytes + kSectorSize - 1) / kSectorSize, op});
   }
-  return seed;
 }
 
-bool BioVectorEqual::operator() (const std::vector<unsigned int>& a,
-    const std::vector<unsigned int>& b) const {
-  if (a.size() != b.size()) {
-    return false;
+// Fill in the overlap groups of the ops of e. Every op has at most one extent.
+// In sector order, a group is a run of extents that each start before the
+// furthest end of the extents before them in the run, so one sweep over the
+// sorted extents finds the groups. O(n log n) however many times the same
+// sectors are written, where listing overlapping pairs would be O(n^2).
+void FindOverlaps(vector<op_extent>& extents, epoch* e) {
+  e->overlap_group.resize(e->ops.size());
+  for (unsigned int i = 0; i < e->ops.size(); ++i) {
+    e->overlap_group[i] = i;
   }
-  for (unsigned int i = 0; i < a.size(); ++i) {
-    if (a.at(i) != b.at(i)) {
-      return false;
+  e->overlaps = false;
+  std::sort(extents.begin(), extents.end(),
+      [](const op_extent& a, const op_extent& b) {
+        return a.start < b.start;
+      });
+  unsigned int run_start = 0;
+  while (run_start < extents.size()) {
+    unsigned long int run_end = extents[run_start].end;
+    unsigned int lowest = extents[run_start].op;
+    unsigned int next = run_start + 1;
+    while (next < extents.size() && extents[next].start < run_end) {
+      run_end = std::max(run_end, extents[next].end);
+      lowest = std::min(lowest, extents[next].op);
+      ++next;
     }
+    for (unsigned int i = run_start; i < next; ++i) {
+      e->overlap_group[extents[i].op] = lowest;
+    }
+    e->overlaps |= next - run_start > 1;
+    run_start = next;
+  }
+}
+
+}  // namespace
+
+
+Permuter::Permuter() : completed_permutations_(kBloomBitsPerSlot) {}
+
+void Permuter::InitShard(const unsigned int shard_id,
+    const unsigned int num_shards, const unsigned int seed) {
+  shard_id_ = shard_id;
+  num_shards_ = num_shards;
+  init_seed(seed);
+}
+
+void Permuter::init_seed(const unsigned int) {
+}
+
+void Permuter::handed_out() {
+}
+
+bool Permuter::InShard() const {
+  if (num_shards_ <= 1) {
+    return true;
   }
-  return true;
+  FingerprintBuilder builder;
+  builder.Update(signature_.data(),
+      signature_.size() * sizeof(CrashStateSignature::value_type));
+  return builder.Digest().lo % num_shards_ == shard_id_;
 }
 
 void Permuter::InitDataVector(vector<disk_write> *data) {
+  own_log_.Build(*data);
+  InitDataVector(data, own_log_);
+}
+
+void Permuter::InitDataVector(vector<disk_write> *data, const LogView& log) {
+  data_ = data;
+  log_ = &log;
   epochs_.clear();
   unsigned int index = 0;
   bool prev_epoch_flush_op = false;
   disk_write data_half;
-  list<range> overlaps;
+  vector<op_extent> extents;
   while (index < data->size()) {
     struct epoch current_epoch;
+    current_epoch.num_meta = 0;
     current_epoch.has_barrier = false;
     current_epoch.overlaps = false;
+    extents.clear();
 
     // Get all ops in this epoch and add them to either the sync_op or async_op
     // lists.
-    while (index < data->size() && !(data->at(index)).is_barrier_write()) {
+    while (index < data->size() && !log.Is(index, LogView::kBarrier)) {
       
       if (prev_epoch_flush_op == true) {
         epoch_op curr_op = {index-1, data_half};
+        AddExtent(data_half.metadata.write_sector, data_half.metadata.size,
+            current_epoch.ops.size(), &extents);
         current_epoch.ops.push_back(curr_op);
         current_epoch.num_meta += data_half.is_meta();
         prev_epoch_flush_op = false;
       }
 
-      disk_write curr = data->at(index);
-      // Find overlapping ranges.
-      unsigned int start = curr.metadata.write_sector;
-      unsigned int end = start + curr.metadata.size;
-      for (auto range_iter = overlaps.begin(); range_iter != overlaps.end();
-          range_iter++) {
-        range r = *range_iter;
-        if ((r.start <= start && r.end >= start)
-            || (r.start <= end && r.end >= end)) {
-          if (r.start > start) {
-            r.start = start;
-          }
-          if (r.end < end) {
-            r.end = end;
-          }
-          current_epoch.overlaps = true;
-          break;
-        } else if (r.start > end) {
-          // Since this is an ordered list, if the next spot is past where we're
-          // looking now then we won't find anything past here. We may as well
-          // insert an item here.
-          range new_range = {start, end};
-          overlaps.insert(range_iter, new_range);
-        }
+      if (log.Is(index, LogView::kWrite)) {
+        AddExtent(log.Sector(index), log.Bytes(index), current_epoch.ops.size(),
+            &extents);
       }
-
       epoch_op curr_op = {index, data->at(index)};
       current_epoch.ops.push_back(curr_op);
-      current_epoch.num_meta += data->at(index).is_meta();
+      current_epoch.num_meta += log.Is(index, LogView::kMeta);
       ++index;
     }
 
     // Check is the op at the current index is a "barrier." If it is then add it
     // to the special spot in the epoch, otherwise just push the current epoch
     // onto the list and move to the next segment of the log.
-    if (index < data->size() && (data->at(index)).is_barrier_write()) {
+    if (index < data->size() && log.Is(index, LogView::kBarrier)) {
       // Check if the op at the current index has a flush flag with data. It it has, then divide
       // it into two halves and make the data available only in the start of the next epoch.
       // If the op has a FUA flag, then it gets normally added into the current epoch
-      if ((data->at(index).has_flush_flag() || data->at(index).has_flush_seq_flag()) && data->at(index).has_write_flag() && (!data->at(index).has_FUA_flag())) {
+      const uint8_t flags = log.Flags(index);
+      if (SplitsFlush(flags)) {
         disk_write flag_half;
         data_half = data->at(index);
         
-        if(data->at(index).has_flush_flag()) {
+        if (flags & LogView::kFlush) {
           flag_half.set_flush_flag();
           data_half.clear_flush_flag();
         }
         
-        if(data->at(index).has_flush_seq_flag()) {
+        if (flags & LogView::kFlushSeq) {
           flag_half.set_flush_seq_flag();
           data_half.clear_flush_seq_flag();
         }
@@ -126,50 +188,216 @@ void Permuter::InitDataVector(vector<disk_write> *data) {
         epoch_op curr_op = {index, flag_half};
         current_epoch.ops.push_back(curr_op);
         current_epoch.num_meta += flag_half.is_meta();
-        epochs_.push_back(current_epoch);
-        prev_epoch_flush_op = true;
         current_epoch.has_barrier = true;
+        FindOverlaps(extents, &current_epoch);
+        epochs_.push_back(std::move(current_epoch));
+        prev_epoch_flush_op = true;
         ++index;
         continue;
       }
 
+      // The barrier always goes last, so it is left out of the overlap groups.
       epoch_op curr_op = {index, data->at(index)};
       current_epoch.ops.push_back(curr_op);
-      current_epoch.num_meta += data->at(index).is_meta();
+      current_epoch.num_meta += log.Is(index, LogView::kMeta);
       current_epoch.has_barrier = true;
       ++index;
     }
-    epochs_.push_back(current_epoch);
+    FindOverlaps(extents, &current_epoch);
+    epochs_.push_back(std::move(current_epoch));
   }
+  init_data(&epochs_);
 }
 
 vector<epoch>* Permuter::GetEpochs() {
   return &epochs_;
 }
 
+unsigned int Permuter::GetLogEntry(epoch_op& op) const {
+  if (!SplitsFlush(log_->Flags(op.abs_index))) {
+    return op.abs_index;
+  }
+  return op.abs_index
+    | (op.op.has_write_flag() ? LogView::kDataHalf : LogView::kFlushHalf);
+}
+
+unsigned int Permuter::GetNumEpochs() {
+  return epochs_.size();
+}
+
+void Permuter::GetEpochData(unsigned int start, unsigned int end,
+    vector<disk_write>& res) {
+  res.clear();
+  for (unsigned int i = start; i < end && i < epochs_.size(); ++i) {
+    for (const epoch_op& op : epochs_.at(i).ops) {
+      res.push_back(op.op);
+    }
+  }
+}
+
+unsigned int Permuter::GetUnpermutedEpochs() {
+  return unpermuted_epochs_;
+}
+
+unsigned int Permuter::GetSharedPrefix() {
+  return 0;
+}
+
+const CrashStateSignature& Permuter::GetCrashStateSignature() {
+  return signature_;
+}
+
+void Permuter::AddSignatureExtent(const unsigned long int start,
+    const unsigned long int end, const unsigned int abs_index) {
+  signature_.push_back(start);
+  signature_.push_back(end);
+  signature_.push_back(abs_index);
+}
+
+void Permuter::BuildSignature(const CrashStateEntries& crash_state) {
+  // Walk the crash state backwards so that the first bio to claim a sector is
+  // the one that wrote it last. covered maps the start of each claimed extent
+  // to its end.
+  map<unsigned long int, unsigned long int> covered;
+  signature_.clear();
+  for (auto entry = crash_state.rbegin(); entry != crash_state.rend();
+      ++entry) {
+    if (!log_->Writes(*entry)) {
+      continue;
+    }
+    const unsigned int abs_index = LogView::Index(*entry);
+    const unsigned long int start = log_->Sector(abs_index);
+    const unsigned long int end =
+      start + (log_->Bytes(abs_index) + kSectorSize - 1) / kSectorSize;
+
+    // Find the first claimed extent that overlaps or touches this bio.
+    auto claimed = covered.upper_bound(start);
+    if (claimed != covered.begin() && std::prev(claimed)->second >= start) {
+      --claimed;
+    }
+    // Claim the gaps between extents that are already claimed, merging them all
+    // into one extent as we go.
+    unsigned long int pos = start;
+    unsigned long int merged_start = start;
+    unsigned long int merged_end = end;
+    while (claimed != covered.end() && claimed->first <= end) {
+      if (claimed->first > pos) {
+        AddSignatureExtent(pos, claimed->first, abs_index);
+      }
+      pos = std::max(pos, claimed->second);
+      merged_start = std::min(merged_start, claimed->first);
+      merged_end = std::max(merged_end, claimed->second);
+      claimed = covered.erase(claimed);
+    }
+    if (pos < end) {
+      AddSignatureExtent(pos, end, abs_index);
+    }
+    covered[merged_start] = merged_end;
+  }
+
+  // Put the triples in sector order and join extents written by the same bio
+  // so that the signature doesn't depend on how the extents were found.
+  const unsigned int num_extents = signature_.size() / 3;
+  vector<unsigned int> order(num_extents);
+  for (unsigned int i = 0; i < num_extents; ++i) {
+    order.at(i) = i;
+  }
+  std::sort(order.begin(), order.end(),
+      [this](const unsigned int a, const unsigned int b) {
+        return signature_.at(a * 3) < signature_.at(b * 3);
+      });
+  CrashStateSignature sorted;
+  sorted.reserve(signature_.size());
+  for (const unsigned int i : order) {
+    const unsigned long int* extent = signature_.data() + i * 3;
+    const unsigned int last = sorted.size();
+    if (last > 0 && sorted.at(last - 2) == extent[0]
+        && sorted.at(last - 1) == extent[2]) {
+      sorted.at(last - 2) = extent[1];
+    } else {
+      sorted.insert(sorted.end(), extent, extent + 3);
+    }
+  }
+  signature_.swap(sorted);
+}
+
+
+bool Permuter::gen_one_state(vector<epoch_op>&) {
+  // Running out of crash states here would look like the permuter is done, so
+  // don't let a permuter without either hook get that far.
+  std::cerr << "permuter implements neither gen_one_state_entries nor "
+    << "gen_one_state" << std::endl;
+  std::abort();
+}
+
+bool Permuter::gen_one_state_entries(CrashStateEntries& res) {
+  const bool new_state = gen_one_state(ops_);
+  res.resize(ops_.size());
+  for (unsigned int i = 0; i < ops_.size(); ++i) {
+    res[i] = GetLogEntry(ops_[i]);
+  }
+  return new_state;
+}
 
 bool Permuter::GenerateCrashState(vector<disk_write>& res) {
-  vector<epoch_op> crash_state;
+  const bool new_state = GenerateCrashState(entries_);
+  ResolveCrashState(entries_, res);
+  return new_state;
+}
+
+void Permuter::ResolveCrashState(const CrashStateEntries& entries,
+    vector<disk_write>& res) {
+  res.resize(entries.size());
+  for (unsigned int i = 0; i < entries.size(); ++i) {
+    const unsigned int entry = entries[i];
+    const unsigned int abs_index = LogView::Index(entry);
+    if (entry & LogView::kFlushHalf) {
+      disk_write flag_half;
+      if (log_->Is(abs_index, LogView::kFlush)) {
+        flag_half.set_flush_flag();
+      }
+      if (log_->Is(abs_index, LogView::kFlushSeq)) {
+        flag_half.set_flush_seq_flag();
+      }
+      res[i] = flag_half;
+      continue;
+    }
+    res[i] = data_->at(abs_index);
+    if (entry & LogView::kDataHalf) {
+      res[i].clear_flush_flag();
+      res[i].clear_flush_seq_flag();
+    }
+  }
+}
+
+bool Permuter::GenerateCrashState(CrashStateEntries& res) {
   unsigned long retries = 0;
   unsigned int exists = 0;
   bool new_state = true;
-  vector<unsigned int> crash_state_hash;
 
-  unsigned long max_retries =
-    ((kRetryMultiplier * completed_permutations_.size()) < kMinRetries)
+  Fingerprint fingerprint;
+
+  bool in_shard = true;
+
+  // Only about one in num_shards_ new crash states belongs to this shard.
+  unsigned long max_retries = num_shards_ *
+    (((kRetryMultiplier * completed_permutations_.Size()) < kMinRetries)
       ? kMinRetries
-      : kRetryMultiplier * completed_permutations_.size();
+      : kRetryMultiplier * completed_permutations_.Size());
   do {
-    new_state = gen_one_state(crash_state);
-
-    crash_state_hash.clear();
-    crash_state_hash.resize(crash_state.size());
-    for (unsigned int i = 0; i < crash_state.size(); ++i) {
-      crash_state_hash.at(i) = crash_state.at(i).abs_index;
-    }
+    new_state = gen_one_state_entries(res);
 
     ++retries;
-    exists = completed_permutations_.count(crash_state_hash);
+    fingerprint = FingerprintEntries(res);
+    exists = completed_permutations_.Contains(fingerprint);
+    if (exists == 0) {
+      BuildSignature(res);
+      in_shard = InShard();
+      if (!in_shard) {
+        // Another shard hands this one out, so don't look at it again.
+        completed_permutations_.Insert(fingerprint);
+      }
+    }
     if (!new_state || retries >= max_retries) {
       // We've likely found all possible crash states so just break. The
       // constant in the multiplier was randomly chosen in the hopes that it
@@ -178,18 +406,30 @@ bool Permuter::GenerateCrashState(vector<disk_write>& res) {
       // make unique permutations.
       break;
     }
-  } while (exists > 0);
+  } while (exists > 0 || !in_shard);
 
-  // Move the permuted crash state data over into the returned crash state
-  // vector.
-  res.clear();
-  res.resize(crash_state.size());
-  for (unsigned int i = 0; i < crash_state.size(); ++i) {
-    res.at(i) = crash_state.at(i).op;
-  }
+  if (exists == 0 && in_shard) {
+    // Count the whole epochs at the start of the crash state that match the log
+    // op for op.
+    unpermuted_epochs_ = 0;
+    unsigned int pos = 0;
+    for (epoch& e : epochs_) {
+      if (pos + e.ops.size() > res.size()) {
+        break;
+      }
+      unsigned int i = 0;
+      while (i < e.ops.size() && res[pos + i] == GetLogEntry(e.ops[i])) {
+        ++i;
+      }
+      if (i < e.ops.size()) {
+        break;
+      }
+      pos += e.ops.size();
+      ++unpermuted_epochs_;
+    }
 
-  if (exists == 0) {
-    completed_permutations_.insert(crash_state_hash);
+    handed_out();
+    completed_permutations_.Insert(fingerprint);
     // We broke out of the above loop because this state is unique.
     return new_state;
   }
@@ -1,22 +1,25 @@
 #ifndef PERMUTER_H
 #define PERMUTER_H
 
-#include <unordered_set>
 #include <vector>
 
+#include "../utils/FingerprintSet.h"
+#include "../utils/LogView.h"
 #include "../utils/utils.h"
 
 namespace fs_testing {
 namespace permuter {
 
-struct BioVectorHash {
-  std::size_t operator() (const std::vector<unsigned int>& permutation) const;
-};
+// Canonical form of a crash state. Holds a (start sector, end sector, abs_index)
+// triple for every extent of the disk, naming the bio that wrote it last,
+// sorted by sector. Crash states with the same signature leave the disk in the
+// same state no matter what order their bios were written in.
+typedef std::vector<unsigned long int> CrashStateSignature;
 
-struct BioVectorEqual {
-  bool operator() (const std::vector<unsigned int>& a,
-      const std::vector<unsigned int>& b) const;
-};
+// A crash state as the log entries (see LogView::entry_half) of its bios in the
+// order they are written. Payloads are looked up in the log when the crash
+// state is written out instead of being copied around with it.
+typedef std::vector<unsigned int> CrashStateEntries;
 
 struct epoch_op {
   unsigned int abs_index;
@@ -26,27 +29,96 @@ struct epoch_op {
 struct epoch {
   unsigned int num_meta;
   bool has_barrier;
+  // True if any two ops in the epoch other than the barrier write some of the
+  // same sectors.
   bool overlaps;
   std::vector<struct epoch_op> ops;
+  // For each op, the index of the lowest op linked to it by a chain of ops
+  // that each write some of the same sectors as the next. Ops that overlap no
+  // other op, and the barrier since it always goes last, are their own group.
+  std::vector<unsigned int> overlap_group;
 };
 
 
 class Permuter {
  public:
+  Permuter();
   virtual ~Permuter() {};
+  // Only hand out the crash states of shard shard_id of num_shards. Crash
+  // states go to shards by a hash of their signature, so shards never check
+  // the same disk state and only need to agree on num_shards. seed reseeds the
+  // random number generator of the permuter, if it has one. Must be called
+  // before InitDataVector.
+  void InitShard(const unsigned int shard_id, const unsigned int num_shards,
+      const unsigned int seed);
+  // data must outlive every crash state generated from it.
   void InitDataVector(std::vector<fs_testing::utils::disk_write>* data);
+  // Same as above but with the flags of each bio already decoded in log, which
+  // must have been built from data and must outlive it as well.
+  void InitDataVector(std::vector<fs_testing::utils::disk_write>* data,
+      const fs_testing::utils::LogView& log);
+  bool GenerateCrashState(CrashStateEntries& res);
+  // Same as above but with a copy of every bio in the crash state.
   bool GenerateCrashState(std::vector<fs_testing::utils::disk_write>& res);
+  // Copy the bios named by entries out of the log.
+  void ResolveCrashState(const CrashStateEntries& entries,
+      std::vector<fs_testing::utils::disk_write>& res);
+
+  unsigned int GetNumEpochs();
+  // Get the ops of epochs [start, end) in the order they appear in the log.
+  void GetEpochData(unsigned int start, unsigned int end,
+      std::vector<fs_testing::utils::disk_write>& res);
+  // Number of whole epochs at the start of the last generated crash state that
+  // are exactly as they appear in the log. The crash state can be rebuilt from
+  // a checkpoint of any of those epochs.
+  unsigned int GetUnpermutedEpochs();
+  // Number of log entries at the start of the last generated crash state that
+  // are the same as at the start of the crash state generated before it. Only
+  // the bios after them differ, so a harness that kept the disk of the previous
+  // crash state around would only have to write those. Permuters that don't
+  // keep track of it report 0.
+  virtual unsigned int GetSharedPrefix();
+  // Signature of the last generated crash state.
+  const CrashStateSignature& GetCrashStateSignature();
 
  protected:
   std::vector<epoch>* GetEpochs();
+  // Log entry of an op in one of the epochs.
+  unsigned int GetLogEntry(epoch_op& op) const;
 
  private:
   virtual void init_data(std::vector<epoch> *data) = 0;
-  virtual bool gen_one_state(std::vector<epoch_op>& res) = 0;
+  virtual void init_seed(const unsigned int seed);
+  // Permuters fill in res with the log entries of a crash state. By default
+  // this calls gen_one_state with ops copied out of the epochs and takes the
+  // log entry of each, so permuters that only implement that keep working.
+  // Permuters must override one of the two, the default gen_one_state aborts.
+  virtual bool gen_one_state_entries(CrashStateEntries& res);
+  virtual bool gen_one_state(std::vector<epoch_op>& res);
+  // Called each time GenerateCrashState hands out a crash state, as opposed to
+  // dropping one it already generated or that is in another shard.
+  virtual void handed_out();
 
   std::vector<epoch> epochs_;
-  std::unordered_set<std::vector<unsigned int>, BioVectorHash, BioVectorEqual>
-    completed_permutations_;
+  std::vector<fs_testing::utils::disk_write>* data_ = NULL;
+  const fs_testing::utils::LogView* log_ = NULL;
+  // Built by InitDataVector if it isn't given a view of the log.
+  fs_testing::utils::LogView own_log_;
+  void AddSignatureExtent(const unsigned long int start,
+      const unsigned long int end, const unsigned int abs_index);
+  void BuildSignature(const CrashStateEntries& crash_state);
+  // True if the crash state with signature_ belongs to this shard.
+  bool InShard() const;
+
+  // Reused between crash states.
+  std::vector<epoch_op> ops_;
+  CrashStateEntries entries_;
+  unsigned int unpermuted_epochs_ = 0;
+  unsigned int shard_id_ = 0;
+  unsigned int num_shards_ = 1;
+  CrashStateSignature signature_;
+  // Fingerprints of the log entries of every crash state generated.
+  fs_testing::utils::FingerprintSet completed_permutations_;
 };
 
 typedef Permuter *permuter_create_t();
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "Permuter.h"
+#include "PrefixPermuter.h"
+
+namespace fs_testing {
+namespace permuter {
+
+using std::iota;
+using std::min;
+using std::mt19937;
+using std::vector;
+
+using fs_testing::utils::disk_write;
+
+const unsigned int PrefixPermuter::kBatchStates;
+
+PrefixPermuter::PrefixPermuter() {
+  rand = mt19937(42);
+}
+
+PrefixPermuter::PrefixPermuter(vector<disk_write> *) {
+  rand = mt19937(42);
+}
+
+void PrefixPermuter::init_seed(const unsigned int seed) {
+  rand.seed(seed);
+}
+
+void PrefixPermuter::init_data(vector<epoch> *data) {
+  log_entries_.clear();
+  epoch_start_.clear();
+  walks_.clear();
+  current_ = 0;
+  batch_left_ = kBatchStates;
+  pending_prefix_ = std::numeric_limits<unsigned int>::max();
+  shared_prefix_ = 0;
+
+  for (unsigned int e = 0; e < data->size(); ++e) {
+    epoch& current = data->at(e);
+    epoch_start_.push_back(log_entries_.size());
+    for (epoch_op& op : current.ops) {
+      log_entries_.push_back(GetLogEntry(op));
+    }
+    walks_.push_back({e,
+        (unsigned int) current.ops.size() - current.has_barrier,
+        current.has_barrier, 0, false, 0, false});
+  }
+  last_walk_ = walks_.size();
+
+  slots_.resize(log_entries_.size());
+  turns_.assign(log_entries_.size(), 0);
+  for (const walk& w : walks_) {
+    auto first = slots_.begin() + epoch_start_.at(w.epoch);
+    iota(first, first + w.num_slots, 0);
+    std::shuffle(first, first + w.num_slots, rand);
+  }
+}
+
+bool PrefixPermuter::Step(walk& w) {
+  if (w.done) {
+    return false;
+  }
+  const unsigned int start = epoch_start_.at(w.epoch);
+  auto slots = slots_.begin() + start;
+  auto turns = turns_.begin() + start;
+
+  // Add the next bio, or the barrier once all the other bios are in.
+  if (w.depth < w.num_slots) {
+    turns[w.depth] = 0;
+    ++w.depth;
+    w.in_order = min(w.in_order, w.depth - 1);
+    if (w.in_order == w.depth - 1 && slots[w.depth - 1] == w.depth - 1) {
+      ++w.in_order;
+    }
+    return true;
+  }
+  if (w.barrier && !w.placed_barrier) {
+    w.placed_barrier = true;
+    if (w.in_order == w.num_slots) {
+      ++w.in_order;
+    }
+    return true;
+  }
+  w.placed_barrier = false;
+
+  // Every crash state starting with the bios placed has been handed out, so
+  // swap the last bio for the next one not yet tried in its place. Rotating
+  // the bios after a level once per bio tried there leaves them as they were
+  // when it has tried them all, so the level above can carry on from there.
+  while (w.depth > 0) {
+    const unsigned int level = w.depth - 1;
+    std::rotate(slots + level, slots + level + 1, slots + w.num_slots);
+    if (++turns[level] < w.num_slots - level) {
+      w.in_order = min(w.in_order, level);
+      if (w.in_order == level && slots[level] == level) {
+        ++w.in_order;
+      }
+      return true;
+    }
+    --w.depth;
+  }
+  w.done = true;
+  return false;
+}
+
+void PrefixPermuter::Fill(const walk& w, CrashStateEntries& res) {
+  const unsigned int start = epoch_start_.at(w.epoch);
+  res.assign(log_entries_.begin(), log_entries_.begin() + start);
+  for (unsigned int i = 0; i < w.depth; ++i) {
+    res.push_back(log_entries_[start + slots_[start + i]]);
+  }
+  if (w.placed_barrier) {
+    res.push_back(log_entries_[start + w.num_slots]);
+  }
+}
+
+bool PrefixPermuter::gen_one_state_entries(CrashStateEntries& res) {
+  if (walks_.empty()) {
+    res.clear();
+    return false;
+  }
+  // Give each epoch its turn until one has a crash state left. Going around
+  // once more than there are epochs covers the epoch that just used up its
+  // batch.
+  for (unsigned int tried = 0; tried <= walks_.size(); ++tried) {
+    walk& w = walks_.at(current_);
+    if (batch_left_ > 0 && Step(w)) {
+      --batch_left_;
+      Fill(w, res);
+
+      // Within a walk, the crash state keeps every bio of the last one but the
+      // one Step swapped out. Between walks, the crash state of the earlier
+      // epoch shares its bios in log order with the later epoch, which has the
+      // whole earlier epoch in log order.
+      unsigned int shared = 0;
+      if (last_walk_ == current_) {
+        shared = epoch_start_.at(w.epoch) + w.depth - !w.placed_barrier;
+      } else if (last_walk_ < walks_.size()) {
+        const walk& first = walks_.at(min(last_walk_, current_));
+        shared = epoch_start_.at(first.epoch) + first.in_order;
+      }
+      pending_prefix_ = min(pending_prefix_, shared);
+      last_walk_ = current_;
+      return true;
+    }
+    current_ = (current_ + 1) % walks_.size();
+    batch_left_ = kBatchStates;
+  }
+  res.clear();
+  return false;
+}
+
+void PrefixPermuter::handed_out() {
+  shared_prefix_ = pending_prefix_;
+  pending_prefix_ = std::numeric_limits<unsigned int>::max();
+}
+
+unsigned int PrefixPermuter::GetSharedPrefix() {
+  return shared_prefix_;
+}
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+extern "C" fs_testing::permuter::Permuter* permuter_get_instance(
+    std::vector<fs_testing::utils::disk_write> *data) {
+  return new fs_testing::permuter::PrefixPermuter(data);
+}
+
+extern "C" void permuter_delete_instance(fs_testing::permuter::Permuter* p) {
+  delete p;
+}
@@ -0,0 +1,87 @@
+#ifndef PREFIX_PERMUTER_H
+#define PREFIX_PERMUTER_H
+
+#include <random>
+#include <vector>
+
+#include "Permuter.h"
+#include "../utils/utils.h"
+
+namespace fs_testing {
+namespace permuter {
+
+// Hands out crash states so that consecutive ones share as long a prefix as
+// possible (see Permuter::GetSharedPrefix). A crash state is every epoch before
+// some epoch e in log order, followed by an ordering of some of the bios of e.
+// If e ends in a barrier, the barrier only goes in after all the other bios of
+// e.
+//
+// The orderings of each epoch are walked depth first, so each crash state
+// either adds one bio to the last one or swaps out its last few bios. Bios are
+// tried in a random order picked once per epoch. Every epoch gets
+// kBatchStates crash states in turn, starting from the first epoch, so that
+// long epochs don't hold up the rest of the log. Once every ordering of every
+// epoch has been handed out, no more crash states are generated.
+class PrefixPermuter : public Permuter {
+ public:
+  PrefixPermuter();
+  PrefixPermuter(std::vector<fs_testing::utils::disk_write> *data);
+
+  static const unsigned int kBatchStates = 1024;
+
+  // Worked out from where the walks are rather than by comparing crash states.
+  // If crash states are dropped in between, this is the shortest prefix shared
+  // by any two consecutive crash states generated since the last one handed
+  // out, which the two handed out crash states share as well.
+  virtual unsigned int GetSharedPrefix();
+
+ private:
+  // Where the depth first walk of the orderings of an epoch is at.
+  struct walk {
+    unsigned int epoch;
+    // Bios of the epoch other than its barrier.
+    unsigned int num_slots;
+    bool barrier;
+    // Number of bios the last crash state placed.
+    unsigned int depth;
+    // True if the last crash state ended with the barrier.
+    bool placed_barrier;
+    // Number of bios at the start of the epoch in the last crash state that
+    // are in log order.
+    unsigned int in_order;
+    bool done;
+  };
+
+  virtual void init_data(std::vector<epoch> *data);
+  virtual void init_seed(const unsigned int seed);
+  virtual bool gen_one_state_entries(CrashStateEntries& res);
+  virtual void handed_out();
+  // Move w on to its next crash state. Returns false if it has none left.
+  bool Step(walk& w);
+  // Fill res with the crash state w is at.
+  void Fill(const walk& w, CrashStateEntries& res);
+
+  std::mt19937 rand;
+  // Log entries of every epoch in log order and where each epoch starts.
+  std::vector<unsigned int> log_entries_;
+  std::vector<unsigned int> epoch_start_;
+  // Per epoch, starting at epoch_start_, the bios of the epoch in the order the
+  // last crash state placed them, and how many times each level of the walk
+  // has rotated the bios after it.
+  std::vector<unsigned int> slots_;
+  std::vector<unsigned int> turns_;
+  std::vector<walk> walks_;
+  unsigned int current_ = 0;
+  unsigned int batch_left_ = kBatchStates;
+  // Walk of the last crash state generated, or walks_.size() if there is none.
+  unsigned int last_walk_ = 0;
+  // Shortest prefix shared by consecutive crash states generated since the
+  // last one handed out.
+  unsigned int pending_prefix_ = 0;
+  unsigned int shared_prefix_ = 0;
+};
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+#endif  // PREFIX_PERMUTER_H
@@ -1,6 +1,6 @@
 #include <iterator>
-#include <list>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 #include <cassert>
@@ -10,10 +10,9 @@
 
 namespace fs_testing {
 namespace permuter {
-using std::advance;
 using std::iota;
-using std::list;
 using std::mt19937;
+using std::swap;
 using std::uniform_int_distribution;
 using std::vector;
 
@@ -28,11 +27,26 @@ RandomPermuter::RandomPermuter(vector<disk_write> *data) {
   rand = mt19937(42);
 }
 
+void RandomPermuter::init_seed(const unsigned int seed) {
+  rand.seed(seed);
+}
+
 void RandomPermuter::init_data(vector<epoch> *data) {
+  log_entries_.clear();
+  epoch_start_.clear();
+  for (epoch& e : *data) {
+    epoch_start_.push_back(log_entries_.size());
+    for (epoch_op& op : e.ops) {
+      log_entries_.push_back(GetLogEntry(op));
+    }
+  }
 }
 
-bool RandomPermuter::gen_one_state(vector<epoch_op>& res) {
-  unsigned int total_elements = 0;
+bool RandomPermuter::gen_one_state_entries(CrashStateEntries& res) {
+  res.clear();
+  if (GetEpochs()->empty()) {
+    return false;
+  }
   // Find how many elements we will be returning (randomly determined).
   uniform_int_distribution<unsigned int> permute_epochs(1, GetEpochs()->size());
   unsigned int num_epochs = permute_epochs(rand);
@@ -41,80 +55,74 @@ bool RandomPermuter::gen_one_state(vector<epoch_op>& res) {
   uniform_int_distribution<unsigned int> permute_requests(1,
       GetEpochs()->at(num_epochs - 1).ops.size());
   unsigned int num_requests = permute_requests(rand);
-  for (unsigned int i = 0; i < num_epochs - 1; ++i) {
-    total_elements += GetEpochs()->at(i).ops.size();
-  }
-  total_elements += num_requests;
-  res.resize(total_elements);
 
-  auto curr_iter = res.begin();
   for (unsigned int i = 0; i < num_epochs; ++i) {
-    if (GetEpochs()->at(i).overlaps || i == num_epochs - 1) {
+    const epoch& current = GetEpochs()->at(i);
+    if (current.overlaps || i == num_epochs - 1) {
       unsigned int size =
-        (i != num_epochs - 1) ? GetEpochs()->at(i).ops.size() : num_requests;
-      auto res_end = curr_iter + size;
-      permute_epoch(curr_iter, res_end, GetEpochs()->at(i));
-
-      curr_iter = res_end;
+        (i != num_epochs - 1) ? current.ops.size() : num_requests;
+      permute_epoch(res, i, size);
     } else {
-      // Use a for loop since vector::insert inserts new elements and we
-      // resized above to the exact size we will have.
       // We will only ever be placing the full epoch here because the above if
       // will catch the case where we place only part of an epoch.
-      for (auto epoch_iter = GetEpochs()->at(i).ops.begin();
-          epoch_iter != GetEpochs()->at(i).ops.end(); ++epoch_iter) {
-        *curr_iter = *epoch_iter;
-        ++curr_iter;
-      }
+      const unsigned int start = epoch_start_.at(i);
+      res.insert(res.end(), log_entries_.begin() + start,
+          log_entries_.begin() + start + current.ops.size());
     }
   }
   return true;
 }
 
-void RandomPermuter::permute_epoch(
-      vector<epoch_op>::iterator& res_start,
-      vector<epoch_op>::iterator& res_end,
-      epoch& epoch) {
-  assert(distance(res_start, res_end) <= epoch.ops.size());
+void RandomPermuter::permute_epoch(CrashStateEntries& res,
+    const unsigned int e, const unsigned int num_ops) {
+  const epoch& current = GetEpochs()->at(e);
+  const unsigned int start = epoch_start_.at(e);
+  assert(num_ops <= current.ops.size());
 
   // Even if the number of bios we're placing is less than the number in the
   // epoch, allow any bio but the barrier (if present) to be picked.
-  unsigned int slots = epoch.ops.size();
-  if (epoch.has_barrier) {
+  unsigned int slots = current.ops.size();
+  if (current.has_barrier) {
     --slots;
   }
 
-  // Fill the list with the empty slots, either [0, epoch.size() - 1] or
-  // [0, epoch.size() - 2]. Prefer a list so that removals are fast. We have
-  // this so that each time we pick a number we can find a bio which we haven't
-  // already placed.
-  list<unsigned int> empty_slots(slots);
-  iota(empty_slots.begin(), empty_slots.end(), 0);
+  // slots_ always holds [0, slots_.size()) in order between calls. Grow it if
+  // this epoch is bigger than any seen so far.
+  if (slots_.size() < slots) {
+    const unsigned int old_size = slots_.size();
+    slots_.resize(slots);
+    iota(slots_.begin() + old_size, slots_.end(), old_size);
+  }
 
-  // First case is when we are placing a subset of the bios, the second is when
-  // we are placing all the bios but a barrier operation is present.
-  while (res_start != res_end && !empty_slots.empty()) {
+  // Partial Fisher-Yates shuffle: each placed bio is picked from the slots not
+  // yet placed, which are kept at the end of slots_. Only touches as many slots
+  // as there are bios to place.
+  swaps_.clear();
+  unsigned int placed = 0;
+  while (placed < num_ops && placed < slots) {
     // Uniform distribution includes both ends, so we need to subtract 1 from
     // the size.
-    uniform_int_distribution<unsigned int> uid(0, empty_slots.size() - 1);
-    auto shift = empty_slots.begin();
-    advance(shift, uid(rand));
-    *res_start = epoch.ops.at(*shift);
-    ++res_start;
-    empty_slots.erase(shift);
+    uniform_int_distribution<unsigned int> uid(placed, slots - 1);
+    const unsigned int pick = uid(rand);
+    swap(slots_[placed], slots_[pick]);
+    swaps_.push_back(pick);
+    res.push_back(log_entries_[start + slots_[placed]]);
+    ++placed;
+  }
+  // Undo the swaps so the next call starts from [0, slots_.size()) again.
+  for (unsigned int i = placed; i > 0; --i) {
+    swap(slots_[i - 1], slots_[swaps_[i - 1]]);
   }
 
   // We are only placing part of an epoch so we need to return here.
-  if (res_start == res_end) {
+  if (placed == num_ops) {
     return;
   }
 
-  assert(epoch.has_barrier);
+  assert(current.has_barrier);
 
-  // Place the barrier operation if it exists since the entire vector already
-  // exists (i.e. we won't cause extra shifting when adding the other elements).
-  // Decrement out count of empty slots since we have filled one.
-  *res_start = epoch.ops.back();
+  // Place the barrier operation if it exists since it always goes last.
+  res.push_back(log_entries_[start + slots]);
 }
 
 }  // namespace permuter
@@ -17,12 +17,20 @@ class RandomPermuter : public Permuter {
 
  private:
   virtual void init_data(std::vector<epoch> *data);
-  virtual bool gen_one_state(std::vector<epoch_op>& res);
-  void permute_epoch(
-      std::vector<epoch_op>::iterator& res_start,
-      std::vector<epoch_op>::iterator& res_end, epoch& epoch);
+  virtual void init_seed(const unsigned int seed);
+  virtual bool gen_one_state_entries(CrashStateEntries& res);
+  // Append num_ops log entries of epoch e to res, picked at random from all
+  // but its barrier, followed by the barrier if num_ops covers the epoch.
+  void permute_epoch(CrashStateEntries& res, const unsigned int e,
+      const unsigned int num_ops);
 
   std::mt19937 rand;
+  // Log entries of every epoch in log order and where each epoch starts.
+  std::vector<unsigned int> log_entries_;
+  std::vector<unsigned int> epoch_start_;
+  // Reused between crash states so that permuting an epoch doesn't allocate.
+  std::vector<unsigned int> slots_;
+  std::vector<unsigned int> swaps_;
 };
 
 }  // namespace permuter
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Permuter.h"
+#include "SubsetPermuter.h"
+
+namespace fs_testing {
+namespace permuter {
+
+using std::iota;
+using std::max;
+using std::min;
+using std::mt19937;
+using std::swap;
+using std::uniform_int_distribution;
+using std::uniform_real_distribution;
+using std::vector;
+
+using fs_testing::utils::disk_write;
+
+namespace {
+
+// Orderings of k of n things, n! / (n - k)!. Must fit in 64 bits.
+uint64_t Orderings(const unsigned int n, const unsigned int k) {
+  uint64_t res = 1;
+  for (unsigned int i = 0; i < k; ++i) {
+    res *= n - i;
+  }
+  return res;
+}
+
+}  // namespace
+
+const uint64_t SubsetPermuter::kInOrderStates;
+
+SubsetPermuter::SubsetPermuter() {
+  rand = mt19937(42);
+}
+
+SubsetPermuter::SubsetPermuter(vector<disk_write> *) {
+  rand = mt19937(42);
+}
+
+uint64_t SubsetPermuter::NumStates() const {
+  return num_states_;
+}
+
+void SubsetPermuter::AddGroups(epoch& e, const unsigned int num_slots) {
+  // Number the groups by their lowest bio and lay them out in group_ops_.
+  const unsigned int first_group = groups_.size();
+  vector<unsigned int> group_of(num_slots);
+  for (unsigned int i = 0; i < num_slots; ++i) {
+    const unsigned int root = e.overlap_group[i];
+    if (root == i) {
+      group_of[i] = groups_.size();
+      groups_.push_back({0, 0, 0, 0});
+    } else {
+      group_of[i] = group_of[root];
+    }
+    ++groups_[group_of[i]].size;
+  }
+  unsigned int first = group_ops_.size();
+  for (unsigned int i = first_group; i < groups_.size(); ++i) {
+    groups_[i].first = first;
+    first += groups_[i].size;
+  }
+  group_ops_.resize(first);
+  vector<unsigned int> placed(groups_.size() - first_group, 0);
+  for (unsigned int i = 0; i < num_slots; ++i) {
+    group& g = groups_[group_of[i]];
+    group_ops_[g.first + placed[group_of[i] - first_group]++] = i;
+  }
+
+  for (unsigned int i = first_group; i < groups_.size(); ++i) {
+    group& g = groups_[i];
+    // Orderings of k of the bios, summed over k, if that fits.
+    uint64_t total = 1;
+    uint64_t orderings = 1;
+    for (unsigned int k = 1; k <= g.size; ++k) {
+      const uint64_t choices = g.size - k + 1;
+      if (orderings > UINT64_MAX / choices
+          || total > UINT64_MAX - orderings * choices) {
+        total = 0;
+        break;
+      }
+      orderings *= choices;
+      total += orderings;
+    }
+    g.num_states = total;
+
+    // Placing k of the bios has g.size! / (g.size - k)! orderings, so the
+    // chance of each k goes with 1 / (g.size - k)!.
+    g.first_weight = k_weights_.size();
+    double sum = 0;
+    for (unsigned int k = 0; k <= g.size; ++k) {
+      sum += std::exp(-std::lgamma(g.size - k + 1.0));
+      k_weights_.push_back(sum);
+    }
+    for (unsigned int k = 0; k <= g.size; ++k) {
+      k_weights_[g.first_weight + k] /= sum;
+    }
+  }
+}
+
+void SubsetPermuter::init_seed(const unsigned int seed) {
+  rand.seed(seed);
+}
+
+void SubsetPermuter::init_data(vector<epoch> *data) {
+  log_entries_.clear();
+  epoch_start_.clear();
+  group_ops_.clear();
+  groups_.clear();
+  k_weights_.clear();
+  blocks_.clear();
+  block_weights_.clear();
+  num_states_ = 0;
+  next_state_ = 0;
+
+  bool too_many = false;
+  auto add_states = [this, &too_many](const uint64_t count) {
+    if (num_states_ > UINT64_MAX - count) {
+      too_many = true;
+    }
+    num_states_ += count;
+  };
+  // Log of the number of crash states in each block.
+  vector<double> log_counts;
+  unsigned int max_group = 0;
+  for (unsigned int e = 0; e < data->size(); ++e) {
+    epoch& current = data->at(e);
+    epoch_start_.push_back(log_entries_.size());
+    for (epoch_op& op : current.ops) {
+      log_entries_.push_back(GetLogEntry(op));
+    }
+
+    const unsigned int slots = current.ops.size() - current.has_barrier;
+    const unsigned int first_group = groups_.size();
+    AddGroups(current, slots);
+    const unsigned int num_groups = groups_.size() - first_group;
+
+    // Crash states with some of the bios of each group, and with all of them
+    // followed by the barrier.
+    uint64_t some = 1;
+    uint64_t all = 1;
+    double log_some = 0;
+    double log_all = 0;
+    for (unsigned int i = first_group; i < groups_.size(); ++i) {
+      const group& g = groups_[i];
+      max_group = max(max_group, g.size);
+      // All of the bios have fewer orderings than any number of them, so they
+      // fit if g.num_states does.
+      if (g.num_states == 0) {
+        too_many = true;
+      } else {
+        const uint64_t factorial = Orderings(g.size, g.size);
+        if (some > UINT64_MAX / g.num_states || all > UINT64_MAX / factorial) {
+          too_many = true;
+        } else {
+          some *= g.num_states;
+          all *= factorial;
+        }
+      }
+      // g.size! times the sum of 1 / j! for j up to g.size.
+      double inverse_factorials = 0;
+      for (unsigned int j = 0; j <= g.size; ++j) {
+        inverse_factorials += std::exp(-std::lgamma(j + 1.0));
+      }
+      log_some += std::lgamma(g.size + 1.0) + std::log(inverse_factorials);
+      log_all += std::lgamma(g.size + 1.0);
+    }
+
+    if (slots > 0) {
+      // Leave out placing none of the bios, which is the last crash state of
+      // the epoch before.
+      blocks_.push_back({e, first_group, num_groups, slots, false,
+          num_states_});
+      add_states(some - 1);
+      log_counts.push_back(log_some + std::log1p(-std::exp(-log_some)));
+    }
+    if (current.has_barrier) {
+      blocks_.push_back({e, first_group, num_groups, slots, true,
+          num_states_});
+      add_states(all);
+      log_counts.push_back(log_all);
+    }
+  }
+
+  slots_.resize(max_group);
+  iota(slots_.begin(), slots_.end(), 0);
+
+  if (too_many) {
+    num_states_ = 0;
+    const double max_log_count =
+      *std::max_element(log_counts.begin(), log_counts.end());
+    double total = 0;
+    block_weights_.resize(blocks_.size());
+    for (unsigned int i = 0; i < blocks_.size(); ++i) {
+      total += std::exp(log_counts.at(i) - max_log_count);
+      block_weights_.at(i) = total;
+    }
+    for (double& weight : block_weights_) {
+      weight /= total;
+    }
+  } else if (num_states_ > kInOrderStates) {
+    order_.Init(num_states_, rand);
+  }
+}
+
+bool SubsetPermuter::gen_one_state_entries(CrashStateEntries& res) {
+  if (blocks_.empty()) {
+    res.clear();
+    return false;
+  }
+
+  if (!block_weights_.empty()) {
+    uniform_real_distribution<double> pick_block(0, 1);
+    const unsigned int i = min<unsigned int>(blocks_.size() - 1,
+        std::lower_bound(block_weights_.begin(), block_weights_.end(),
+          pick_block(rand)) - block_weights_.begin());
+    Draw(blocks_.at(i));
+    Fill(blocks_.at(i), res);
+    return true;
+  }
+
+  if (next_state_ >= num_states_) {
+    res.clear();
+    return false;
+  }
+  const uint64_t state = (num_states_ > kInOrderStates)
+    ? order_.At(next_state_) : next_state_;
+  ++next_state_;
+
+  const block& b = *(std::upper_bound(blocks_.begin(), blocks_.end(), state,
+        [](const uint64_t s, const block& other) {
+          return s < other.first_state;
+        }) - 1);
+  Decode(b, state - b.first_state);
+  Fill(b, res);
+  return true;
+}
+
+void SubsetPermuter::Decode(const block& b, uint64_t state) {
+  picks_.resize(b.num_groups);
+  digits_.resize(b.num_slots);
+  if (!b.barrier) {
+    // Number 0 would place none of the bios.
+    ++state;
+  }
+  // The crash state is a mixed radix number with a digit per group, each of
+  // which is the number of the ordering of the bios placed from the group.
+  unsigned int* digits = digits_.data();
+  for (unsigned int i = 0; i < b.num_groups; ++i) {
+    const group& g = groups_[b.first_group + i];
+    const uint64_t radix =
+      b.barrier ? Orderings(g.size, g.size) : g.num_states;
+    uint64_t ordering = state % radix;
+    state /= radix;
+
+    unsigned int k = b.barrier ? g.size : 0;
+    if (!b.barrier) {
+      uint64_t count = 1;
+      while (ordering >= count) {
+        ordering -= count;
+        ++k;
+        count *= g.size - k + 1;
+      }
+    }
+    picks_[i] = k;
+    for (unsigned int j = 0; j < k; ++j) {
+      digits[j] = ordering % (g.size - j);
+      ordering /= g.size - j;
+    }
+    digits += g.size;
+  }
+}
+
+void SubsetPermuter::Draw(const block& b) {
+  picks_.resize(b.num_groups);
+  digits_.resize(b.num_slots);
+  uniform_real_distribution<double> pick_count(0, 1);
+  unsigned int placed = 0;
+  // Drawing none of the bios is at worst as likely as drawing one of them, so
+  // this rarely takes more than a couple of tries.
+  while (placed == 0) {
+    unsigned int* digits = digits_.data();
+    for (unsigned int i = 0; i < b.num_groups; ++i) {
+      const group& g = groups_[b.first_group + i];
+      unsigned int k = g.size;
+      if (!b.barrier) {
+        const auto weights = k_weights_.begin() + g.first_weight;
+        k = min<unsigned int>(g.size, std::lower_bound(weights,
+              weights + g.size + 1, pick_count(rand)) - weights);
+      }
+      picks_[i] = k;
+      placed += k;
+      for (unsigned int j = 0; j < k; ++j) {
+        uniform_int_distribution<unsigned int> pick_slot(0, g.size - j - 1);
+        digits[j] = pick_slot(rand);
+      }
+      digits += g.size;
+    }
+    if (b.barrier) {
+      break;
+    }
+  }
+}
+
+void SubsetPermuter::Fill(const block& b, CrashStateEntries& res) {
+  const unsigned int start = epoch_start_.at(b.epoch);
+  res.assign(log_entries_.begin(), log_entries_.begin() + start);
+  const unsigned int* digits = digits_.data();
+  for (unsigned int i = 0; i < b.num_groups; ++i) {
+    const group& g = groups_[b.first_group + i];
+    const unsigned int* ops = group_ops_.data() + g.first;
+    // Same partial Fisher-Yates shuffle as RandomPermuter, with the picks
+    // given.
+    for (unsigned int j = 0; j < picks_[i]; ++j) {
+      swap(slots_[j], slots_[j + digits[j]]);
+      res.push_back(log_entries_[start + ops[slots_[j]]]);
+    }
+    for (unsigned int j = picks_[i]; j > 0; --j) {
+      swap(slots_[j - 1], slots_[j - 1 + digits[j - 1]]);
+    }
+    digits += g.size;
+  }
+  if (b.barrier) {
+    res.push_back(log_entries_[start + b.num_slots]);
+  }
+}
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+extern "C" fs_testing::permuter::Permuter* permuter_get_instance(
+    std::vector<fs_testing::utils::disk_write> *data) {
+  return new fs_testing::permuter::SubsetPermuter(data);
+}
+
+extern "C" void permuter_delete_instance(fs_testing::permuter::Permuter* p) {
+  delete p;
+}
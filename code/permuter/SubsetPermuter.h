@@ -0,0 +1,102 @@
+#ifndef SUBSET_PERMUTER_H
+#define SUBSET_PERMUTER_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Permuter.h"
+#include "../utils/RandomPermutation.h"
+#include "../utils/utils.h"
+
+namespace fs_testing {
+namespace permuter {
+
+// Like EnumerationPermuter, but only tries one order of bios that don't
+// overlap. The bios of an epoch, other than its barrier, are split into groups
+// that are connected by overlapping each other. A crash state is every epoch
+// before some epoch e in log order followed by, for each group of e, some of
+// its bios in some order. Groups of one bio are either in or out, so an epoch
+// of n bios that don't overlap has 2^n - 1 crash states rather than the sum of
+// n! / (n - k)! over k. The barrier only goes in after every other bio of e.
+//
+// Crash states are handed out in order when there are at most kInOrderStates
+// of them, in a random order that visits each once if they can be numbered in
+// 64 bits, and drawn uniformly at random otherwise.
+class SubsetPermuter : public Permuter {
+ public:
+  SubsetPermuter();
+  SubsetPermuter(std::vector<fs_testing::utils::disk_write> *data);
+
+  // Number of crash states, or 0 if there are too many to number.
+  uint64_t NumStates() const;
+
+  static const uint64_t kInOrderStates = 1 << 16;
+
+ private:
+  struct group {
+    // Bios of the group are group_ops_[first, first + size).
+    unsigned int first;
+    unsigned int size;
+    // Number of orderings of any number of the bios, 0 if too many to number.
+    uint64_t num_states;
+    // Chance of placing k of the bios is k_weights_[first_weight + k],
+    // accumulated over k.
+    unsigned int first_weight;
+  };
+
+  // Crash states that place some of the bios of groups
+  // [first_group, first_group + num_groups) of an epoch. If barrier is set,
+  // every one of the bios is placed, followed by the barrier of the epoch.
+  struct block {
+    unsigned int epoch;
+    unsigned int first_group;
+    unsigned int num_groups;
+    // Bios of the epoch other than its barrier.
+    unsigned int num_slots;
+    bool barrier;
+    // Number of the first crash state in the block.
+    uint64_t first_state;
+  };
+
+  virtual void init_data(std::vector<epoch> *data);
+  virtual void init_seed(const unsigned int seed);
+  virtual bool gen_one_state_entries(CrashStateEntries& res);
+  // Split the bios of e other than its barrier into groups that overlap.
+  void AddGroups(epoch& e, const unsigned int num_slots);
+  // Fill picks_ and digits_ with crash state number state of block b.
+  void Decode(const block& b, uint64_t state);
+  // Fill picks_ and digits_ with a crash state of block b drawn at random.
+  void Draw(const block& b);
+  // Fill res with the crash state of block b given by picks_ and digits_.
+  void Fill(const block& b, CrashStateEntries& res);
+
+  std::mt19937 rand;
+  // Log entries of every epoch in log order and where each epoch starts.
+  std::vector<unsigned int> log_entries_;
+  std::vector<unsigned int> epoch_start_;
+  // Index in its epoch of each bio, grouped by groups_.
+  std::vector<unsigned int> group_ops_;
+  std::vector<group> groups_;
+  std::vector<double> k_weights_;
+  std::vector<block> blocks_;
+  uint64_t num_states_ = 0;
+  uint64_t next_state_ = 0;
+  // Used when there are too many crash states to number. Chance of drawing a
+  // crash state from each block, accumulated over blocks_.
+  std::vector<double> block_weights_;
+  // Order crash states are handed out in if there are more than
+  // kInOrderStates.
+  fs_testing::utils::RandomPermutation order_;
+  // Reused between crash states so that picking bios doesn't allocate. The
+  // number of bios placed from each group of a block, and which of the bios
+  // left to pick from each pick takes, in the order of group_ops_.
+  std::vector<unsigned int> picks_;
+  std::vector<unsigned int> digits_;
+  std::vector<unsigned int> slots_;
+};
+
+}  // namespace permuter
+}  // namespace fs_testing
+
+#endif  // SUBSET_PERMUTER_H
@@ -2,6 +2,7 @@
 #define HARNESS_FILE_SYSTEM_TEST_RESULT_H
 
 #include <iostream>
+#include <string>
 
 namespace fs_testing {
 
@@ -34,6 +35,8 @@ class FileSystemTestResult {
   std::string error_description;
 
   int fs_check_return;
+  // Output of the file system checker if it did not return cleanly.
+  std::string fs_check_log;
 
  private:
   ErrorType error_summary_;
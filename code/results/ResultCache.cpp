@@ -0,0 +1,224 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "ResultCache.h"
+
+namespace fs_testing {
+
+using std::memcmp;
+using std::memcpy;
+using std::string;
+
+using fs_testing::utils::Fingerprint;
+using fs_testing::utils::FingerprintBuilder;
+
+namespace {
+
+static const char kMagic[8] = {'C', 'M', 'R', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t kVersion = 1;
+
+struct cache_header {
+  char magic[sizeof(kMagic)];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+uint32_t RecordChecksum(const CachedResult& res) {
+  FingerprintBuilder builder;
+  builder.Update(&res, offsetof(CachedResult, checksum));
+  return builder.Digest().lo;
+}
+
+Fingerprint RecordKey(const CachedResult& res) {
+  Fingerprint key;
+  key.lo = res.key_lo;
+  key.hi = res.key_hi;
+  return key;
+}
+
+bool WriteAll(const int fd, const void* buf, const size_t len, off_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t res =
+      pwrite(fd, (const char*) buf + done, len - done, offset + done);
+    if (res < 0) {
+      return false;
+    }
+    done += res;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ResultCache::LoadRecords(const int fd, result_index* index,
+    unsigned int* dropped) {
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    return false;
+  }
+  if (info.st_size == 0) {
+    cache_header header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.record_size = sizeof(CachedResult);
+    return WriteAll(fd, &header, sizeof(header), 0);
+  }
+  if ((size_t) info.st_size < sizeof(cache_header)) {
+    return false;
+  }
+
+  const size_t num_records =
+    (info.st_size - sizeof(cache_header)) / sizeof(CachedResult);
+  const size_t used = sizeof(cache_header) + num_records * sizeof(CachedResult);
+  void* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  const cache_header* header = (const cache_header*) map;
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+      || header->version != kVersion
+      || header->record_size != sizeof(CachedResult)) {
+    munmap(map, info.st_size);
+    return false;
+  }
+  const CachedResult* records =
+    (const CachedResult*) ((const char*) map + sizeof(cache_header));
+  for (size_t i = 0; i < num_records; ++i) {
+    if (records[i].checksum != RecordChecksum(records[i])) {
+      ++*dropped;
+      continue;
+    }
+    // Later records win.
+    if (!index->emplace(RecordKey(records[i]), records[i]).second) {
+      (*index)[RecordKey(records[i])] = records[i];
+      ++*dropped;
+    }
+  }
+  munmap(map, info.st_size);
+
+  if (used != (size_t) info.st_size && ftruncate(fd, used) < 0) {
+    return false;
+  }
+  return true;
+}
+
+ResultCache::~ResultCache() {
+  Close();
+}
+
+bool ResultCache::Open(const string& path) {
+  Close();
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (flock(fd_, LOCK_EX) < 0) {
+    Close();
+    return false;
+  }
+  const bool loaded = LoadRecords(fd_, &index_, &dropped_);
+  flock(fd_, LOCK_UN);
+  if (!loaded) {
+    Close();
+  }
+  return loaded;
+}
+
+void ResultCache::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+  index_.clear();
+  dropped_ = 0;
+}
+
+bool ResultCache::Lookup(const Fingerprint& key, CachedResult* res) const {
+  const auto found = index_.find(key);
+  if (found == index_.end()) {
+    return false;
+  }
+  *res = found->second;
+  return true;
+}
+
+bool ResultCache::Append(const Fingerprint& key, CachedResult res) {
+  if (fd_ < 0) {
+    return false;
+  }
+  res.key_lo = key.lo;
+  res.key_hi = key.hi;
+  res.checksum = RecordChecksum(res);
+
+  if (flock(fd_, LOCK_EX) < 0) {
+    return false;
+  }
+  // Append at a record boundary even if someone died part way through theirs.
+  // A torn record is always shorter than a whole one, so writing over it leaves
+  // nothing behind.
+  struct stat info;
+  bool written = false;
+  if (fstat(fd_, &info) == 0) {
+    off_t end = info.st_size;
+    end -= (end - sizeof(cache_header)) % sizeof(CachedResult);
+    written = WriteAll(fd_, &res, sizeof(res), end);
+  }
+  flock(fd_, LOCK_UN);
+  if (written) {
+    index_[key] = res;
+  }
+  return written;
+}
+
+unsigned int ResultCache::Size() const {
+  return index_.size();
+}
+
+bool ResultCache::Compact(const string& path, unsigned int* kept,
+    unsigned int* dropped) {
+  ResultCache cache;
+  if (!cache.Open(path)) {
+    return false;
+  }
+  // Hold the lock the whole time so that nobody appends to the old file while
+  // it is being copied.
+  if (flock(cache.fd_, LOCK_EX) < 0) {
+    return false;
+  }
+  // Reload in case something was appended between Open and the lock.
+  cache.index_.clear();
+  cache.dropped_ = 0;
+  if (!LoadRecords(cache.fd_, &cache.index_, &cache.dropped_)) {
+    return false;
+  }
+
+  const string tmp_path = path + ".compact";
+  ResultCache compacted;
+  unlink(tmp_path.c_str());
+  if (!compacted.Open(tmp_path)) {
+    return false;
+  }
+  for (const auto& record : cache.index_) {
+    if (!compacted.Append(record.first, record.second)) {
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (fsync(compacted.fd_) < 0 || rename(tmp_path.c_str(), path.c_str()) < 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  *kept = cache.index_.size();
+  *dropped = cache.dropped_;
+  return true;
+}
+
+}  // namespace fs_testing
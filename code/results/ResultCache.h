@@ -0,0 +1,71 @@
+#ifndef HARNESS_RESULT_CACHE_H
+#define HARNESS_RESULT_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "../utils/Fingerprint.h"
+
+namespace fs_testing {
+
+// Result of checking a single crash state as it is stored in a ResultCache.
+// Written to disk as is, so it may only hold fixed size types.
+struct CachedResult {
+  uint64_t key_lo;
+  uint64_t key_hi;
+  int32_t fs_check_return;
+  uint32_t fs_error;
+  uint32_t data_error;
+  // Covers everything above so that torn or corrupt records can be skipped.
+  uint32_t checksum;
+};
+
+// Append only file of crash state results that outlives a single run of the
+// harness. Records are keyed by a Fingerprint of everything that determines
+// the result of a crash state, so later runs over the same profile only have
+// to check crash states that no earlier run has seen.
+//
+// Any number of processes may have the same cache open and append to it. An
+// exclusive flock is held for every append so that records never interleave.
+// Records appended by other processes after Open are not seen until the cache
+// is opened again.
+// *** This is not a thread-safe class. ***
+class ResultCache {
+ public:
+  ~ResultCache();
+  // Open the cache at path, creating it if needed, and load every valid record
+  // in it. Returns false if the file can't be used as a cache.
+  bool Open(const std::string& path);
+  void Close();
+  bool Lookup(const fs_testing::utils::Fingerprint& key,
+      CachedResult* res) const;
+  bool Append(const fs_testing::utils::Fingerprint& key, CachedResult res);
+  // Number of distinct keys in the cache.
+  unsigned int Size() const;
+
+  // Rewrite the cache at path keeping only the last valid record for each key.
+  // Other processes must not have the cache open while it is being compacted,
+  // as anything they append afterwards goes to the old file.
+  static bool Compact(const std::string& path, unsigned int* kept,
+      unsigned int* dropped);
+
+ private:
+  typedef std::unordered_map<fs_testing::utils::Fingerprint, CachedResult,
+    fs_testing::utils::FingerprintHash> result_index;
+
+  // Check the header of the cache in fd and load every valid record in it into
+  // index. Writes a header if the file is empty and cuts off a torn record left
+  // at the end by an appender that died. fd must be locked exclusively.
+  static bool LoadRecords(const int fd, result_index* index,
+      unsigned int* dropped);
+
+  int fd_ = -1;
+  result_index index_;
+  // Number of records in the file that were unreadable or had a repeat key.
+  unsigned int dropped_ = 0;
+};
+
+}  // namespace fs_testing
+
+#endif  // HARNESS_RESULT_CACHE_H
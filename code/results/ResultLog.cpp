@@ -0,0 +1,144 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "ResultLog.h"
+
+namespace fs_testing {
+
+using std::ifstream;
+using std::memcmp;
+using std::memcpy;
+using std::string;
+
+namespace {
+
+static const char kMagic[8] = {'C', 'M', 'R', 'E', 'S', 'U', 'L', 'T'};
+static const uint32_t kVersion = 1;
+static const char kFsckLogSuffix[] = ".fsck";
+// Flush records once this much has been buffered.
+static const unsigned int kBufferSize = 64 * 1024;
+
+struct log_header {
+  char magic[sizeof(kMagic)];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+bool WriteAll(const int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    const ssize_t res = write(fd, buf, len);
+    if (res < 0) {
+      return false;
+    }
+    buf += res;
+    len -= res;
+  }
+  return true;
+}
+
+}  // namespace
+
+ResultWriter::~ResultWriter() {
+  Close();
+}
+
+bool ResultWriter::Open(const string& path) {
+  Close();
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  fsck_fd_ = open((path + kFsckLogSuffix).c_str(),
+      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0 || fsck_fd_ < 0) {
+    Close();
+    return false;
+  }
+  fsck_log_size_ = 0;
+  buf_.reserve(kBufferSize);
+
+  log_header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(ResultRecord);
+  buf_.insert(buf_.end(), (const char*) &header,
+      (const char*) &header + sizeof(header));
+  return true;
+}
+
+bool ResultWriter::IsOpen() const {
+  return fd_ >= 0;
+}
+
+bool ResultWriter::Append(ResultRecord* record, const string& fsck_log) {
+  if (fd_ < 0) {
+    return false;
+  }
+  if (!fsck_log.empty()) {
+    if (!WriteAll(fsck_fd_, fsck_log.data(), fsck_log.size())) {
+      return false;
+    }
+    record->fsck_log_offset = fsck_log_size_;
+    record->fsck_log_size = fsck_log.size();
+    fsck_log_size_ += fsck_log.size();
+  }
+  record->reserved = 0;
+  buf_.insert(buf_.end(), (const char*) record,
+      (const char*) record + sizeof(*record));
+  if (buf_.size() >= kBufferSize) {
+    return Flush();
+  }
+  return true;
+}
+
+bool ResultWriter::Flush() {
+  if (fd_ < 0) {
+    return false;
+  }
+  const bool res = WriteAll(fd_, buf_.data(), buf_.size());
+  buf_.clear();
+  return res;
+}
+
+bool ResultWriter::Close() {
+  bool res = true;
+  if (fd_ >= 0) {
+    res = Flush();
+    close(fd_);
+  }
+  if (fsck_fd_ >= 0) {
+    close(fsck_fd_);
+  }
+  fd_ = -1;
+  fsck_fd_ = -1;
+  buf_.clear();
+  return res;
+}
+
+bool ResultReader::Open(const string& path) {
+  records_.open(path, ifstream::binary);
+  fsck_log_.open(path + kFsckLogSuffix, ifstream::binary);
+  log_header header;
+  records_.read((char*) &header, sizeof(header));
+  return records_.good() && memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+    && header.version == kVersion
+    && header.record_size == sizeof(ResultRecord);
+}
+
+bool ResultReader::Next(ResultRecord* record) {
+  // A partial record at the end means the writer died part way through.
+  records_.read((char*) record, sizeof(*record));
+  return records_.gcount() == sizeof(*record);
+}
+
+bool ResultReader::ReadFsckLog(const ResultRecord& record, string* log) {
+  log->resize(record.fsck_log_size);
+  if (record.fsck_log_size == 0) {
+    return true;
+  }
+  fsck_log_.clear();
+  fsck_log_.seekg(record.fsck_log_offset);
+  fsck_log_.read(&log->at(0), record.fsck_log_size);
+  return fsck_log_.gcount() == record.fsck_log_size;
+}
+
+}  // namespace fs_testing
@@ -0,0 +1,87 @@
+#ifndef HARNESS_RESULT_LOG_H
+#define HARNESS_RESULT_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs_testing {
+
+// Result of checking a single crash state as it is written to a result log.
+// Written to disk as is, so it may only hold fixed size types.
+struct ResultRecord {
+  enum Source {
+    // The crash state was checked.
+    kChecked = 0,
+    // An equivalent crash state was checked earlier in the same run.
+    kReused = 1,
+    // An equivalent crash state was checked by an earlier run.
+    kCached = 2,
+  };
+
+  enum Stage {
+    kSnapshotStage = 0,
+    kBioWriteStage,
+    kFsckStage,
+    kTestCaseStage,
+    kNumStages,
+  };
+
+  // Order the crash state was generated in.
+  uint64_t state_id;
+  // Fingerprint of the crash state signature.
+  uint64_t signature_lo;
+  uint64_t signature_hi;
+  // Where the output of fsck is in the fsck log. Size 0 if there is none.
+  uint64_t fsck_log_offset;
+  uint32_t fsck_log_size;
+  int32_t fs_check_return;
+  uint32_t fs_error;
+  uint32_t data_error;
+  uint32_t source;
+  // Time spent on each stage in microseconds. All 0 unless source is kChecked.
+  uint32_t stage_us[kNumStages];
+  uint32_t reserved;
+};
+
+// Streams ResultRecords to an append only file through a buffer. Output from
+// fsck goes to a second file next to it (path + ".fsck") that records point
+// into.
+// *** This is not a thread-safe class. ***
+class ResultWriter {
+ public:
+  ~ResultWriter();
+  // Create the log at path, replacing anything that was there.
+  bool Open(const std::string& path);
+  bool IsOpen() const;
+  // If fsck_log isn't empty it is written out and record is pointed at it.
+  // Otherwise the fsck log fields of record are left as they are, so that a
+  // reused result can point at the output of the check it reuses.
+  bool Append(ResultRecord* record, const std::string& fsck_log);
+  bool Flush();
+  bool Close();
+
+ private:
+  int fd_ = -1;
+  int fsck_fd_ = -1;
+  uint64_t fsck_log_size_ = 0;
+  std::vector<char> buf_;
+};
+
+// Reads back what a ResultWriter wrote.
+class ResultReader {
+ public:
+  bool Open(const std::string& path);
+  // Get the next record in the log. Returns false at the end of the log.
+  bool Next(ResultRecord* record);
+  bool ReadFsckLog(const ResultRecord& record, std::string* log);
+
+ private:
+  std::ifstream records_;
+  std::ifstream fsck_log_;
+};
+
+}  // namespace fs_testing
+
+#endif  // HARNESS_RESULT_LOG_H
@@ -6,11 +6,11 @@
 
 namespace fs_testing {
 
-// TODO(ashmrtn): Watch memory consumption with this. If we have 1 million tests
-// then we will have 1 million class instantiations which could be a lot of
-// memory. We are already potentially using a lot of memory for the RAM block
-// device and disk wrapper logging and we want this to be a useable test
-// harness.
+// Only lives as long as it takes to check a crash state. TestSuiteResult keeps
+// running totals and ResultWriter streams compact records of each test to disk.
+// The only thing kept per crash state is a few words of result for each
+// distinct signature (see Tester::signature_result), so that equivalent crash
+// states can reuse it.
 
 // Container for all things related to the crash state being tested including
 // 1. bio prefix used to generate the state
@@ -6,69 +6,103 @@ namespace fs_testing {
 
 using std::endl;;
 using std::ostream;
-using std::vector;
 
 using fs_testing::tests::DataTestResult;
 using fs_testing::FileSystemTestResult;
 using fs_testing::SingleTestInfo;
 
-void TestSuiteResult::AddCompletedTest(const SingleTestInfo& done) {
-  completed_.push_back(done);
+void TestSuiteResult::Count(const unsigned int fs_error,
+    const unsigned int data_error) {
+  ++completed_;
+  if (fs_error == FileSystemTestResult::kClean
+      && data_error == DataTestResult::kClean) {
+    ++num_passed_;
+  } else if (fs_error == FileSystemTestResult::kFixed
+      && data_error == DataTestResult::kClean) {
+    ++num_passed_fixed_;
+  } else {
+    ++num_failed_;
+    switch (data_error) {
+      case DataTestResult::kOldFilePersisted:
+        ++old_file_persisted_;
+        break;
+      case DataTestResult::kFileMissing:
+        ++file_missing_;
+        break;
+      case DataTestResult::kFileDataCorrupted:
+        ++file_data_corrupted_;
+        break;
+      case DataTestResult::kFileMetadataCorrupted:
+        ++file_metadata_corrupted_;
+        break;
+      case DataTestResult::kOther:
+        ++other_;
+        break;
+    }
+  }
 }
 
-unsigned int TestSuiteResult::GetCompleted() const {
-  return completed_.size();
+void TestSuiteResult::AddCompletedTest(const SingleTestInfo& done) {
+  Count(done.fs_test.GetError(), done.data_test.GetError());
 }
 
-void TestSuiteResult::PrintResults(ostream& os) const {
-  unsigned int num_failed = 0;
-  unsigned int num_passed_fixed = 0;
-  unsigned int num_passed = 0;
+void TestSuiteResult::AddReusedTest(const SingleTestInfo& done) {
+  AddCompletedTest(done);
+  ++reused_;
+}
 
-  unsigned int old_file_persisted = 0;
-  unsigned int file_missing = 0;
-  unsigned int file_data_corrupted = 0;
-  unsigned int file_metadata_corrupted = 0;
-  unsigned int other = 0;
+void TestSuiteResult::AddCachedTest(const SingleTestInfo& done) {
+  AddCompletedTest(done);
+  ++cached_;
+}
 
-  for (const auto& result : completed_) {
-    if (result.fs_test.GetError() == FileSystemTestResult::kClean
-        && result.data_test.GetError() == DataTestResult::kClean) {
-      ++num_passed;
-    } else if (result.fs_test.GetError() == FileSystemTestResult::kFixed
-        && result.data_test.GetError() == DataTestResult::kClean) {
-      ++num_passed_fixed;
-    } else {
-      ++num_failed;
-      switch (result.data_test.GetError()) {
-        case DataTestResult::kOldFilePersisted:
-          ++old_file_persisted;
-          break;
-        case DataTestResult::kFileMissing:
-          ++file_missing;
-          break;
-        case DataTestResult::kFileDataCorrupted:
-          ++file_data_corrupted;
-          break;
-        case DataTestResult::kFileMetadataCorrupted:
-          ++file_metadata_corrupted;
-          break;
-        case DataTestResult::kOther:
-          ++other;
-          break;
-      }
-    }
+void TestSuiteResult::AddRecord(const ResultRecord& record) {
+  Count(record.fs_error, record.data_error);
+  if (record.source == ResultRecord::kReused) {
+    ++reused_;
+  } else if (record.source == ResultRecord::kCached) {
+    ++cached_;
   }
+}
 
-  os << "Ran " << num_failed + num_passed_fixed + num_passed << " tests with"
-    << "\n\tpassed cleanly: " << num_passed
-    << "\n\tpassed fixed: " << num_passed_fixed
-    << "\n\tfailed: " << num_failed
-    << "\n\t\told file persisted: " << old_file_persisted
-    << "\n\t\tfile missing: " << file_missing
-    << "\n\t\tfile data corrupted: " << file_data_corrupted
-    << "\n\t\tfile metadata corrupted: " << file_metadata_corrupted
-    << "\n\t\tother: " << other << endl;
+void TestSuiteResult::Merge(const TestSuiteResult& other) {
+  completed_ += other.completed_;
+  reused_ += other.reused_;
+  cached_ += other.cached_;
+  num_failed_ += other.num_failed_;
+  num_passed_fixed_ += other.num_passed_fixed_;
+  num_passed_ += other.num_passed_;
+  old_file_persisted_ += other.old_file_persisted_;
+  file_missing_ += other.file_missing_;
+  file_data_corrupted_ += other.file_data_corrupted_;
+  file_metadata_corrupted_ += other.file_metadata_corrupted_;
+  other_ += other.other_;
+}
+
+unsigned int TestSuiteResult::GetCompleted() const {
+  return completed_;
+}
+
+unsigned int TestSuiteResult::GetReused() const {
+  return reused_;
+}
+
+unsigned int TestSuiteResult::GetCached() const {
+  return cached_;
+}
+
+void TestSuiteResult::PrintResults(ostream& os) const {
+  os << "Ran " << completed_ << " tests with"
+    << "\n\treused from equivalent crash states: " << reused_
+    << "\n\treused from result cache: " << cached_
+    << "\n\tpassed cleanly: " << num_passed_
+    << "\n\tpassed fixed: " << num_passed_fixed_
+    << "\n\tfailed: " << num_failed_
+    << "\n\t\told file persisted: " << old_file_persisted_
+    << "\n\t\tfile missing: " << file_missing_
+    << "\n\t\tfile data corrupted: " << file_data_corrupted_
+    << "\n\t\tfile metadata corrupted: " << file_metadata_corrupted_
+    << "\n\t\tother: " << other_ << endl;
 }
 
 }  // namespace fs_testing
@@ -1,22 +1,50 @@
 #ifndef HARNESS_TEST_SUITE_RESULT_H
 #define HARNESS_TEST_SUITE_RESULT_H
 
-#include <vector>
-
 #include <iostream>
 
+#include "ResultLog.h"
 #include "SingleTestInfo.h"
 
 namespace fs_testing {
 
+// Running totals of the results of a set of tests. Results themselves aren't
+// kept, use a ResultWriter for that.
 class TestSuiteResult {
  public:
   void AddCompletedTest(const fs_testing::SingleTestInfo& done);
+  // Add a test that was not run because an equivalent crash state was already
+  // checked. done is the result of that equivalent crash state.
+  void AddReusedTest(const fs_testing::SingleTestInfo& done);
+  // Add a test that was not run because an earlier run of the harness already
+  // checked an equivalent crash state.
+  void AddCachedTest(const fs_testing::SingleTestInfo& done);
+  // Add a test read back from a result log.
+  void AddRecord(const ResultRecord& record);
+  // Add all the tests completed in another suite to this one.
+  void Merge(const TestSuiteResult& other);
   unsigned int GetCompleted() const;
+  // Number of completed tests that reused the result of another test.
+  unsigned int GetReused() const;
+  unsigned int GetCached() const;
   void PrintResults(std::ostream& os) const;
 
  private:
-  std::vector<fs_testing::SingleTestInfo> completed_;
+  void Count(const unsigned int fs_error, const unsigned int data_error);
+
+  unsigned int completed_ = 0;
+  unsigned int reused_ = 0;
+  unsigned int cached_ = 0;
+
+  unsigned int num_failed_ = 0;
+  unsigned int num_passed_fixed_ = 0;
+  unsigned int num_passed_ = 0;
+
+  unsigned int old_file_persisted_ = 0;
+  unsigned int file_missing_ = 0;
+  unsigned int file_data_corrupted_ = 0;
+  unsigned int file_metadata_corrupted_ = 0;
+  unsigned int other_ = 0;
 };
 
 }  // namespace fs_testing
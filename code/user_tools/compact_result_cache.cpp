@@ -0,0 +1,27 @@
+#include <iostream>
+
+#include "../results/ResultCache.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+using fs_testing::ResultCache;
+
+// Drop unreadable and repeated records from a result cache. Don't run this
+// while the harness has the cache open.
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " <result cache>" << endl;
+    return -1;
+  }
+  unsigned int kept = 0;
+  unsigned int dropped = 0;
+  if (!ResultCache::Compact(argv[1], &kept, &dropped)) {
+    cerr << "error compacting result cache " << argv[1] << endl;
+    return -1;
+  }
+  cout << "kept " << kept << " results, dropped " << dropped << " records"
+    << endl;
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <getopt.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "../utils/communication/ClientSocket.h"
+#include "../utils/communication/SocketUtils.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::fixed;
+using std::setprecision;
+
+using fs_testing::utils::communication::ClientSocket;
+using fs_testing::utils::communication::HarnessStats;
+using fs_testing::utils::communication::kSocketNameOutbound;
+using fs_testing::utils::communication::SocketError;
+using fs_testing::utils::communication::SocketMessage;
+
+static const char* const kStageNames[HarnessStats::kNumStages] = {
+  "permute",
+  "snapshot restore",
+  "bio write",
+  "fsck",
+  "mount",
+  "test case",
+  "umount",
+};
+
+static double rate(const uint64_t states, const uint64_t ms) {
+  return (ms == 0) ? 0 : states * 1000.0 / ms;
+}
+
+static double percent(const uint64_t part, const uint64_t whole) {
+  return (whole == 0) ? 0 : part * 100.0 / whole;
+}
+
+static void print_stats(const HarnessStats& stats) {
+  cout << fixed << setprecision(1)
+    << "completed " << stats.completed << " of " << stats.states_target
+    << " crash states in " << stats.elapsed_ms / 1000.0 << " s"
+    << "\n\tcurrent rate: " << rate(stats.window_completed, stats.window_ms)
+    << " states/s over the last " << stats.window_ms / 1000.0 << " s"
+    << "\n\taverage rate: " << rate(stats.completed, stats.elapsed_ms)
+    << " states/s"
+    << "\n\tdedup hit rate: "
+    << percent(stats.reused + stats.cached, stats.completed) << "% ("
+    << stats.reused << " equivalent states, " << stats.cached
+    << " from result cache)"
+    << "\n\tpassed cleanly: " << stats.passed
+    << "\n\tpassed fixed: " << stats.passed_fixed
+    << "\n\tfailed: " << stats.failed
+    << "\n\t\told file persisted: " << stats.old_file_persisted
+    << "\n\t\tfile missing: " << stats.file_missing
+    << "\n\t\tfile data corrupted: " << stats.file_data_corrupted
+    << "\n\t\tfile metadata corrupted: " << stats.file_metadata_corrupted
+    << "\n\t\tother: " << stats.other
+    << "\n\ttime in each stage, summed over all workers:" << endl;
+  uint64_t total_us = 0;
+  for (unsigned int i = 0; i < HarnessStats::kNumStages; ++i) {
+    total_us += stats.stage_us[i];
+  }
+  for (unsigned int i = 0; i < HarnessStats::kNumStages; ++i) {
+    cout << "\t\t" << kStageNames[i] << ": " << stats.stage_us[i] / 1000
+      << " ms (" << percent(stats.stage_us[i], total_us) << "%)" << endl;
+  }
+}
+
+// Ask a harness running in background mode how far along its tests are.
+int main(int argc, char** argv) {
+  unsigned int interval = 0;
+  int c;
+  while ((c = getopt(argc, argv, "w:")) != -1) {
+    switch (c) {
+      case 'w':
+        interval = atoi(optarg);
+        break;
+      default:
+        cerr << "usage: " << argv[0] << " [-w <seconds between queries>]"
+          << endl;
+        return -1;
+    }
+  }
+
+  while (true) {
+    ClientSocket conn(kSocketNameOutbound);
+    if (conn.Init() < 0) {
+      cerr << "error connecting to harness" << endl;
+      return -1;
+    }
+    if (conn.SendCommand(SocketMessage::kStats) != SocketError::kNone) {
+      cerr << "error sending stats query" << endl;
+      return -1;
+    }
+    SocketMessage reply;
+    if (conn.WaitForMessage(&reply) != SocketError::kNone) {
+      cerr << "error reading stats" << endl;
+      return -1;
+    }
+    if (reply.type != SocketMessage::kStatsDone) {
+      cerr << "harness is not running tests" << endl;
+      return -1;
+    }
+    print_stats(reply.stats_value);
+
+    if (interval == 0) {
+      break;
+    }
+    cout << endl;
+    sleep(interval);
+  }
+  return 0;
+}
@@ -0,0 +1,190 @@
+#include <getopt.h>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../results/DataTestResult.h"
+#include "../results/FileSystemTestResult.h"
+#include "../results/ResultLog.h"
+#include "../results/TestSuiteResult.h"
+
+#define OPTS_STRING "d:f:Fls:x"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+using fs_testing::FileSystemTestResult;
+using fs_testing::ResultReader;
+using fs_testing::ResultRecord;
+using fs_testing::TestSuiteResult;
+using fs_testing::tests::DataTestResult;
+
+namespace {
+
+static const option long_options[] = {
+  {"data-error", required_argument, NULL, 'd'},
+  {"fs-error", required_argument, NULL, 'f'},
+  {"failed", no_argument, NULL, 'F'},
+  {"list", no_argument, NULL, 'l'},
+  {"source", required_argument, NULL, 's'},
+  {"fsck-log", no_argument, NULL, 'x'},
+  {0, 0, 0, 0},
+};
+
+static const char* const kSourceNames[] = {"checked", "reused", "cached"};
+static const char* const kStageNames[] = {
+  "snapshot", "bio write", "fsck", "test case"};
+
+template <typename ErrorType>
+string ErrorName(const unsigned int err) {
+  if (err == 0) {
+    return "clean";
+  }
+  std::ostringstream name;
+  name << (ErrorType) err;
+  if (name.fail()) {
+    std::ostringstream mask;
+    mask << "0x" << std::hex << err;
+    return mask.str();
+  }
+  return name.str();
+}
+
+bool Failed(const ResultRecord& record) {
+  return record.data_error != DataTestResult::kClean
+    || (record.fs_error != FileSystemTestResult::kClean
+        && record.fs_error != FileSystemTestResult::kFixed);
+}
+
+}  // namespace
+
+// Summarize the results in a result log written by c_harness and list the
+// crash states that match the given filters.
+int main(int argc, char** argv) {
+  bool list = false;
+  bool failed_only = false;
+  bool fsck_log = false;
+  long int fs_error = -1;
+  long int data_error = -1;
+  int source = -1;
+
+  int option_idx = 0;
+  for (int c = getopt_long(argc, argv, OPTS_STRING, long_options, &option_idx);
+        c != -1;
+        c = getopt_long(argc, argv, OPTS_STRING, long_options, &option_idx)) {
+    switch (c) {
+      case 'd':
+        data_error = strtol(optarg, NULL, 0);
+        break;
+      case 'f':
+        fs_error = strtol(optarg, NULL, 0);
+        break;
+      case 'F':
+        failed_only = true;
+        break;
+      case 'l':
+        list = true;
+        break;
+      case 's':
+        for (unsigned int i = 0; i < 3; ++i) {
+          if (string(optarg) == kSourceNames[i]) {
+            source = i;
+          }
+        }
+        if (source < 0) {
+          cerr << "Unknown result source " << optarg << endl;
+          return -1;
+        }
+        break;
+      case 'x':
+        fsck_log = true;
+        break;
+      case '?':
+      default:
+        return -1;
+    }
+  }
+  if (optind + 1 != argc) {
+    cerr << "usage: " << argv[0] << " [--list] [--failed] [--fs-error mask]"
+      << " [--data-error mask] [--source checked|reused|cached] [--fsck-log]"
+      << " <result log>" << endl;
+    return -1;
+  }
+
+  ResultReader reader;
+  if (!reader.Open(argv[optind])) {
+    cerr << "Error opening result log " << argv[optind] << endl;
+    return -1;
+  }
+
+  TestSuiteResult all;
+  TestSuiteResult matched;
+  unsigned long int stage_totals[ResultRecord::kNumStages] = {};
+  ResultRecord record;
+  string log;
+  while (reader.Next(&record)) {
+    all.AddRecord(record);
+    if (record.source == ResultRecord::kChecked) {
+      for (unsigned int i = 0; i < ResultRecord::kNumStages; ++i) {
+        stage_totals[i] += record.stage_us[i];
+      }
+    }
+
+    if ((failed_only && !Failed(record))
+        || (fs_error >= 0 && !(record.fs_error & fs_error)
+          && !(fs_error == 0 && record.fs_error == 0))
+        || (data_error >= 0 && !(record.data_error & data_error)
+          && !(data_error == 0 && record.data_error == 0))
+        || (source >= 0 && record.source != (unsigned int) source)) {
+      continue;
+    }
+    matched.AddRecord(record);
+    if (!list) {
+      continue;
+    }
+    cout << "state " << record.state_id
+      << " signature " << std::hex << std::setfill('0') << std::setw(16)
+      << record.signature_hi << std::setw(16) << record.signature_lo
+      << std::dec << std::setfill(' ')
+      << " " << kSourceNames[record.source % 3]
+      << " fs " << ErrorName<FileSystemTestResult::ErrorType>(record.fs_error)
+      << " data " << ErrorName<DataTestResult::ErrorType>(record.data_error)
+      << " fsck " << record.fs_check_return;
+    if (record.source == ResultRecord::kChecked) {
+      cout << " us";
+      for (unsigned int i = 0; i < ResultRecord::kNumStages; ++i) {
+        cout << " " << record.stage_us[i];
+      }
+    }
+    cout << endl;
+    if (fsck_log && record.fsck_log_size > 0) {
+      if (reader.ReadFsckLog(record, &log)) {
+        cout << log << endl;
+      } else {
+        cerr << "Error reading fsck log for state " << record.state_id << endl;
+      }
+    }
+  }
+
+  all.PrintResults(cout);
+  const unsigned int checked =
+    all.GetCompleted() - all.GetReused() - all.GetCached();
+  for (unsigned int i = 0; i < ResultRecord::kNumStages; ++i) {
+    cout << "\t" << kStageNames[i] << " time: " << stage_totals[i] / 1000
+      << " ms";
+    if (checked > 0) {
+      cout << " (" << stage_totals[i] / checked << " us per checked state)";
+    }
+    cout << endl;
+  }
+  if (list || failed_only || fs_error >= 0 || data_error >= 0 || source >= 0) {
+    cout << endl << "Matching tests:" << endl;
+    matched.PrintResults(cout);
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <cstring>
+
+#include "Crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace fs_testing {
+namespace utils {
+
+namespace {
+
+// Reflected polynomial of CRC32C.
+const uint32_t kPolynomial = 0x82f63b78;
+
+// Slicing-by-8 tables for CPUs without the crc32 instruction.
+struct Crc32cTables {
+  uint32_t table[8][256];
+
+  Crc32cTables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (unsigned int j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+      }
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (unsigned int j = 1; j < 8; ++j) {
+        table[j][i] =
+          (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+uint32_t Crc32cSoftware(const unsigned char* data, std::size_t len,
+    uint32_t crc) {
+  static const Crc32cTables tables;
+  const uint32_t (*t)[256] = tables.table;
+  while (len >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff]
+      ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff]
+      ^ t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff]
+      ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+    data += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+    ++data;
+    --len;
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(const unsigned char* data, std::size_t len,
+    uint32_t crc) {
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    len -= 8;
+  }
+  crc = crc64;
+  while (len > 0) {
+    crc = _mm_crc32_u8(crc, *data);
+    ++data;
+    --len;
+  }
+  return crc;
+}
+#endif
+
+}  // namespace
+
+uint32_t Crc32c(const void* data, std::size_t len, uint32_t crc) {
+  const unsigned char* bytes = (const unsigned char*) data;
+  crc = ~crc;
+#if defined(__x86_64__)
+  static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+  if (has_sse42) {
+    return ~Crc32cHardware(bytes, len, crc);
+  }
+#endif
+  return ~Crc32cSoftware(bytes, len, crc);
+}
+
+}  // namespace utils
+}  // namespace fs_testing
@@ -0,0 +1,18 @@
+#ifndef UTILS_CRC32C_H
+#define UTILS_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fs_testing {
+namespace utils {
+
+// CRC32C (Castagnoli) of len bytes at data, continuing from crc so that a
+// buffer can be checked a piece at a time. Uses the SSE4.2 crc32 instruction
+// when the CPU has it.
+uint32_t Crc32c(const void* data, std::size_t len, uint32_t crc = 0);
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_CRC32C_H
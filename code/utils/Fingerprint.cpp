@@ -0,0 +1,118 @@
+#include <cstring>
+
+#include "Fingerprint.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::memcpy;
+
+namespace {
+
+// Constants from MurmurHash3.
+static const uint64_t kC1 = 0x87c37b91114253d5ULL;
+static const uint64_t kC2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t Rotl(const uint64_t x, const unsigned int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+}  // namespace
+
+bool Fingerprint::operator==(const Fingerprint& other) const {
+  return lo == other.lo && hi == other.hi;
+}
+
+bool Fingerprint::operator!=(const Fingerprint& other) const {
+  return !(*this == other);
+}
+
+std::size_t FingerprintHash::operator() (const Fingerprint& fingerprint)
+    const {
+  // The bits are already well mixed.
+  return fingerprint.lo;
+}
+
+FingerprintBuilder::FingerprintBuilder()
+  : h1_(0x6a09e667f3bcc908ULL), h2_(0xbb67ae8584caa73bULL) {}
+
+void FingerprintBuilder::Mix(uint64_t word) {
+  // Each word goes into both halves with different constants so that the two
+  // halves are independent of each other.
+  uint64_t k1 = word * kC1;
+  k1 = Rotl(k1, 31) * kC2;
+  h1_ ^= k1;
+  h1_ = (Rotl(h1_, 27) + h2_) * 5 + 0x52dce729;
+
+  uint64_t k2 = word * kC2;
+  k2 = Rotl(k2, 33) * kC1;
+  h2_ ^= k2;
+  h2_ = (Rotl(h2_, 31) + h1_) * 5 + 0x38495ab5;
+}
+
+void FingerprintBuilder::Update(const void* data, std::size_t len) {
+  const unsigned char* bytes = (const unsigned char*) data;
+  length_ += len;
+  std::size_t i = 0;
+  // Top up whatever is left from last time, then go a word at a time.
+  while (tail_len_ != 0 && i < len) {
+    tail_ |= ((uint64_t) bytes[i++]) << (8 * tail_len_);
+    if (++tail_len_ == sizeof(uint64_t)) {
+      Mix(tail_);
+      tail_ = 0;
+      tail_len_ = 0;
+    }
+  }
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    Mix(word);
+  }
+  for (; i < len; ++i) {
+    tail_ |= ((uint64_t) bytes[i]) << (8 * tail_len_);
+    if (++tail_len_ == sizeof(uint64_t)) {
+      Mix(tail_);
+      tail_ = 0;
+      tail_len_ = 0;
+    }
+  }
+}
+
+void FingerprintBuilder::Update(const std::string& str) {
+  // Include the length so that the boundaries between strings matter.
+  const uint64_t len = str.size();
+  Update(&len, sizeof(len));
+  Update(str.data(), str.size());
+}
+
+Fingerprint FingerprintBuilder::Digest() const {
+  uint64_t h1 = h1_;
+  uint64_t h2 = h2_;
+  h1 ^= Fmix(tail_ * kC1);
+  h2 ^= Fmix(tail_ * kC2);
+  h1 ^= length_;
+  h2 ^= length_;
+  h1 += h2;
+  h2 += h1;
+  h1 = Fmix(h1);
+  h2 = Fmix(h2);
+  h1 += h2;
+  h2 += h1;
+
+  Fingerprint res;
+  res.lo = h1;
+  res.hi = h2;
+  return res;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
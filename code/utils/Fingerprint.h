@@ -0,0 +1,49 @@
+#ifndef UTILS_FINGERPRINT_H
+#define UTILS_FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace fs_testing {
+namespace utils {
+
+// 128-bit hash of some data. Not cryptographic, but wide enough that
+// collisions between the things we fingerprint can be ignored.
+struct Fingerprint {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+
+  bool operator==(const Fingerprint& other) const;
+  bool operator!=(const Fingerprint& other) const;
+};
+
+struct FingerprintHash {
+  std::size_t operator() (const Fingerprint& fingerprint) const;
+};
+
+// Builds a Fingerprint out of data handed to it a piece at a time. Handing the
+// same bytes over in different sized pieces gives the same Fingerprint.
+class FingerprintBuilder {
+ public:
+  FingerprintBuilder();
+  void Update(const void* data, std::size_t len);
+  void Update(const std::string& str);
+  Fingerprint Digest() const;
+
+ private:
+  void Mix(uint64_t word);
+
+  uint64_t h1_;
+  uint64_t h2_;
+  uint64_t length_ = 0;
+  // Bytes waiting for a full word to mix.
+  uint64_t tail_ = 0;
+  unsigned int tail_len_ = 0;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_FINGERPRINT_H
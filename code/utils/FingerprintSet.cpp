@@ -0,0 +1,114 @@
+#include "FingerprintSet.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::size_t;
+using std::vector;
+
+namespace {
+
+static const size_t kInitialSlots = 1024;
+
+}  // namespace
+
+FingerprintSet::FingerprintSet(const unsigned int bloom_bits)
+  : bloom_bits_(bloom_bits) {
+  Resize(kInitialSlots);
+}
+
+Fingerprint FingerprintSet::Normalize(Fingerprint fingerprint) {
+  if (IsEmpty(fingerprint)) {
+    fingerprint.lo = 1;
+  }
+  return fingerprint;
+}
+
+bool FingerprintSet::IsEmpty(const Fingerprint& slot) {
+  return slot.lo == 0 && slot.hi == 0;
+}
+
+uint64_t FingerprintSet::BloomMask(const Fingerprint& fingerprint) {
+  // The table only uses the low bits of lo, so take the bits to set from hi.
+  uint64_t mask = 0;
+  for (unsigned int i = 0; i < kBloomHashes; ++i) {
+    mask |= 1ULL << ((fingerprint.hi >> (6 * i)) & 63);
+  }
+  return mask;
+}
+
+size_t FingerprintSet::BloomWord(const Fingerprint& fingerprint) const {
+  // Map the top half of hi onto [0, bloom_.size()) without a divide.
+  return ((fingerprint.hi >> 32) * bloom_.size()) >> 32;
+}
+
+size_t FingerprintSet::Find(const Fingerprint& fingerprint) const {
+  const size_t mask = slots_.size() - 1;
+  size_t i = fingerprint.lo & mask;
+  while (!IsEmpty(slots_[i]) && slots_[i] != fingerprint) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+bool FingerprintSet::Insert(Fingerprint fingerprint) {
+  fingerprint = Normalize(fingerprint);
+  const size_t i = Find(fingerprint);
+  if (!IsEmpty(slots_[i])) {
+    return false;
+  }
+  slots_[i] = fingerprint;
+  ++size_;
+  if (!bloom_.empty()) {
+    bloom_[BloomWord(fingerprint)] |= BloomMask(fingerprint);
+  }
+  if (size_ * 4 > slots_.size() * 3) {
+    Resize(slots_.size() * 2);
+  }
+  return true;
+}
+
+bool FingerprintSet::Contains(Fingerprint fingerprint) const {
+  fingerprint = Normalize(fingerprint);
+  if (!bloom_.empty()) {
+    const uint64_t mask = BloomMask(fingerprint);
+    if ((bloom_[BloomWord(fingerprint)] & mask) != mask) {
+      return false;
+    }
+  }
+  return !IsEmpty(slots_[Find(fingerprint)]);
+}
+
+void FingerprintSet::Clear() {
+  size_ = 0;
+  vector<Fingerprint>().swap(slots_);
+  Resize(kInitialSlots);
+}
+
+size_t FingerprintSet::Size() const {
+  return size_;
+}
+
+size_t FingerprintSet::MemoryUsage() const {
+  return slots_.size() * sizeof(Fingerprint) + bloom_.size() * sizeof(uint64_t);
+}
+
+void FingerprintSet::Resize(const size_t num_slots) {
+  vector<Fingerprint> old(num_slots);
+  old.swap(slots_);
+  if (bloom_bits_ > 0) {
+    bloom_.assign((num_slots * bloom_bits_ + 63) / 64, 0);
+  }
+  for (const Fingerprint& fingerprint : old) {
+    if (IsEmpty(fingerprint)) {
+      continue;
+    }
+    slots_[Find(fingerprint)] = fingerprint;
+    if (!bloom_.empty()) {
+      bloom_[BloomWord(fingerprint)] |= BloomMask(fingerprint);
+    }
+  }
+}
+
+}  // namespace utils
+}  // namespace fs_testing
@@ -0,0 +1,62 @@
+#ifndef UTILS_FINGERPRINT_SET_H
+#define UTILS_FINGERPRINT_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Fingerprint.h"
+
+namespace fs_testing {
+namespace utils {
+
+// Set of Fingerprints kept in a single open addressing table with linear
+// probing. A slot is just the 16 byte Fingerprint, all zeros if the slot is
+// empty, so nothing is allocated per entry. The table doubles when it is 3/4
+// full, so it takes 21 to 43 bytes per entry.
+//
+// Things stored by fingerprint are only told apart by it. For n entries the
+// chance that any two different things share a fingerprint is about
+// n^2 / 2^129, under 10^-20 for a billion entries.
+//
+// Optionally, a Bloom filter in front of the table answers most lookups of
+// fingerprints that aren't in the set with a single cache line. Each lookup
+// sets or tests kBloomHashes bits of one 64 bit word.
+// *** This is not a thread-safe class. ***
+class FingerprintSet {
+ public:
+  // bloom_bits is the number of filter bits to keep per slot of the table, or 0
+  // for no filter.
+  explicit FingerprintSet(const unsigned int bloom_bits = 0);
+
+  // Returns false if fingerprint was already in the set.
+  bool Insert(Fingerprint fingerprint);
+  bool Contains(Fingerprint fingerprint) const;
+  void Clear();
+
+  std::size_t Size() const;
+  // Bytes taken by the table and the filter.
+  std::size_t MemoryUsage() const;
+
+  static const unsigned int kBloomHashes = 4;
+
+ private:
+  // The all zero Fingerprint marks an empty slot, so move it somewhere else.
+  static Fingerprint Normalize(Fingerprint fingerprint);
+  static bool IsEmpty(const Fingerprint& slot);
+  static uint64_t BloomMask(const Fingerprint& fingerprint);
+  std::size_t BloomWord(const Fingerprint& fingerprint) const;
+  // Slot fingerprint is in or the empty slot it would go in.
+  std::size_t Find(const Fingerprint& fingerprint) const;
+  void Resize(const std::size_t num_slots);
+
+  std::vector<Fingerprint> slots_;
+  std::vector<uint64_t> bloom_;
+  std::size_t size_ = 0;
+  const unsigned int bloom_bits_;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_FINGERPRINT_SET_H
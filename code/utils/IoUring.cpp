@@ -0,0 +1,209 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "IoUring.h"
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace fs_testing {
+namespace utils {
+
+using std::memset;
+
+IoUring::~IoUring() {
+  Teardown();
+}
+
+bool IoUring::IsOpen() const {
+  return ring_fd_ >= 0;
+}
+
+unsigned int IoUring::Entries() const {
+  return entries_;
+}
+
+unsigned int IoUring::Space() const {
+  return entries_ - queued_;
+}
+
+void IoUring::Teardown() {
+  if (sqes_ != NULL) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != NULL && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != NULL) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+  ring_fd_ = -1;
+  sq_ring_ = NULL;
+  cq_ring_ = NULL;
+  sqes_ = NULL;
+  entries_ = 0;
+  queued_ = 0;
+}
+
+#ifdef HAVE_IO_URING
+
+bool IoUring::Init(unsigned int entries, void* buf, size_t len) {
+  Teardown();
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd_ < 0) {
+    ring_fd_ = -1;
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  cq_ring_size_ =
+    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_ring_size_ > sq_ring_size_) {
+      sq_ring_size_ = cq_ring_size_;
+    }
+    cq_ring_size_ = sq_ring_size_;
+  }
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = NULL;
+    Teardown();
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = NULL;
+      Teardown();
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = NULL;
+    Teardown();
+    return false;
+  }
+
+  char* sq = (char*) sq_ring_;
+  char* cq = (char*) cq_ring_;
+  sq_head_ = (unsigned int*) (sq + params.sq_off.head);
+  sq_tail_ = (unsigned int*) (sq + params.sq_off.tail);
+  sq_mask_ = (unsigned int*) (sq + params.sq_off.ring_mask);
+  sq_array_ = (unsigned int*) (sq + params.sq_off.array);
+  cq_head_ = (unsigned int*) (cq + params.cq_off.head);
+  cq_tail_ = (unsigned int*) (cq + params.cq_off.tail);
+  cq_mask_ = (unsigned int*) (cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  entries_ = params.sq_entries;
+
+  struct iovec registered = {buf, len};
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+        &registered, 1) < 0) {
+    Teardown();
+    return false;
+  }
+  return true;
+}
+
+bool IoUring::QueueWrite(const int fd, const char* data,
+    const unsigned int len, const unsigned long int offset, const bool link) {
+  if (queued_ == entries_) {
+    return false;
+  }
+  // We are the only one who moves the tail, so it doesn't need an atomic load.
+  const unsigned int tail = *sq_tail_;
+  const unsigned int index = tail & *sq_mask_;
+  struct io_uring_sqe* sqe = ((struct io_uring_sqe*) sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->flags = link ? IOSQE_IO_LINK : 0;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long) data;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->buf_index = 0;
+  // Remember how much should be written so short writes can be caught.
+  sqe->user_data = len;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  ++queued_;
+  return true;
+}
+
+long int IoUring::SubmitAndWait(unsigned long int* syscalls) {
+  unsigned int to_submit = queued_;
+  unsigned int to_complete = queued_;
+  long int bytes = 0;
+  bool failed = false;
+  while (to_complete > 0) {
+    const int res = syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+        to_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+      // Nothing we can do about whatever is still in flight, so tear the ring
+      // down to make sure none of it completes later.
+      Teardown();
+      return -1;
+    }
+    ++*syscalls;
+    to_submit -= res;
+
+    unsigned int head = *cq_head_;
+    const unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const struct io_uring_cqe* cqe =
+        ((struct io_uring_cqe*) cqes_) + (head & *cq_mask_);
+      if (cqe->res < 0 || (unsigned long) cqe->res != cqe->user_data) {
+        failed = true;
+      } else {
+        bytes += cqe->res;
+      }
+      ++head;
+      --to_complete;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  queued_ = 0;
+  return failed ? -1 : bytes;
+}
+
+#else
+
+bool IoUring::Init(unsigned int, void*, size_t) {
+  return false;
+}
+
+bool IoUring::QueueWrite(const int, const char*, const unsigned int,
+    const unsigned long int, const bool) {
+  return false;
+}
+
+long int IoUring::SubmitAndWait(unsigned long int*) {
+  return -1;
+}
+
+#endif  // HAVE_IO_URING
+
+}  // namespace utils
+}  // namespace fs_testing
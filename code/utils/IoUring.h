@@ -0,0 +1,71 @@
+#ifndef UTILS_IO_URING_H
+#define UTILS_IO_URING_H
+
+#include <cstddef>
+
+// io_uring only exists on kernels newer than the ones CrashMonkey usually runs
+// on. Without the headers Init always fails and callers should fall back to
+// regular system calls.
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+namespace fs_testing {
+namespace utils {
+
+// Bare bones io_uring that only knows how to write from a single registered
+// buffer. Talks to the kernel directly so that we don't depend on liburing.
+// *** This is not a thread-safe class. ***
+class IoUring {
+ public:
+  ~IoUring();
+  // Set up a ring with room for the given number of writes and register buf
+  // as its only fixed buffer. Returns false if the kernel doesn't support
+  // io_uring or the ring could not be made.
+  bool Init(unsigned int entries, void* buf, size_t len);
+  // False until Init succeeds, and again once SubmitAndWait has torn the ring
+  // down after io_uring_enter failed.
+  bool IsOpen() const;
+  unsigned int Entries() const;
+  // Number of writes that can be queued before they must be submitted.
+  unsigned int Space() const;
+  // Queue a write of len bytes from the registered buffer at data to offset in
+  // fd. If link is set, the next write queued won't start until this one is
+  // done. Returns false if the ring is full.
+  bool QueueWrite(const int fd, const char* data, const unsigned int len,
+      const unsigned long int offset, const bool link);
+  // Submit everything queued and wait for all of it to complete. Returns the
+  // number of bytes written or -1 if any write failed or was short. The number
+  // of io_uring_enter calls made is added to syscalls.
+  long int SubmitAndWait(unsigned long int* syscalls);
+
+ private:
+  void Teardown();
+
+  int ring_fd_ = -1;
+  unsigned int entries_ = 0;
+  unsigned int queued_ = 0;
+
+  void* sq_ring_ = NULL;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = NULL;
+  size_t cq_ring_size_ = 0;
+  void* sqes_ = NULL;
+  size_t sqes_size_ = 0;
+
+  unsigned int* sq_head_ = NULL;
+  unsigned int* sq_tail_ = NULL;
+  unsigned int* sq_mask_ = NULL;
+  unsigned int* sq_array_ = NULL;
+  unsigned int* cq_head_ = NULL;
+  unsigned int* cq_tail_ = NULL;
+  unsigned int* cq_mask_ = NULL;
+  void* cqes_ = NULL;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_IO_URING_H
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <cstring>
+
+#include "LatencyHistogram.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::chrono::nanoseconds;
+using std::memset;
+using std::ostream;
+
+LatencyHistogram::LatencyHistogram() {
+  memset(counts_, 0, sizeof(counts_));
+}
+
+unsigned int LatencyHistogram::BucketFor(const uint64_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+  // Index of the highest set bit picks the power of two, the bits below it
+  // pick the bucket within it.
+  const unsigned int exponent = 63 - __builtin_clzll(value);
+  const unsigned int shift = exponent - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t LatencyHistogram::BucketLow(const unsigned int bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  const unsigned int shift = bucket / kSubBuckets - 1;
+  return ((uint64_t) (kSubBuckets + bucket % kSubBuckets)) << shift;
+}
+
+uint64_t LatencyHistogram::BucketHigh(const unsigned int bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  const unsigned int shift = bucket / kSubBuckets - 1;
+  return BucketLow(bucket) + ((((uint64_t) 1) << shift) - 1);
+}
+
+void LatencyHistogram::Record(const nanoseconds latency) {
+  const uint64_t value = (latency.count() < 0) ? 0 : latency.count();
+  ++counts_[BucketFor(value)];
+  ++count_;
+  total_ += value;
+  if (value < min_) {
+    min_ = value;
+  }
+  if (value > max_) {
+    max_ = value;
+  }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (unsigned int i = 0; i < kNumBuckets; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  total_ += other.total_;
+  if (other.min_ < min_) {
+    min_ = other.min_;
+  }
+  if (other.max_ > max_) {
+    max_ = other.max_;
+  }
+}
+
+uint64_t LatencyHistogram::Count() const {
+  return count_;
+}
+
+nanoseconds LatencyHistogram::Total() const {
+  return nanoseconds(total_);
+}
+
+nanoseconds LatencyHistogram::Min() const {
+  return nanoseconds((count_ == 0) ? 0 : min_);
+}
+
+nanoseconds LatencyHistogram::Max() const {
+  return nanoseconds(max_);
+}
+
+nanoseconds LatencyHistogram::Percentile(const double percentile) const {
+  if (count_ == 0) {
+    return nanoseconds(0);
+  }
+  uint64_t rank = std::ceil(percentile / 100.0 * count_);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < kNumBuckets; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      uint64_t res = BucketHigh(i);
+      if (res > max_) {
+        res = max_;
+      }
+      if (res < min_) {
+        res = min_;
+      }
+      return nanoseconds(res);
+    }
+  }
+  return nanoseconds(max_);
+}
+
+void LatencyHistogram::PrintJson(ostream& os) const {
+  os << "{\"count\": " << count_
+    << ", \"total_ns\": " << total_
+    << ", \"min_ns\": " << Min().count()
+    << ", \"p50_ns\": " << Percentile(50).count()
+    << ", \"p90_ns\": " << Percentile(90).count()
+    << ", \"p99_ns\": " << Percentile(99).count()
+    << ", \"max_ns\": " << max_
+    << ", \"buckets\": [";
+  bool first = true;
+  for (unsigned int i = 0; i < kNumBuckets; ++i) {
+    if (counts_[i] == 0) {
+      continue;
+    }
+    if (!first) {
+      os << ", ";
+    }
+    first = false;
+    os << "[" << BucketLow(i) << ", " << BucketHigh(i) << ", " << counts_[i]
+      << "]";
+  }
+  os << "]}";
+}
+
+}  // namespace utils
+}  // namespace fs_testing
@@ -0,0 +1,51 @@
+#ifndef UTILS_LATENCY_HISTOGRAM_H
+#define UTILS_LATENCY_HISTOGRAM_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace fs_testing {
+namespace utils {
+
+// HDR style histogram of latencies in nanoseconds. Values below 32ns get a
+// bucket each and every power of two above that is split into 32 buckets, so
+// percentiles are within about 3% of the real value no matter the scale.
+// *** This is not a thread-safe class. ***
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  void Record(const std::chrono::nanoseconds latency);
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t Count() const;
+  std::chrono::nanoseconds Total() const;
+  std::chrono::nanoseconds Min() const;
+  std::chrono::nanoseconds Max() const;
+  // Smallest recorded latency that percentile percent of latencies are at or
+  // below, rounded up to the end of its bucket.
+  std::chrono::nanoseconds Percentile(const double percentile) const;
+
+  // Write the summary and all non-empty buckets as a JSON object.
+  void PrintJson(std::ostream& os) const;
+
+ private:
+  static const unsigned int kSubBucketBits = 5;
+  static const unsigned int kSubBuckets = 1 << kSubBucketBits;
+  static const unsigned int kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  static unsigned int BucketFor(const uint64_t value);
+  static uint64_t BucketLow(const unsigned int bucket);
+  static uint64_t BucketHigh(const unsigned int bucket);
+
+  uint64_t counts_[kNumBuckets];
+  uint64_t count_ = 0;
+  uint64_t total_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_LATENCY_HISTOGRAM_H
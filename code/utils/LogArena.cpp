@@ -0,0 +1,110 @@
+#include <sys/mman.h>
+
+#include <cstring>
+
+#include "LogArena.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::lock_guard;
+using std::mutex;
+using std::size_t;
+
+namespace {
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t RoundUp(const size_t value, const size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+}  // namespace
+
+LogArena::~LogArena() {
+  for (const slab& s : slabs_) {
+    munmap(s.base, s.size);
+  }
+}
+
+LogArena& LogArena::Default() {
+  static LogArena arena;
+  return arena;
+}
+
+char* LogArena::MapSlab(const size_t size) {
+  // Reserved huge pages are used if there are any, otherwise ask for
+  // transparent huge pages.
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base == MAP_FAILED) {
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+    madvise(base, size, MADV_HUGEPAGE);
+  }
+  return (char*) base;
+}
+
+char* LogArena::Allocate(const size_t size) {
+  if (size == 0) {
+    return NULL;
+  }
+  const size_t len = RoundUp(size, kAlignment);
+  lock_guard<mutex> guard(lock_);
+  if (len > kSlabSize / 4) {
+    // Big data gets a slab to itself so it doesn't strand the rest of the
+    // current one.
+    const size_t slab_size = RoundUp(len, kHugePageSize);
+    char* base = MapSlab(slab_size);
+    if (base == NULL) {
+      return NULL;
+    }
+    slabs_.push_back({base, slab_size, len});
+    bytes_used_ += len;
+    return base;
+  }
+  if (slabs_.empty()
+      || slabs_.at(current_).used + len > slabs_.at(current_).size) {
+    char* base = MapSlab(kSlabSize);
+    if (base == NULL) {
+      return NULL;
+    }
+    slabs_.push_back({base, kSlabSize, 0});
+    current_ = slabs_.size() - 1;
+  }
+  slab& s = slabs_.at(current_);
+  char* res = s.base + s.used;
+  s.used += len;
+  bytes_used_ += len;
+  return res;
+}
+
+char* LogArena::Copy(const char* data, const size_t size) {
+  char* res = Allocate(size);
+  if (res != NULL) {
+    std::memcpy(res, data, size);
+  }
+  return res;
+}
+
+void LogArena::Adopt(void* base, const size_t size) {
+  lock_guard<mutex> guard(lock_);
+  slabs_.push_back({(char*) base, size, size});
+  bytes_used_ += size;
+}
+
+size_t LogArena::NumSlabs() const {
+  lock_guard<mutex> guard(lock_);
+  return slabs_.size();
+}
+
+size_t LogArena::BytesUsed() const {
+  lock_guard<mutex> guard(lock_);
+  return bytes_used_;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
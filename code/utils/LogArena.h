@@ -0,0 +1,56 @@
+#ifndef UTILS_LOG_ARENA_H
+#define UTILS_LOG_ARENA_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace fs_testing {
+namespace utils {
+
+// Holds the data of every disk_write. Data is carved out of large slabs that
+// are backed by huge pages when the system has them and is only freed when the
+// arena is, so disk_writes can point at it without owning it.
+class LogArena {
+ public:
+  LogArena() = default;
+  LogArena(const LogArena&) = delete;
+  LogArena& operator=(const LogArena&) = delete;
+  ~LogArena();
+
+  // Arena disk_writes in this process keep their data in. Lives until exit.
+  static LogArena& Default();
+
+  // size bytes aligned to kAlignment, or NULL if size is 0 or memory ran out.
+  char* Allocate(const std::size_t size);
+  // Copy of the size bytes at data, or NULL as for Allocate.
+  char* Copy(const char* data, const std::size_t size);
+  // Take a mapping made with mmap as a slab, unmapping it with the arena.
+  void Adopt(void* base, const std::size_t size);
+
+  std::size_t NumSlabs() const;
+  std::size_t BytesUsed() const;
+
+  static const std::size_t kAlignment = 512;
+  static const std::size_t kSlabSize = 64 * 1024 * 1024;
+
+ private:
+  struct slab {
+    char* base;
+    std::size_t size;
+    std::size_t used;
+  };
+
+  static char* MapSlab(const std::size_t size);
+
+  mutable std::mutex lock_;
+  std::vector<slab> slabs_;
+  // Index of the slab small allocations come from.
+  std::size_t current_ = 0;
+  std::size_t bytes_used_ = 0;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_LOG_ARENA_H
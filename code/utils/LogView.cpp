@@ -0,0 +1,33 @@
+#include "LogView.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::vector;
+
+uint8_t LogView::Decode(disk_write& dw) {
+  return (dw.has_write_flag() ? kWrite : 0)
+    | (dw.is_barrier_write() ? kBarrier : 0)
+    | (dw.is_meta() ? kMeta : 0)
+    | (dw.has_flush_flag() ? kFlush : 0)
+    | (dw.has_flush_seq_flag() ? kFlushSeq : 0)
+    | (dw.has_FUA_flag() ? kFUA : 0)
+    | (dw.is_async_write() ? kAsync : 0);
+}
+
+void LogView::Build(vector<disk_write>& log) {
+  sectors_.resize(log.size());
+  sizes_.resize(log.size());
+  flags_.resize(log.size());
+  data_.resize(log.size());
+  for (std::size_t i = 0; i < log.size(); ++i) {
+    disk_write& dw = log[i];
+    sectors_[i] = dw.metadata.write_sector;
+    sizes_[i] = dw.metadata.size;
+    flags_[i] = Decode(dw);
+    data_[i] = dw.get_data();
+  }
+}
+
+}  // namespace utils
+}  // namespace fs_testing
@@ -0,0 +1,97 @@
+#ifndef UTILS_LOG_VIEW_H
+#define UTILS_LOG_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+namespace fs_testing {
+namespace utils {
+
+// Columnar copy of a log, one array per field, with the bio flags the harness
+// cares about decoded once into a byte per bio. Meant for loops over the whole
+// log that would otherwise test kernel flags through utils_c on every bio.
+class LogView {
+ public:
+  enum flag : uint8_t {
+    kWrite = 1 << 0,
+    kBarrier = 1 << 1,
+    kMeta = 1 << 2,
+    kFlush = 1 << 3,
+    kFlushSeq = 1 << 4,
+    kFUA = 1 << 5,
+    kAsync = 1 << 6,
+  };
+
+  // Crash states name their bios by log entry: the index of the bio in the
+  // log, or'd with one of these if it is only half of a flush with data.
+  enum entry_half : unsigned int {
+    // Just the flush flags of the bio.
+    kFlushHalf = 1u << 31,
+    // The data of the bio without its flush flags.
+    kDataHalf = 1u << 30,
+  };
+
+  static std::size_t Index(const unsigned int entry);
+
+  // Flag byte for a single bio.
+  static uint8_t Decode(disk_write& dw);
+
+  void Build(std::vector<disk_write>& log);
+
+  std::size_t Size() const;
+  unsigned long int Sector(const std::size_t i) const;
+  // Size of the bio in bytes.
+  unsigned int Bytes(const std::size_t i) const;
+  uint8_t Flags(const std::size_t i) const;
+  bool Is(const std::size_t i, const flag f) const;
+  const char* Data(const std::size_t i) const;
+  // True if entry puts data on the disk.
+  bool Writes(const unsigned int entry) const;
+
+ private:
+  std::vector<unsigned long int> sectors_;
+  std::vector<unsigned int> sizes_;
+  std::vector<uint8_t> flags_;
+  std::vector<const char*> data_;
+};
+
+inline std::size_t LogView::Index(const unsigned int entry) {
+  return entry & (kDataHalf - 1);
+}
+
+inline std::size_t LogView::Size() const {
+  return flags_.size();
+}
+
+inline unsigned long int LogView::Sector(const std::size_t i) const {
+  return sectors_[i];
+}
+
+inline unsigned int LogView::Bytes(const std::size_t i) const {
+  return sizes_[i];
+}
+
+inline uint8_t LogView::Flags(const std::size_t i) const {
+  return flags_[i];
+}
+
+inline bool LogView::Is(const std::size_t i, const flag f) const {
+  return (flags_[i] & f) != 0;
+}
+
+inline const char* LogView::Data(const std::size_t i) const {
+  return data_[i];
+}
+
+inline bool LogView::Writes(const unsigned int entry) const {
+  const std::size_t i = Index(entry);
+  return !(entry & kFlushHalf) && Is(i, kWrite) && sizes_[i] > 0;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_LOG_VIEW_H
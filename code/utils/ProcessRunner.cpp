@@ -0,0 +1,188 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ProcessRunner.h"
+
+extern char **environ;
+
+namespace fs_testing {
+namespace utils {
+
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+namespace {
+
+static const unsigned int kReadSize = 4096;
+
+// Write as much of the remaining input as the pipe will take. SIGPIPE is
+// blocked while writing so that a child which exits without reading all its
+// input doesn't take the harness down with it.
+int WriteInput(const int fd, const string& input, unsigned int* written) {
+  sigset_t pipe_set;
+  sigset_t old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+  const int res = write(fd, input.data() + *written, input.size() - *written);
+  if (res < 0 && errno == EPIPE) {
+    // Eat the SIGPIPE we just generated before unblocking it again.
+    const struct timespec no_wait = {0, 0};
+    sigtimedwait(&pipe_set, NULL, &no_wait);
+  } else if (res > 0) {
+    *written += res;
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  return res;
+}
+
+}  // namespace
+
+ProcessRunner::ProcessRunner(unsigned int max_output)
+  : max_output_(max_output) {}
+
+int ProcessRunner::Run(const vector<string>& args, const string& input,
+    ProcessResult* result) const {
+  result->status = -1;
+  result->wall_time = microseconds(0);
+  memset(&result->usage, 0, sizeof(result->usage));
+  result->output.clear();
+  result->output_truncated = false;
+  if (args.empty()) {
+    return -1;
+  }
+
+  vector<char*> argv;
+  for (const string& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(NULL);
+
+  // Pipes are close-on-exec so that children spawned by other threads don't
+  // hold on to them. posix_spawn clears the flag on the copies it dup2s.
+  int out_pipe[2];
+  int in_pipe[2];
+  if (pipe2(out_pipe, O_CLOEXEC) < 0) {
+    return -1;
+  }
+  if (pipe2(in_pipe, O_CLOEXEC) < 0) {
+    close(out_pipe[0]);
+    close(out_pipe[1]);
+    return -1;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDERR_FILENO);
+
+  time_point<steady_clock> start_time = steady_clock::now();
+  pid_t child;
+  const int spawn_res = posix_spawnp(&child, argv.at(0), &actions, NULL,
+      argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(in_pipe[0]);
+  close(out_pipe[1]);
+  if (spawn_res != 0) {
+    close(in_pipe[1]);
+    close(out_pipe[0]);
+    return -1;
+  }
+
+  // Feed the child its input and drain its output at the same time so that
+  // neither side blocks on a full pipe.
+  unsigned int input_written = 0;
+  int in_fd = in_pipe[1];
+  if (input.empty()) {
+    close(in_fd);
+    in_fd = -1;
+  } else {
+    fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+  }
+  char buf[kReadSize];
+  int out_fd = out_pipe[0];
+  while (out_fd >= 0) {
+    struct pollfd fds[2];
+    unsigned int num_fds = 0;
+    fds[num_fds].fd = out_fd;
+    fds[num_fds].events = POLLIN;
+    ++num_fds;
+    if (in_fd >= 0) {
+      fds[num_fds].fd = in_fd;
+      fds[num_fds].events = POLLOUT;
+      ++num_fds;
+    }
+    if (poll(fds, num_fds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Stop reading, so a child blocked on a full pipe gets EPIPE instead of
+      // waiting forever for us while we wait for it to exit.
+      close(out_fd);
+      out_fd = -1;
+      break;
+    }
+
+    if (in_fd >= 0 && fds[1].revents) {
+      const int res = (fds[1].revents & POLLOUT)
+        ? WriteInput(in_fd, input, &input_written)
+        : -1;
+      if ((res < 0 && errno != EAGAIN) || input_written == input.size()) {
+        close(in_fd);
+        in_fd = -1;
+      }
+    }
+
+    if (fds[0].revents) {
+      const int res = read(out_fd, buf, kReadSize);
+      if (res < 0 && errno == EINTR) {
+        continue;
+      } else if (res <= 0) {
+        close(out_fd);
+        out_fd = -1;
+        break;
+      }
+      const unsigned int bytes_read = res;
+      const unsigned int space = max_output_ - result->output.size();
+      if (bytes_read > space) {
+        result->output_truncated = true;
+      }
+      result->output.append(buf, (bytes_read > space) ? space : bytes_read);
+    }
+  }
+  if (in_fd >= 0) {
+    close(in_fd);
+  }
+
+  int res;
+  do {
+    res = wait4(child, &result->status, 0, &result->usage);
+  } while (res < 0 && errno == EINTR);
+  time_point<steady_clock> end_time = steady_clock::now();
+  result->wall_time = duration_cast<microseconds>(end_time - start_time);
+  return (res < 0) ? -1 : 0;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
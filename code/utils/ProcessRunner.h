@@ -0,0 +1,45 @@
+#ifndef UTILS_PROCESS_RUNNER_H
+#define UTILS_PROCESS_RUNNER_H
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace fs_testing {
+namespace utils {
+
+// Everything we know about a process once it has finished running.
+struct ProcessResult {
+  // Status of the process as returned by wait4.
+  int status;
+  std::chrono::microseconds wall_time;
+  struct rusage usage;
+  // Combined stdout and stderr of the process. Only the first max_output bytes
+  // are kept.
+  std::string output;
+  bool output_truncated;
+};
+
+// Runs programs directly with posix_spawn instead of going through system()
+// and a shell. Output of the child is captured through a pipe instead of being
+// thrown away. Safe to use from multiple threads at once.
+class ProcessRunner {
+ public:
+  ProcessRunner(unsigned int max_output);
+  // Run args[0], searched for in PATH, with the remaining args. If input is not
+  // empty it is fed to the standard input of the process. Returns 0 if the
+  // process was run (regardless of its exit status) or -1 if it could not be
+  // started or waited on.
+  int Run(const std::vector<std::string>& args, const std::string& input,
+      ProcessResult* result) const;
+
+ private:
+  const unsigned int max_output_;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_PROCESS_RUNNER_H
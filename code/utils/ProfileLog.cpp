@@ -0,0 +1,227 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#include "Crc32c.h"
+#include "LogArena.h"
+#include "ProfileLog.h"
+#include "utils_c.h"
+
+namespace fs_testing {
+namespace utils {
+
+using std::ifstream;
+using std::memcmp;
+using std::memcpy;
+using std::memset;
+using std::unique_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+uint64_t Align(const uint64_t offset) {
+  return (offset + kProfileAlignment - 1) & ~(kProfileAlignment - 1);
+}
+
+uint32_t HeaderCrc(ProfileHeader header) {
+  header.header_crc = 0;
+  return Crc32c(&header, sizeof(header));
+}
+
+bool WriteAll(const int fd, const void* data, const size_t len,
+    const off_t offset) {
+  size_t written = 0;
+  while (written < len) {
+    const ssize_t res = pwrite(fd, (const char*) data + written,
+        len - written, offset + written);
+    if (res < 0) {
+      return false;
+    }
+    written += res;
+  }
+  return true;
+}
+
+bool LoadTextProfile(const string& path, vector<disk_write>* log,
+    string* error) {
+  ifstream is(path);
+  while (is.peek() != EOF) {
+    log->push_back(disk_write::deserialize(is));
+  }
+  if (is.fail()) {
+    *error = "unable to parse text profile";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool SaveProfile(const string& path, const string& fs_type,
+    vector<disk_write>& log) {
+  ProfileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kProfileMagic, sizeof(header.magic));
+  header.version = kProfileVersion;
+  header.header_size = sizeof(header);
+  strncpy(header.fs_type, fs_type.c_str(), sizeof(header.fs_type) - 1);
+  unsigned long long flags[C_NUM_FLAGS];
+  c_get_flag_encoding(flags);
+  for (unsigned int i = 0; i < C_NUM_FLAGS; ++i) {
+    header.flag_encoding[i] = flags[i];
+  }
+  header.num_entries = log.size();
+  header.table_offset = sizeof(header);
+
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Data is written as the table is filled in, the gaps left for alignment
+  // stay holes.
+  vector<ProfileEntry> table(log.size());
+  uint64_t end = header.table_offset + table.size() * sizeof(ProfileEntry);
+  for (unsigned int i = 0; i < log.size(); ++i) {
+    disk_write& dw = log.at(i);
+    ProfileEntry& entry = table.at(i);
+    memset(&entry, 0, sizeof(entry));
+    entry.bi_flags = dw.metadata.bi_flags;
+    entry.bi_rw = dw.metadata.bi_rw;
+    entry.write_sector = dw.metadata.write_sector;
+    entry.size = dw.metadata.size;
+    const char* data = dw.get_data();
+    if (data == NULL || entry.size == 0) {
+      continue;
+    }
+    entry.data_offset = Align(end);
+    entry.data_crc = Crc32c(data, entry.size);
+    if (!WriteAll(fd, data, entry.size, entry.data_offset)) {
+      close(fd);
+      return false;
+    }
+    end = entry.data_offset + entry.size;
+  }
+
+  header.file_size = end;
+  header.table_crc = Crc32c(table.data(), table.size() * sizeof(ProfileEntry));
+  header.header_crc = HeaderCrc(header);
+  const bool res =
+    WriteAll(fd, table.data(), table.size() * sizeof(ProfileEntry),
+        header.table_offset)
+    && WriteAll(fd, &header, sizeof(header), 0)
+    && ftruncate(fd, end) == 0;
+  return close(fd) == 0 && res;
+}
+
+bool LoadProfile(const string& path, string* fs_type, vector<disk_write>* log,
+    string* error) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = string("unable to open profile: ") + strerror(errno);
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    close(fd);
+    *error = string("unable to stat profile: ") + strerror(errno);
+    return false;
+  }
+  char magic[sizeof(ProfileHeader::magic)];
+  if (file_stat.st_size < (off_t) sizeof(ProfileHeader)
+      || pread(fd, magic, sizeof(magic), 0) != sizeof(magic)
+      || memcmp(magic, kProfileMagic, sizeof(magic)) != 0) {
+    close(fd);
+    return LoadTextProfile(path, log, error);
+  }
+
+  const size_t file_size = file_stat.st_size;
+  void* mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    *error = string("unable to map profile: ") + strerror(errno);
+    return false;
+  }
+  // The mapping is handed to the LogArena once the whole profile checks out.
+  auto unmap = [file_size](char* m) { munmap(m, file_size); };
+  unique_ptr<char, decltype(unmap)> base((char*) mapping, unmap);
+
+  ProfileHeader header;
+  memcpy(&header, base.get(), sizeof(header));
+  if (header.version != kProfileVersion
+      || header.header_size != sizeof(header)) {
+    *error = "unsupported profile version " + std::to_string(header.version);
+    return false;
+  }
+  if (header.header_crc != HeaderCrc(header)) {
+    *error = "profile header is corrupted";
+    return false;
+  }
+  if (header.file_size != file_size
+      || header.table_offset > file_size
+      || header.num_entries
+        > (file_size - header.table_offset) / sizeof(ProfileEntry)) {
+    *error = "profile is truncated";
+    return false;
+  }
+  unsigned long long flags[C_NUM_FLAGS];
+  c_get_flag_encoding(flags);
+  for (unsigned int i = 0; i < C_NUM_FLAGS; ++i) {
+    if (header.flag_encoding[i] != flags[i]) {
+      *error = "profile was recorded on a kernel with different bio flags";
+      return false;
+    }
+  }
+
+  const ProfileEntry* table =
+    (const ProfileEntry*) (base.get() + header.table_offset);
+  if (Crc32c(table, header.num_entries * sizeof(ProfileEntry))
+      != header.table_crc) {
+    *error = "profile entry table is corrupted";
+    return false;
+  }
+
+  vector<disk_write> loaded;
+  loaded.reserve(header.num_entries);
+  for (uint64_t i = 0; i < header.num_entries; ++i) {
+    const ProfileEntry& entry = table[i];
+    disk_write_op_meta meta;
+    meta.bi_flags = entry.bi_flags;
+    meta.bi_rw = entry.bi_rw;
+    meta.write_sector = entry.write_sector;
+    meta.size = entry.size;
+    loaded.emplace_back();
+    loaded.back().metadata = meta;
+    if (entry.data_offset == 0 || entry.size == 0) {
+      continue;
+    }
+    if (entry.data_offset > file_size
+        || entry.size > file_size - entry.data_offset) {
+      *error = "profile is truncated";
+      return false;
+    }
+    char* data = base.get() + entry.data_offset;
+    if (Crc32c(data, entry.size) != entry.data_crc) {
+      *error = "data of bio " + std::to_string(i) + " in profile is corrupted";
+      return false;
+    }
+    loaded.back().assign_data(data);
+  }
+
+  header.fs_type[sizeof(header.fs_type) - 1] = '\0';
+  *fs_type = header.fs_type;
+  log->insert(log->end(), loaded.begin(), loaded.end());
+  LogArena::Default().Adopt(base.release(), file_size);
+  return true;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
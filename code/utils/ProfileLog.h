@@ -0,0 +1,67 @@
+#ifndef UTILS_PROFILE_LOG_H
+#define UTILS_PROFILE_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+namespace fs_testing {
+namespace utils {
+
+// Layout of a binary profile:
+//
+// * a ProfileHeader
+// * a table of num_entries ProfileEntry, one per bio in log order
+// * the data of each bio, each starting on a kProfileAlignment boundary
+//
+// Every part is covered by a CRC32C so a damaged profile is caught on load
+// instead of replaying garbage. Fields are in host byte order, profiles are not
+// meant to move between machines of different endianness.
+struct ProfileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  // File system the profile was recorded on, NUL padded.
+  char fs_type[32];
+  // Values of the bio flags bi_rw was recorded with, see c_get_flag_encoding.
+  uint64_t flag_encoding[8];
+  uint64_t num_entries;
+  uint64_t table_offset;
+  uint64_t file_size;
+  uint32_t table_crc;
+  // CRC of the header with this field set to 0.
+  uint32_t header_crc;
+};
+
+struct ProfileEntry {
+  uint64_t bi_flags;
+  uint64_t bi_rw;
+  uint64_t write_sector;
+  // Offset of the data in the file, 0 if the bio carried no data.
+  uint64_t data_offset;
+  uint32_t size;
+  uint32_t data_crc;
+};
+
+static const char kProfileMagic[] = "CMPROFIL";
+static const uint32_t kProfileVersion = 1;
+static const uint64_t kProfileAlignment = 4096;
+
+// Write log to a binary profile at path.
+bool SaveProfile(const std::string& path, const std::string& fs_type,
+    std::vector<disk_write>& log);
+
+// Append the bios in the profile at path to log. Binary profiles are mapped
+// into memory and the data of each disk_write points into the mapping, which
+// becomes a slab of the LogArena. Profiles in the older text
+// format are parsed and copied. fs_type is set to the file system of binary
+// profiles and left alone for text ones. On failure error says why.
+bool LoadProfile(const std::string& path, std::string* fs_type,
+    std::vector<disk_write>* log, std::string* error);
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_PROFILE_LOG_H
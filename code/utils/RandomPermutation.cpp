@@ -0,0 +1,56 @@
+#include "RandomPermutation.h"
+
+namespace fs_testing {
+namespace utils {
+
+namespace {
+
+static const unsigned int kFeistelRounds = 4;
+
+// Finalizer from splitmix64.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+}  // namespace
+
+void RandomPermutation::Init(const uint64_t size, std::mt19937& rand) {
+  size_ = size;
+  const unsigned int bits = (size > 1) ? 64 - __builtin_clzll(size - 1) : 0;
+  half_bits_ = (bits + 1) / 2;
+  keys_.resize(kFeistelRounds);
+  for (uint64_t& key : keys_) {
+    key = ((uint64_t) rand() << 32) | rand();
+  }
+}
+
+uint64_t RandomPermutation::At(uint64_t i) const {
+  do {
+    i = Feistel(i);
+  } while (i >= size_);
+  return i;
+}
+
+uint64_t RandomPermutation::Size() const {
+  return size_;
+}
+
+uint64_t RandomPermutation::Feistel(uint64_t x) const {
+  const uint64_t mask = (1ULL << half_bits_) - 1;
+  uint64_t left = x >> half_bits_;
+  uint64_t right = x & mask;
+  for (const uint64_t key : keys_) {
+    const uint64_t next = left ^ (Mix(right ^ key) & mask);
+    left = right;
+    right = next;
+  }
+  return (left << half_bits_) | right;
+}
+
+}  // namespace utils
+}  // namespace fs_testing
@@ -0,0 +1,34 @@
+#ifndef UTILS_RANDOM_PERMUTATION_H
+#define UTILS_RANDOM_PERMUTATION_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace fs_testing {
+namespace utils {
+
+// Random permutation of [0, size) worked out one element at a time instead of
+// being stored. A keyed Feistel network permutes the smallest range with an
+// even number of bits that holds [0, size). Elements it maps outside of
+// [0, size) are walked along their cycle until they land back inside, which
+// takes less than four steps on average.
+class RandomPermutation {
+ public:
+  void Init(const uint64_t size, std::mt19937& rand);
+  // Element i of the permutation, for i < Size().
+  uint64_t At(uint64_t i) const;
+  uint64_t Size() const;
+
+ private:
+  uint64_t Feistel(uint64_t x) const;
+
+  uint64_t size_ = 0;
+  unsigned int half_bits_ = 0;
+  std::vector<uint64_t> keys_;
+};
+
+}  // namespace utils
+}  // namespace fs_testing
+
+#endif  // UTILS_RANDOM_PERMUTATION_H
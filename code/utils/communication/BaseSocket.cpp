@@ -41,6 +41,7 @@ int BaseSocket::ReadMessageFromSocket(int socket, SocketMessage *m) {
     case SocketMessage::kRunTests:
     case SocketMessage::kRunTestsDone:
     case SocketMessage::kCheckpointDone:
+    case SocketMessage::kStats:
       // Somebody sent us extra data anyway. Gobble it up and throw it away.
       if (m->size != 0) {
         res = GobbleData(socket, m->size);
@@ -49,6 +50,9 @@ int BaseSocket::ReadMessageFromSocket(int socket, SocketMessage *m) {
     case SocketMessage::kCheckpoint:
       res = ReadStringFromSocket(socket, m->size, &m->string_value);
       break;
+    case SocketMessage::kStatsDone:
+      res = ReadStatsFromSocket(socket, m->size, &m->stats_value);
+      break;
     default:
       res = -1;
   }
@@ -76,6 +80,7 @@ int BaseSocket::WriteMessageToSocket(int socket, SocketMessage &m) {
     case SocketMessage::kRunTests:
     case SocketMessage::kRunTestsDone:
     case SocketMessage::kCheckpointDone:
+    case SocketMessage::kStats:
       // By default, always send the proper size of the message and no other,
       // extra data.
       res = WriteIntToSocket(socket, 0);
@@ -86,6 +91,9 @@ int BaseSocket::WriteMessageToSocket(int socket, SocketMessage &m) {
     case SocketMessage::kCheckpoint:
       res = WriteStringToSocket(socket, m.string_value);
       break;
+    case SocketMessage::kStatsDone:
+      res = WriteStatsToSocket(socket, m.stats_value);
+      break;
     default:
       res = -1;
   }
@@ -110,7 +118,8 @@ int BaseSocket::ReadIntFromSocket(int socket, int* data) {
   int32_t d;
   do {
     int res = recv(socket, (char*) &d + bytes_read, sizeof(d) - bytes_read, 0);
-    if (res < 0) {
+    // The other end hung up before sending the whole int.
+    if (res <= 0) {
       return -1;
     }
     bytes_read += res;
@@ -198,6 +207,52 @@ int BaseSocket::WriteStringToSocket(int socket, string &data) {
   return 0;
 }
 
+// Stats are sent as an array of 64-bit values, each as two network endian ints
+// with the high half first. Fields the other side doesn't know about are
+// dropped on read and left zero if they weren't sent.
+int BaseSocket::ReadStatsFromSocket(int socket, unsigned int len,
+    HarnessStats *data) {
+  if (len & (sizeof(uint64_t) - 1)) {
+    return -1;
+  }
+
+  memset(data, 0, sizeof(HarnessStats));
+  uint64_t *fields = (uint64_t*) data;
+  const unsigned int num_fields = sizeof(HarnessStats) / sizeof(uint64_t);
+  unsigned int i = 0;
+  for (; i < num_fields && i < len / sizeof(uint64_t); ++i) {
+    int high;
+    int low;
+    if (ReadIntFromSocket(socket, &high) < 0
+        || ReadIntFromSocket(socket, &low) < 0) {
+      return -1;
+    }
+    fields[i] = (((uint64_t) (uint32_t) high) << 32) | (uint32_t) low;
+  }
+  if (len > i * sizeof(uint64_t)) {
+    return GobbleData(socket, len - i * sizeof(uint64_t));
+  }
+  return 0;
+}
+
+int BaseSocket::WriteStatsToSocket(int socket, HarnessStats &data) {
+  static_assert(sizeof(HarnessStats) % sizeof(uint64_t) == 0,
+      "HarnessStats must only hold 64-bit fields");
+  int res = WriteIntToSocket(socket, sizeof(HarnessStats));
+  if (res < 0) {
+    return res;
+  }
+
+  const uint64_t *fields = (const uint64_t*) &data;
+  for (unsigned int i = 0; i < sizeof(HarnessStats) / sizeof(uint64_t); ++i) {
+    if (WriteIntToSocket(socket, (int) (fields[i] >> 32)) < 0
+        || WriteIntToSocket(socket, (int) (uint32_t) fields[i]) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 }  // namespace communication
 }  // namespace utils
 }  // namespace fs_testing
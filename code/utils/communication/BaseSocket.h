@@ -19,6 +19,9 @@ class BaseSocket {
   static int ReadStringFromSocket(int socket, unsigned int len,
       std::string *data);
   static int WriteStringToSocket(int socket, std::string &data);
+  static int ReadStatsFromSocket(int socket, unsigned int len,
+      HarnessStats *data);
+  static int WriteStatsToSocket(int socket, HarnessStats &data);
 };
 
 }  // namespace communication
@@ -1,8 +1,11 @@
+#include <poll.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <string>
 
 #include "ServerSocket.h"
@@ -19,6 +22,7 @@ ServerSocket::~ServerSocket() {
   // If we try to close an invalid file descriptor then oh well, nothing bad
   // should happen (famous last words...).
   close(client_socket);
+  close(query_socket);
   close(server_socket);
   unlink(socket_address.c_str());
 }
@@ -76,6 +80,65 @@ SocketError ServerSocket::WaitForMessage(SocketMessage *m) {
   return SocketError::kNone;
 }
 
+SocketError ServerSocket::WaitForQuery(SocketMessage *m, int timeout_ms) {
+  if (server_socket < 0) {
+    return SocketError::kNotConnected;
+  }
+  if (query_socket >= 0) {
+    return SocketError::kAlreadyConnected;
+  }
+
+  struct pollfd pending;
+  pending.fd = server_socket;
+  pending.events = POLLIN;
+  const int res = poll(&pending, 1, timeout_ms);
+  if (res < 0) {
+    return SocketError::kSyscall;
+  } else if (res == 0) {
+    return SocketError::kTimeout;
+  }
+  query_socket = accept(server_socket, NULL, NULL);
+  if (query_socket < 0) {
+    return SocketError::kSyscall;
+  }
+
+  // Don't let a client that connects and never sends anything hold up the
+  // caller for longer than it asked to wait. A zero timeval would mean no
+  // timeout at all.
+  if (timeout_ms >= 0) {
+    const int read_ms = (timeout_ms > 0) ? timeout_ms : 1;
+    struct timeval timeout;
+    timeout.tv_sec = read_ms / 1000;
+    timeout.tv_usec = (read_ms % 1000) * 1000;
+    if (setsockopt(query_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+          sizeof(timeout)) < 0) {
+      close(query_socket);
+      query_socket = -1;
+      return SocketError::kSyscall;
+    }
+  }
+
+  errno = 0;
+  if (BaseSocket::ReadMessageFromSocket(query_socket, m)) {
+    const bool timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+    close(query_socket);
+    query_socket = -1;
+    return timed_out ? SocketError::kTimeout : SocketError::kSyscall;
+  }
+  return SocketError::kNone;
+}
+
+SocketError ServerSocket::SendQueryReply(SocketMessage &m) {
+  if (query_socket < 0) {
+    return SocketError::kNotConnected;
+  }
+
+  const int res = BaseSocket::WriteMessageToSocket(query_socket, m);
+  close(query_socket);
+  query_socket = -1;
+  return (res < 0) ? SocketError::kSyscall : SocketError::kNone;
+}
+
 void ServerSocket::CloseClient() {
   close(client_socket);
   client_socket = -1;
@@ -84,6 +147,8 @@ void ServerSocket::CloseClient() {
 void ServerSocket::CloseServer() {
   close(client_socket);
   client_socket = -1;
+  close(query_socket);
+  query_socket = -1;
   close(server_socket);
   server_socket = -1;
 }
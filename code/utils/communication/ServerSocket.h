@@ -23,11 +23,19 @@ class ServerSocket {
   SocketError SendCommand(SocketMessage::CmCommand c);
   SocketError SendMessage(SocketMessage &m);
   SocketError WaitForMessage(SocketMessage *m);
+  // Wait up to timeout_ms for a message on a connection of its own, so that
+  // queries can be answered while the client of WaitForMessage waits for a
+  // reply. The reply goes out with SendQueryReply, which also closes the
+  // connection. A client that connects but sends nothing within timeout_ms is
+  // hung up on and kTimeout returned.
+  SocketError WaitForQuery(SocketMessage *m, int timeout_ms);
+  SocketError SendQueryReply(SocketMessage &m);
   void CloseClient();
   void CloseServer();
  private:
   int server_socket = -1;
   int client_socket = -1;
+  int query_socket = -1;
   const std::string socket_address;
 };
 
@@ -1,6 +1,7 @@
 #ifndef UTILS_COMMUNICATION_SOCKET_UTILS_H
 #define UTILS_COMMUNICATION_SOCKET_UTILS_H
 
+#include <cstdint>
 #include <string>
 
 namespace fs_testing {
@@ -30,6 +31,43 @@ const char kSocketNameOutbound[] = "/tmp/crash_monkey_harness";
  ******************************************************************************/
 
 
+// Progress of checking crash states, sent in reply to a kStats message. Every
+// field is a 64-bit count so the struct can be sent as an array of them.
+struct HarnessStats {
+  // Same order as Tester::time_stats.
+  enum Stage {
+    kPermute,
+    kSnapshot,
+    kBioWrite,
+    kFsck,
+    kMount,
+    kTestCase,
+    kUmount,
+    kNumStages,
+  };
+
+  uint64_t elapsed_ms;
+  uint64_t states_target;
+  uint64_t completed;
+  // Completed states whose result came from an equivalent state or an
+  // earlier run instead of being checked.
+  uint64_t reused;
+  uint64_t cached;
+  uint64_t passed;
+  uint64_t passed_fixed;
+  uint64_t failed;
+  uint64_t old_file_persisted;
+  uint64_t file_missing;
+  uint64_t file_data_corrupted;
+  uint64_t file_metadata_corrupted;
+  uint64_t other;
+  // States completed in the last window_ms milliseconds, for the current rate.
+  uint64_t window_ms;
+  uint64_t window_completed;
+  // Time spent in each stage summed over all workers.
+  uint64_t stage_us[kNumStages];
+};
+
 // Simple container for the different responses that you can get back from a
 // socket connection. I'm lazy and using C++ so I'm using strings instead of a
 // char* where I'd have to do some memory management myself. The fields at the
@@ -55,6 +93,10 @@ struct SocketMessage {
     kRunTestsDone,
     kCheckpoint,
     kCheckpointDone,
+    // Ask for the progress of the crash states being checked. May be sent at
+    // any time while tests are running, the reply carries a HarnessStats.
+    kStats,
+    kStatsDone,
   };
 
   CmCommand type;
@@ -62,6 +104,7 @@ struct SocketMessage {
   unsigned int size;
   int int_value;
   std::string string_value;
+  HarnessStats stats_value;
 };
 
 // Basic errors to handle reporting back to the user. They aren't meant to
@@ -79,6 +122,8 @@ enum SocketError {
   kWrongType,
   kAlreadyConnected,
   kNotConnected,
+  // Nothing arrived before the timeout given.
+  kTimeout,
 };
 
 }  // namespace communication
@@ -7,13 +7,14 @@
 #include <fstream>
 #include <ios>
 #include <iostream>
-#include <memory>
 #include <random>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "LogArena.h"
 #include "utils.h"
 #include "utils_c.h"
 
@@ -27,7 +28,6 @@ using std::mt19937;
 using std::ofstream;
 using std::ostream;
 using std::pair;
-using std::shared_ptr;
 using std::tie;
 using std::uniform_int_distribution;
 using std::vector;
@@ -44,24 +44,15 @@ bool disk_write::is_meta() {
   return c_is_meta(&metadata);
 }
 
+// Copying a disk_write is as cheap as it gets as they are copied around for
+// every crash state.
+static_assert(std::is_trivially_copyable<disk_write>::value,
+    "disk_write should be trivially copyable");
+
 disk_write::disk_write(const struct disk_write_op_meta& m,
     const char *d) {
   metadata = m;
-  if (metadata.size > 0 && d != NULL) {
-    data = shared_ptr<char>(new char[metadata.size],
-        [](char* c) {delete[] c;});
-    memcpy(data.get(), d, metadata.size);
-  }
-}
-
-disk_write::disk_write(const disk_write& other) {
-  metadata = other.metadata;
-  data = other.data;
-}
-
-void disk_write::operator=(const disk_write& other) {
-  metadata = other.metadata;
-  data = other.data;
+  set_data(d);
 }
 
 bool operator==(const disk_write& a, const disk_write& b) {
@@ -69,13 +60,13 @@ bool operator==(const disk_write& a, const disk_write& b) {
         a.metadata.size) ==
       tie(b.metadata.bi_flags, b.metadata.bi_rw, b.metadata.write_sector,
         b.metadata.size)) {
-    if ((a.data.get() == NULL && b.data.get() != NULL) ||
-        (a.data.get() != NULL && b.data.get() == NULL)) {
+    if ((a.data == NULL && b.data != NULL) ||
+        (a.data != NULL && b.data == NULL)) {
       return false;
-    } else if (a.data.get() == NULL && b.data.get() == NULL) {
+    } else if (a.data == NULL && b.data == NULL) {
       return true;
     }
-    if (memcmp(a.data.get(), b.data.get(), a.metadata.size) == 0) {
+    if (memcmp(a.data, b.data, a.metadata.size) == 0) {
       return true;
     }
   }
@@ -94,7 +85,7 @@ void disk_write::serialize(std::ofstream& fs, const disk_write& dw) {
     << dw.metadata.bi_rw << " "
     << dw.metadata.write_sector << " "
     << dw.metadata.size << " ";
-  char *data = (char *) dw.data.get();
+  const char *data = dw.data;
   for (unsigned int i = 0; i < dw.metadata.size; ++i) {
     // TODO(ashmrtn): Change to put?
     fs << *(data + i);
@@ -121,14 +112,18 @@ disk_write disk_write::deserialize(ifstream& is) {
   // Eat single space between size of data and data.
   is.get(nl);
   assert(nl == ' ');
-  char *data = new char[meta.size];
-  is.read(data, meta.size);
+  disk_write res;
+  res.metadata = meta;
+  // Read straight into the arena instead of through a temporary buffer.
+  char *data = LogArena::Default().Allocate(meta.size);
+  if (data != NULL) {
+    is.read(data, meta.size);
+    res.assign_data(data);
+  }
   // Make sure that the meta.size field matches the actual data size in the log.
   is.get(nl);
   assert(nl == '\n');
   is.copyfmt(prev_format);
-  disk_write res(meta, data);
-  delete[] data;
   return res;
 }
 
@@ -140,7 +135,7 @@ ofstream& operator<<(ofstream& fs, const disk_write& dw) {
     << dw.metadata.bi_rw << " "
     << dw.metadata.write_sector << " "
     << dw.metadata.size << " "
-    << dw.data;
+    << (const void*) dw.data;
   return fs;
 }
 
@@ -182,15 +177,18 @@ void disk_write::clear_flush_seq_flag() {
   c_clear_flush_seq_flag(&metadata);
 }
 
-shared_ptr<char> disk_write::set_data(const char *d) {
+const char* disk_write::set_data(const char *d) {
   if (metadata.size > 0 && d != NULL) {
-    data = shared_ptr<char>(new char[metadata.size]);
-    memcpy(data.get(), d, metadata.size);
+    data = LogArena::Default().Copy(d, metadata.size);
   }
   return data;
 }
 
-shared_ptr<char> disk_write::get_data() {
+void disk_write::assign_data(const char *d) {
+  data = d;
+}
+
+const char* disk_write::get_data() const {
   return data;
 }
 
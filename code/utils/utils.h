@@ -3,7 +3,6 @@
 
 #include <fstream>
 #include <iostream>
-#include <memory>
 #include <utility>
 #include <vector>
 
@@ -12,15 +11,16 @@
 namespace fs_testing {
 namespace utils {
 
+// A bio from the wrapper's log. Data lives in the LogArena, so copies are
+// plain copies that point at the same data.
 class disk_write {
  public:
   disk_write() = default;
+  // Copies m.size bytes at d into the LogArena.
   disk_write(const struct disk_write_op_meta& m, const char *d);
-  disk_write(const disk_write& other);
 
-  struct disk_write_op_meta metadata;
+  struct disk_write_op_meta metadata = {};
 
-  void operator=(const disk_write& other);
   friend bool operator==(const disk_write& a, const disk_write& b);
   friend bool operator!=(const disk_write& a, const disk_write& b);
   friend std::ofstream& operator<<(std::ofstream& os, const disk_write& dw);
@@ -41,18 +41,18 @@ class disk_write {
   static void serialize(std::ofstream& fs, const disk_write& dw);
   static disk_write deserialize(std::ifstream& is);
 
-  // Returns a pointer to the data which was assigned or NULL if data could not
-  // be assigned. Pointer is valid only as long as the object exists. The user
-  // should not call free on this pointer or otherwise attempt memory management
-  // of it.
-  std::shared_ptr<char> set_data(const char *data);
+  // Copies metadata.size bytes at data into the LogArena and returns the copy,
+  // or NULL if data could not be assigned.
+  const char* set_data(const char *data);
+  // Points at data, which must already be in the LogArena or otherwise outlive
+  // this and all copies of it, without copying it.
+  void assign_data(const char *data);
   // Returns a pointer to the data field or NULL if data has not been assigned.
-  // Pointer is valid only as long as the object exists or otherwise attempt
-  // memory management of it.
-  std::shared_ptr<char> get_data();
+  // The user should not free this pointer.
+  const char* get_data() const;
 
  private:
-  std::shared_ptr<char> data;
+  const char* data = NULL;
 };
 
 
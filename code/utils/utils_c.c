@@ -59,4 +59,15 @@ void c_clear_flush_seq_flag(struct disk_write_op_meta *m) {
 }
 // bool c_reset_flush_flag(struct disk_write_op_meta *m) {
 //   return (m->bi_rw)
-// }
\ No newline at end of file
+// }
+
+void c_get_flag_encoding(unsigned long long *flags) {
+  flags[0] = REQ_WRITE;
+  flags[1] = REQ_SYNC;
+  flags[2] = REQ_META;
+  flags[3] = REQ_DISCARD;
+  flags[4] = REQ_SOFTBARRIER;
+  flags[5] = REQ_FUA;
+  flags[6] = REQ_FLUSH;
+  flags[7] = REQ_FLUSH_SEQ;
+}
@@ -26,6 +26,12 @@ void c_set_flush_seq_flag(struct disk_write_op_meta *m);
 void c_clear_flush_flag(struct disk_write_op_meta *m);
 void c_clear_flush_seq_flag(struct disk_write_op_meta *m);
 
+// Values of the bio flags the harness looks at in the kernel it was built
+// against, so that saved profiles can tell if they are read back by a harness
+// that numbers the flags differently.
+#define C_NUM_FLAGS 8
+void c_get_flag_encoding(unsigned long long *flags);
+
 #ifdef __cplusplus
 }
 #endif
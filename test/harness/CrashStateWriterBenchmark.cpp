@@ -0,0 +1,177 @@
+// Compares writing a large synthetic crash state with pwritev against writing
+// it with O_DIRECT through io_uring.
+//
+// usage: CrashStateWriterBenchmark [file or device] [number of bios]
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/blk_types.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../code/harness/CrashStateWriter.h"
+#include "../../code/utils/utils.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+using fs_testing::AlignedLog;
+using fs_testing::CrashStateWriter;
+using fs_testing::WriteStats;
+using fs_testing::utils::disk_write;
+
+namespace {
+
+static const unsigned int kSectorSize = 512;
+static const unsigned int kNumBios = 100000;
+static const unsigned int kPasses = 5;
+// Keep everything inside a 128MiB region.
+static const unsigned long int kRegionSectors = 128 * 1024 * 1024 / kSectorSize;
+
+// Roughly what a file system workload looks like: mostly sequential runs of
+// small bios with the occasional jump somewhere else and some rewrites of
+// blocks that were already written (journal and metadata blocks).
+void MakeProfile(const unsigned int num_bios, vector<disk_write>& log) {
+  std::mt19937 rand(42);
+  vector<char> buf(8 * kSectorSize);
+  unsigned long int sector = 0;
+  log.clear();
+  for (unsigned int i = 0; i < num_bios; ++i) {
+    struct disk_write_op_meta meta;
+    std::memset(&meta, 0, sizeof(meta));
+    meta.bi_rw = REQ_WRITE;
+    meta.size = (rand() % 8 + 1) * kSectorSize;
+
+    const unsigned int choice = rand() % 100;
+    if (choice < 5) {
+      sector = rand() % (kRegionSectors - 8);
+    } else if (choice < 15 && !log.empty()) {
+      sector = log.at(rand() % log.size()).metadata.write_sector;
+    }
+    if (sector + meta.size / kSectorSize > kRegionSectors) {
+      sector = 0;
+    }
+    meta.write_sector = sector;
+    sector += meta.size / kSectorSize;
+
+    for (char& c : buf) {
+      c = rand();
+    }
+    log.emplace_back(meta, buf.data());
+  }
+}
+
+bool RunPasses(const string& name, const int fd, CrashStateWriter& writer,
+    vector<disk_write>& log) {
+  WriteStats stats;
+  microseconds total(0);
+  for (unsigned int i = 0; i < kPasses; ++i) {
+    const auto start = steady_clock::now();
+    if (!writer.Write(fd, log.begin(), log.end(), &stats) || fsync(fd) < 0) {
+      cerr << name << ": error writing crash state" << endl;
+      return false;
+    }
+    total += duration_cast<microseconds>(steady_clock::now() - start);
+  }
+  cout << name << ": " << total.count() / kPasses / 1000.0 << " ms per state, "
+    << stats.syscalls / kPasses << " syscalls per state, "
+    << stats.bytes / kPasses << " bytes per state" << endl;
+  return true;
+}
+
+bool ZeroRegion(const int fd, const vector<char>& zeros) {
+  return pwrite(fd, zeros.data(), zeros.size(), 0) == (ssize_t) zeros.size()
+    && fsync(fd) == 0;
+}
+
+bool ReadRegion(const int fd, vector<char>& contents) {
+  contents.resize(kRegionSectors * kSectorSize);
+  unsigned long int done = 0;
+  while (done < contents.size()) {
+    const ssize_t res =
+      pread(fd, contents.data() + done, contents.size() - done, done);
+    if (res <= 0) {
+      return false;
+    }
+    done += res;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const string path = (argc > 1) ? argv[1] : "/tmp/crash_state_benchmark";
+  const unsigned int num_bios = (argc > 2) ? atoi(argv[2]) : kNumBios;
+
+  vector<disk_write> log;
+  MakeProfile(num_bios, log);
+  cout << "writing " << log.size() << " bios to " << path << endl;
+
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  // Block devices can't be truncated, but they should already be big enough.
+  if (fd < 0 || (ftruncate(fd, kRegionSectors * kSectorSize) < 0
+        && errno != EINVAL)) {
+    cerr << "error opening " << path << endl;
+    return 1;
+  }
+
+  // Both writers start from a zeroed region so that leftovers from earlier runs
+  // don't show up as differences.
+  const vector<char> zeros(kRegionSectors * kSectorSize, 0);
+  CrashStateWriter pwritev_writer;
+  vector<char> expected;
+  if (!ZeroRegion(fd, zeros) || !RunPasses("pwritev", fd, pwritev_writer, log)
+      || !ReadRegion(fd, expected)) {
+    close(fd);
+    return 1;
+  }
+
+  AlignedLog aligned_log;
+  CrashStateWriter uring_writer;
+  if (!aligned_log.Init(log) || !uring_writer.InitUring(&aligned_log)) {
+    cout << "io_uring: unavailable" << endl;
+    close(fd);
+    return 0;
+  }
+  if (!ZeroRegion(fd, zeros)) {
+    close(fd);
+    return 1;
+  }
+  // Not every file system supports O_DIRECT (tmpfs doesn't), so fall back to
+  // buffered writes if it is refused.
+  int direct_fd = open(path.c_str(), O_RDWR | O_DIRECT);
+  const bool direct = direct_fd >= 0;
+  if (!direct) {
+    direct_fd = open(path.c_str(), O_RDWR);
+  }
+  const bool ok = RunPasses(direct ? "io_uring O_DIRECT" : "io_uring buffered",
+      direct_fd, uring_writer, log);
+  close(direct_fd);
+
+  vector<char> actual;
+  if (!ok || !ReadRegion(fd, actual)) {
+    close(fd);
+    return 1;
+  }
+  close(fd);
+  if (actual != expected) {
+    cerr << "io_uring and pwritev wrote different crash states" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// mus now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../../code/harness/CrashStateWriter.h"
+#include "../../code/utils/LogView.h"
+#include "../../code/utils/utils.h"
+#include "../utils/TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::vector;
+
+using fs_testing::CrashStateWriter;
+using fs_testing::WriteStats;
+using fs_testing::utils::disk_write;
+using fs_testing::utils::LogView;
+
+namespace {
+
+static const unsigned int kSectorSize = 512;
+static const unsigned int kDiskSectors = 256;
+
+}  // namespace
+
+class CrashStateWriterTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char path[] = "/tmp/CrashStateWriterTestXXXXXX";
+    fd_ = mkstemp(path);
+    ASSERT_LE(0, fd_);
+    unlink(path);
+  }
+
+  virtual void TearDown() {
+    close(fd_);
+  }
+
+  // Zero the disk and return what writing bios one at a time in order leaves
+  // on it.
+  vector<char> ReplayInOrder(const vector<disk_write>& bios) {
+    vector<char> disk(kDiskSectors * kSectorSize, 0);
+    for (const disk_write& bio : bios) {
+      std::copy(bio.get_data(), bio.get_data() + bio.metadata.size,
+          disk.begin() + bio.metadata.write_sector * kSectorSize);
+    }
+    Zero();
+    return disk;
+  }
+
+  void Zero() {
+    const vector<char> zeros(kDiskSectors * kSectorSize, 0);
+    ASSERT_EQ((ssize_t) zeros.size(),
+        pwrite(fd_, zeros.data(), zeros.size(), 0));
+  }
+
+  vector<char> ReadDisk() {
+    vector<char> disk(kDiskSectors * kSectorSize);
+    EXPECT_EQ((ssize_t) disk.size(), pread(fd_, disk.data(), disk.size(), 0));
+    return disk;
+  }
+
+  int fd_ = -1;
+  CrashStateWriter writer_;
+  WriteStats stats_;
+};
+
+TEST_F(CrashStateWriterTest, OverlappingAdjacentAndShadowedExtents) {
+  vector<disk_write> bios = {
+    // Adjacent bios that can go out in one write, out of sector order.
+    MakeBio(8, 8 * kSectorSize, REQ_WRITE, 'a'),
+    MakeBio(0, 8 * kSectorSize, REQ_WRITE, 'b'),
+    MakeBio(16, 4 * kSectorSize, REQ_WRITE, 'c'),
+    // Partly overwritten by the next bio.
+    MakeBio(40, 8 * kSectorSize, REQ_WRITE, 'd'),
+    MakeBio(44, 8 * kSectorSize, REQ_WRITE, 'e'),
+    // Entirely shadowed by the bio after it.
+    MakeBio(66, 2 * kSectorSize, REQ_WRITE, 'f'),
+    MakeBio(64, 8 * kSectorSize, REQ_WRITE, 'g'),
+    // Shadows the middle of the bio before it.
+    MakeBio(96, 16 * kSectorSize, REQ_WRITE, 'h'),
+    MakeBio(100, 2 * kSectorSize, REQ_WRITE, 'i'),
+    // Written three times, the last write wins.
+    MakeBio(128, 4 * kSectorSize, REQ_WRITE, 'j'),
+    MakeBio(128, 4 * kSectorSize, REQ_WRITE, 'k'),
+    MakeBio(128, 4 * kSectorSize, REQ_WRITE, 'l'),
+    // Right after an overlapping group.
+    MakeBio(132, 4 * kSectorSize, REQ_WRITE, 'm'),
+  };
+  const vector<char> expected = ReplayInOrder(bios);
+
+  ASSERT_TRUE(writer_.Write(fd_, bios.begin(), bios.end(), &stats_));
+  EXPECT_EQ(expected, ReadDisk());
+  // The three adjacent bios at the start go out together.
+  EXPECT_GT(bios.size(), stats_.syscalls);
+}
+
+TEST_F(CrashStateWriterTest, LogEntriesMatchInOrderReplay) {
+  std::mt19937 rand(42);
+  vector<disk_write> bios;
+  for (unsigned int i = 0; i < 500; ++i) {
+    const unsigned int sectors = rand() % 8 + 1;
+    bios.push_back(MakeBio(rand() % (kDiskSectors - sectors),
+          sectors * kSectorSize, REQ_WRITE, 'a' + i % 26));
+  }
+  LogView log;
+  log.Build(bios);
+
+  // Write a shuffled crash state of part of the log through its log entries.
+  vector<unsigned int> entries;
+  vector<disk_write> crash_state;
+  for (unsigned int i = 0; i < bios.size(); ++i) {
+    if (rand() % 4 != 0) {
+      entries.push_back(i);
+    }
+  }
+  std::shuffle(entries.begin(), entries.end(), rand);
+  for (const unsigned int entry : entries) {
+    crash_state.push_back(bios.at(entry));
+  }
+  const vector<char> expected = ReplayInOrder(crash_state);
+
+  ASSERT_TRUE(writer_.Write(fd_, log, entries.cbegin(), entries.cend(),
+        &stats_));
+  EXPECT_EQ(expected, ReadDisk());
+}
+
+}  // namespace test
+}  // namespace fs_testing
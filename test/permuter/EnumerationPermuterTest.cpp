@@ -0,0 +1,87 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// mus now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <set>
+#include <vector>
+
+#include "../../code/permuter/EnumerationPermuter.h"
+#include "../../code/utils/utils.h"
+#include "../utils/TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::set;
+using std::vector;
+
+using fs_testing::permuter::CrashStateEntries;
+using fs_testing::permuter::EnumerationPermuter;
+using fs_testing::utils::disk_write;
+
+vector<disk_write> MakeLog(const unsigned int num_bios) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < num_bios; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  return log;
+}
+
+TEST(EnumerationPermuter, EnumeratesSmallLogsInOrder) {
+  vector<disk_write> log = {MakeBio(0, 4096, REQ_WRITE),
+    MakeBio(8, 4096, REQ_WRITE), MakeBio(0, 0, REQ_WRITE | REQ_FUA),
+    MakeBio(16, 4096, REQ_WRITE)};
+  EnumerationPermuter p;
+  p.InitDataVector(&log);
+
+  // Either bio or both in either order, both followed by the barrier, then the
+  // last bio on top of the first epoch.
+  const vector<CrashStateEntries> expected = {{0}, {1}, {0, 1}, {1, 0},
+    {0, 1, 2}, {1, 0, 2}, {0, 1, 2, 3}};
+  ASSERT_EQ(expected.size(), p.NumStates());
+  CrashStateEntries res;
+  for (const CrashStateEntries& state : expected) {
+    EXPECT_TRUE(p.GenerateCrashState(res));
+    EXPECT_EQ(state, res);
+  }
+  EXPECT_FALSE(p.GenerateCrashState(res));
+}
+
+TEST(EnumerationPermuter, ShufflesLargerSpacesWithoutRepeats) {
+  vector<disk_write> log = MakeLog(8);
+  EnumerationPermuter p;
+  p.InitDataVector(&log);
+
+  // Orderings of 1 to 8 of the 8 bios.
+  ASSERT_EQ(109600, p.NumStates());
+  ASSERT_LT(EnumerationPermuter::kInOrderStates, p.NumStates());
+  set<CrashStateEntries> seen;
+  CrashStateEntries res;
+  ASSERT_TRUE(p.GenerateCrashState(res));
+  // Not handed out in order.
+  EXPECT_NE(CrashStateEntries({0}), res);
+  do {
+    ASSERT_TRUE(seen.insert(res).second);
+  } while (p.GenerateCrashState(res));
+  EXPECT_EQ(p.NumStates(), seen.size());
+}
+
+TEST(EnumerationPermuter, SamplesSpacesTooLargeToNumber) {
+  vector<disk_write> log = MakeLog(25);
+  EnumerationPermuter p;
+  p.InitDataVector(&log);
+
+  EXPECT_EQ(0, p.NumStates());
+  CrashStateEntries res;
+  for (unsigned int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(p.GenerateCrashState(res));
+    ASSERT_FALSE(res.empty());
+    set<unsigned int> bios(res.begin(), res.end());
+    EXPECT_EQ(res.size(), bios.size());
+    EXPECT_GT(25, *bios.rbegin());
+  }
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,242 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// mus now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "../../code/permuter/Permuter.h"
+#include "../../code/utils/utils.h"
+#include "../utils/TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::deque;
+using std::vector;
+
+using fs_testing::permuter::CrashStateEntries;
+using fs_testing::permuter::CrashStateSignature;
+using fs_testing::permuter::epoch;
+using fs_testing::permuter::epoch_op;
+using fs_testing::permuter::Permuter;
+using fs_testing::utils::disk_write;
+using fs_testing::utils::LogView;
+
+// Hands out the ops of the first epoch in the orders it is given.
+class OrderedPermuter : public Permuter {
+ public:
+  using Permuter::GetEpochs;
+
+  deque<vector<unsigned int>> orders;
+
+ private:
+  void init_data(vector<epoch>*) {}
+
+  bool gen_one_state(vector<epoch_op>& res) {
+    res.clear();
+    if (orders.empty()) {
+      return false;
+    }
+    for (const unsigned int i : orders.front()) {
+      res.push_back(GetEpochs()->at(0).ops.at(i));
+    }
+    orders.pop_front();
+    return true;
+  }
+};
+
+// Hands out the crash states it is given as log entries.
+class EntryPermuter : public Permuter {
+ public:
+  deque<CrashStateEntries> states;
+
+ private:
+  void init_data(vector<epoch>*) {}
+
+  bool gen_one_state_entries(CrashStateEntries& res) {
+    res.clear();
+    if (states.empty()) {
+      return false;
+    }
+    res = states.front();
+    states.pop_front();
+    return true;
+  }
+};
+
+CrashStateSignature Generate(OrderedPermuter& p, vector<unsigned int> order) {
+  vector<disk_write> res;
+  p.orders.push_back(order);
+  EXPECT_TRUE(p.GenerateCrashState(res));
+  return p.GetCrashStateSignature();
+}
+
+TEST(Permuter, SignatureIgnoresOrderOfDisjointBios) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(8, 4096),
+    MakeBio(64, 512)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  const CrashStateSignature in_order = Generate(p, {0, 1, 2});
+  const CrashStateSignature reordered = Generate(p, {2, 0, 1});
+  EXPECT_EQ(in_order, reordered);
+  // Adjacent extents written by different bios are kept apart.
+  EXPECT_EQ(CrashStateSignature({0, 8, 0, 8, 16, 1, 64, 65, 2}), in_order);
+}
+
+TEST(Permuter, SignatureFollowsLastWriter) {
+  vector<disk_write> log = {MakeBio(0, 8192), MakeBio(4, 1024),
+    MakeBio(100, 512)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  const CrashStateSignature in_order = Generate(p, {0, 1, 2});
+  EXPECT_EQ(CrashStateSignature({0, 4, 0, 4, 6, 1, 6, 16, 0, 100, 101, 2}),
+      in_order);
+  // Bio 1 is completely hidden by bio 0 when it goes first.
+  const CrashStateSignature hidden = Generate(p, {1, 0, 2});
+  EXPECT_EQ(CrashStateSignature({0, 16, 0, 100, 101, 2}), hidden);
+  // Moving the bio that doesn't overlap anything changes nothing.
+  EXPECT_EQ(in_order, Generate(p, {2, 0, 1}));
+  EXPECT_EQ(hidden, Generate(p, {1, 2, 0}));
+}
+
+TEST(Permuter, FindsOverlapGroups) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(16, 4096),
+    MakeBio(4, 512), MakeBio(6, 4096), MakeBio(12, 4096),
+    MakeBio(100, 512), MakeBio(24, 512)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  ASSERT_EQ(1, p.GetEpochs()->size());
+  const epoch& e = p.GetEpochs()->at(0);
+  EXPECT_TRUE(e.overlaps);
+  // Bios 0 and 1 are linked through bios 3 and 4, sizes are in bytes but
+  // sectors aren't. Bio 6 only touches bio 1.
+  EXPECT_EQ(vector<unsigned int>({0, 0, 0, 0, 0, 5, 6}), e.overlap_group);
+}
+
+TEST(Permuter, GroupsRepeatedWritesOfOneSector) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < 10000; ++i) {
+    log.push_back(MakeBio(8, 512));
+  }
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  ASSERT_EQ(1, p.GetEpochs()->size());
+  const epoch& e = p.GetEpochs()->at(0);
+  EXPECT_TRUE(e.overlaps);
+  EXPECT_EQ(vector<unsigned int>(log.size(), 0), e.overlap_group);
+}
+
+TEST(Permuter, NoOverlapsBetweenDisjointBios) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(8, 4096),
+    MakeBio(64, 512)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  ASSERT_EQ(1, p.GetEpochs()->size());
+  EXPECT_FALSE(p.GetEpochs()->at(0).overlaps);
+  EXPECT_EQ(vector<unsigned int>({0, 1, 2}),
+      p.GetEpochs()->at(0).overlap_group);
+}
+
+TEST(Permuter, SignatureOfPrefix) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(8, 4096)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  EXPECT_EQ(CrashStateSignature({8, 16, 1}), Generate(p, {1}));
+  EXPECT_EQ(CrashStateSignature({0, 8, 0}), Generate(p, {0}));
+}
+
+TEST(Permuter, OldPermutersNameSplitFlushHalves) {
+  vector<disk_write> log = {MakeBio(0, 4096),
+    MakeBio(8, 4096, REQ_WRITE | REQ_FLUSH), MakeBio(16, 512)};
+  OrderedPermuter p;
+  p.InitDataVector(&log);
+
+  ASSERT_EQ(2, p.GetEpochs()->size());
+  CrashStateEntries res;
+  p.orders.push_back({1, 0});
+  EXPECT_TRUE(p.GenerateCrashState(res));
+  EXPECT_EQ(CrashStateEntries({1 | LogView::kFlushHalf, 0}), res);
+  EXPECT_EQ(0, p.GetUnpermutedEpochs());
+}
+
+TEST(Permuter, ResolvesSplitFlushHalves) {
+  vector<disk_write> log = {MakeBio(0, 4096),
+    MakeBio(8, 4096, REQ_WRITE | REQ_FLUSH), MakeBio(16, 512)};
+  EntryPermuter p;
+  p.InitDataVector(&log);
+
+  const CrashStateEntries in_order = {0, 1 | LogView::kFlushHalf,
+    1 | LogView::kDataHalf, 2};
+  p.states.push_back(in_order);
+  vector<disk_write> res;
+  EXPECT_TRUE(p.GenerateCrashState(res));
+  EXPECT_EQ(2, p.GetUnpermutedEpochs());
+  EXPECT_EQ(CrashStateSignature({0, 8, 0, 8, 16, 1, 16, 17, 2}),
+      p.GetCrashStateSignature());
+
+  ASSERT_EQ(4, res.size());
+  EXPECT_EQ(log.at(0), res.at(0));
+  EXPECT_TRUE(res.at(1).has_flush_flag());
+  EXPECT_FALSE(res.at(1).has_write_flag());
+  EXPECT_EQ(0, res.at(1).metadata.size);
+  EXPECT_FALSE(res.at(2).has_flush_flag());
+  EXPECT_TRUE(res.at(2).has_write_flag());
+  EXPECT_EQ(log.at(1).get_data(), res.at(2).get_data());
+  EXPECT_EQ(log.at(2), res.at(3));
+
+  // The flush alone doesn't write anything.
+  p.states.push_back({0, 1 | LogView::kFlushHalf});
+  EXPECT_TRUE(p.GenerateCrashState(res));
+  EXPECT_EQ(1, p.GetUnpermutedEpochs());
+  EXPECT_EQ(CrashStateSignature({0, 8, 0}), p.GetCrashStateSignature());
+}
+
+TEST(Permuter, ShardsSplitCrashStates) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(8, 4096),
+    MakeBio(4, 4096), MakeBio(64, 512)};
+  const deque<CrashStateEntries> states = {{0}, {1}, {2}, {3}, {0, 1},
+    {1, 0}, {0, 2}, {2, 0}, {0, 1, 2, 3}, {3, 2, 1, 0}};
+
+  // Disk states are the same whatever shard finds them.
+  vector<CrashStateSignature> shards[3];
+  for (unsigned int shard = 0; shard < 3; ++shard) {
+    EntryPermuter p;
+    p.InitShard(shard, 3, 0);
+    p.InitDataVector(&log);
+    p.states = states;
+    CrashStateEntries res;
+    while (p.GenerateCrashState(res)) {
+      shards[shard].push_back(p.GetCrashStateSignature());
+    }
+  }
+
+  EntryPermuter whole;
+  whole.InitDataVector(&log);
+  whole.states = states;
+  vector<CrashStateSignature> all;
+  CrashStateEntries res;
+  while (whole.GenerateCrashState(res)) {
+    all.push_back(whole.GetCrashStateSignature());
+  }
+  ASSERT_EQ(states.size(), all.size());
+
+  vector<CrashStateSignature> joined;
+  for (const vector<CrashStateSignature>& shard : shards) {
+    joined.insert(joined.end(), shard.begin(), shard.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::sort(joined.begin(), joined.end());
+  EXPECT_EQ(all, joined);
+}
+
+}  // namespace test
+}  // namespace fs_testing
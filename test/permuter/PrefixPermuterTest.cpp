@@ -0,0 +1,126 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// mus now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "../../code/permuter/PrefixPermuter.h"
+#include "../../code/utils/utils.h"
+#include "../utils/TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::set;
+using std::vector;
+
+using fs_testing::permuter::CrashStateEntries;
+using fs_testing::permuter::PrefixPermuter;
+using fs_testing::utils::disk_write;
+
+unsigned int CommonPrefix(const CrashStateEntries& a,
+    const CrashStateEntries& b) {
+  unsigned int i = 0;
+  while (i < a.size() && i < b.size() && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+TEST(PrefixPermuter, HandsOutEveryCrashStateOnce) {
+  vector<disk_write> log = {MakeBio(0, 4096, REQ_WRITE),
+    MakeBio(8, 4096, REQ_WRITE), MakeBio(16, 4096, REQ_WRITE),
+    MakeBio(0, 0, REQ_WRITE | REQ_FUA), MakeBio(24, 4096, REQ_WRITE)};
+  PrefixPermuter p;
+  p.InitDataVector(&log);
+
+  // Orderings of 1 to 3 of the first 3 bios, the 6 orderings of all of them
+  // again followed by the barrier, then the last bio on top of the first epoch.
+  set<CrashStateEntries> seen;
+  CrashStateEntries res;
+  while (p.GenerateCrashState(res)) {
+    ASSERT_TRUE(seen.insert(res).second);
+  }
+  EXPECT_EQ(3 + 6 + 6 + 6 + 1, seen.size());
+  EXPECT_EQ(1, seen.count({0, 1, 2, 3, 4}));
+}
+
+TEST(PrefixPermuter, ConsecutiveStatesShareLongPrefixes) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < 6; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  log.push_back(MakeBio(0, 0, REQ_WRITE | REQ_FUA));
+  for (unsigned int i = 0; i < 6; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  PrefixPermuter p;
+  p.InitDataVector(&log);
+
+  CrashStateEntries prev;
+  CrashStateEntries res;
+  for (unsigned int i = 0; i < 2 * PrefixPermuter::kBatchStates; ++i) {
+    ASSERT_TRUE(p.GenerateCrashState(res));
+    EXPECT_EQ(CommonPrefix(prev, res), p.GetSharedPrefix());
+    // One batch per epoch, and every epoch before the one being permuted is
+    // left as it was logged.
+    EXPECT_LE(i / PrefixPermuter::kBatchStates, p.GetUnpermutedEpochs());
+    if (i % PrefixPermuter::kBatchStates != 0) {
+      // Either one more bio than the last crash state, or the same crash state
+      // with its last few bios swapped out.
+      EXPECT_TRUE(p.GetSharedPrefix() == prev.size()
+          || p.GetSharedPrefix() == res.size() - 1);
+    }
+    prev = res;
+  }
+}
+
+TEST(PrefixPermuter, ShardsNeverOverstateSharedPrefix) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < 4; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  log.push_back(MakeBio(0, 0, REQ_WRITE | REQ_FUA));
+  for (unsigned int i = 0; i < 4; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  PrefixPermuter p;
+  p.InitShard(1, 3, 42);
+  p.InitDataVector(&log);
+
+  // Crash states of the other shards are dropped in between, so the bios
+  // after the reported prefix may have been swapped out more than once.
+  CrashStateEntries prev;
+  CrashStateEntries res;
+  unsigned int states = 0;
+  while (p.GenerateCrashState(res)) {
+    EXPECT_GE(CommonPrefix(prev, res), p.GetSharedPrefix());
+    prev = res;
+    ++states;
+  }
+  EXPECT_LT(0, states);
+}
+
+TEST(PrefixPermuter, SeedPicksOrderOfBios) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < 8; ++i) {
+    log.push_back(MakeBio(i * 8, 4096, REQ_WRITE));
+  }
+  set<unsigned int> firsts;
+  CrashStateEntries res;
+  for (unsigned int seed = 0; seed < 16; ++seed) {
+    PrefixPermuter p;
+    p.InitShard(0, 1, seed);
+    p.InitDataVector(&log);
+    ASSERT_TRUE(p.GenerateCrashState(res));
+    ASSERT_EQ(1, res.size());
+    firsts.insert(res.front());
+  }
+  EXPECT_LT(1, firsts.size());
+}
+
+}  // namespace test
+}  // namespace fs_testing
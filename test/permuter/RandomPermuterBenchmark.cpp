@@ -0,0 +1,119 @@
+// Compares the time RandomPermuter takes to generate a crash state from one
+// big epoch against picking bios out of a std::list the way it used to. Both
+// times include the rest of Permuter::GenerateCrashState, which is what the
+// harness reports as permute time.
+//
+// usage: RandomPermuterBenchmark [bios per epoch] [crash states]
+
+#include <linux/blk_types.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../code/permuter/Permuter.h"
+#include "../../code/permuter/RandomPermuter.h"
+#include "../../code/utils/utils.h"
+
+using std::cout;
+using std::endl;
+using std::list;
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+using fs_testing::permuter::epoch;
+using fs_testing::permuter::epoch_op;
+using fs_testing::permuter::Permuter;
+using fs_testing::permuter::RandomPermuter;
+using fs_testing::utils::disk_write;
+
+namespace {
+
+static const unsigned int kNumBios = 20000;
+static const unsigned int kNumStates = 50;
+
+// RandomPermuter on a single epoch before it used a partial Fisher-Yates
+// shuffle.
+class ListPermuter : public Permuter {
+ private:
+  void init_data(vector<epoch>*) {}
+
+  bool gen_one_state(vector<epoch_op>& res) {
+    epoch& e = GetEpochs()->back();
+    std::uniform_int_distribution<unsigned int> permute_requests(1,
+        e.ops.size());
+    res.resize(permute_requests(rand));
+
+    list<unsigned int> empty_slots(e.ops.size());
+    std::iota(empty_slots.begin(), empty_slots.end(), 0);
+    for (epoch_op& op : res) {
+      std::uniform_int_distribution<unsigned int> uid(0,
+          empty_slots.size() - 1);
+      auto shift = empty_slots.begin();
+      std::advance(shift, uid(rand));
+      op = e.ops.at(*shift);
+      empty_slots.erase(shift);
+    }
+    return true;
+  }
+
+  std::mt19937 rand = std::mt19937(42);
+};
+
+// One epoch of disjoint 4K writes.
+void MakeLog(const unsigned int num_bios, vector<disk_write>& log) {
+  vector<char> buf(4096, 'a');
+  log.clear();
+  for (unsigned int i = 0; i < num_bios; ++i) {
+    struct disk_write_op_meta meta;
+    std::memset(&meta, 0, sizeof(meta));
+    meta.bi_rw = REQ_WRITE;
+    meta.write_sector = i * 8;
+    meta.size = buf.size();
+    log.emplace_back(meta, buf.data());
+  }
+}
+
+void Run(const string& name, Permuter& p, vector<disk_write>& log,
+    const unsigned int num_states) {
+  p.InitDataVector(&log);
+  vector<disk_write> crash_state;
+  unsigned long int bios = 0;
+  const auto start = steady_clock::now();
+  for (unsigned int i = 0; i < num_states; ++i) {
+    p.GenerateCrashState(crash_state);
+    bios += crash_state.size();
+  }
+  const microseconds total =
+    duration_cast<microseconds>(steady_clock::now() - start);
+  cout << name << ": " << total.count() / num_states / 1000.0
+    << " ms per state, " << bios / num_states << " bios per state" << endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const unsigned int num_bios = (argc > 1) ? atoi(argv[1]) : kNumBios;
+  const unsigned int num_states = (argc > 2) ? atoi(argv[2]) : kNumStates;
+
+  vector<disk_write> log;
+  MakeLog(num_bios, log);
+  cout << "generating " << num_states << " crash states from an epoch of "
+    << log.size() << " bios" << endl;
+
+  ListPermuter list_permuter;
+  Run("list", list_permuter, log, num_states);
+  RandomPermuter random_permuter;
+  Run("fisher-yates", random_permuter, log, num_states);
+  return 0;
+}
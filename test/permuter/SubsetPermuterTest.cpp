@@ -0,0 +1,87 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// mus now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "../../code/permuter/SubsetPermuter.h"
+#include "../../code/utils/utils.h"
+#include "../utils/TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::set;
+using std::vector;
+
+using fs_testing::permuter::CrashStateEntries;
+using fs_testing::permuter::SubsetPermuter;
+using fs_testing::utils::disk_write;
+
+set<CrashStateEntries> GenerateAll(SubsetPermuter& p) {
+  set<CrashStateEntries> seen;
+  CrashStateEntries res;
+  while (p.GenerateCrashState(res)) {
+    EXPECT_TRUE(seen.insert(res).second);
+  }
+  return seen;
+}
+
+TEST(SubsetPermuter, OnlyOneOrderOfDisjointBios) {
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(8, 4096),
+    MakeBio(16, 4096)};
+  SubsetPermuter p;
+  p.InitDataVector(&log);
+
+  ASSERT_EQ(7, p.NumStates());
+  const set<CrashStateEntries> expected = {{0}, {1}, {2}, {0, 1}, {0, 2},
+    {1, 2}, {0, 1, 2}};
+  EXPECT_EQ(expected, GenerateAll(p));
+}
+
+TEST(SubsetPermuter, OrdersOverlappingBios) {
+  // Bios 0 and 1 overlap, 2 doesn't overlap anything, and 3 is a barrier.
+  vector<disk_write> log = {MakeBio(0, 4096), MakeBio(4, 4096),
+    MakeBio(64, 512), MakeBio(0, 512, REQ_WRITE | REQ_FUA),
+    MakeBio(128, 512)};
+  SubsetPermuter p;
+  p.InitDataVector(&log);
+
+  // 5 orderings of the group times 2 for bio 2, less placing nothing, then the
+  // 2 orders of the group with everything and the barrier, then bio 4.
+  ASSERT_EQ(12, p.NumStates());
+  const set<CrashStateEntries> seen = GenerateAll(p);
+  EXPECT_EQ(12, seen.size());
+  EXPECT_EQ(1, seen.count({0, 1}));
+  EXPECT_EQ(1, seen.count({1, 0}));
+  EXPECT_EQ(1, seen.count({1, 0, 2, 3}));
+  EXPECT_EQ(1, seen.count({0, 1, 2, 3, 4}));
+  // The bio that doesn't overlap anything always goes after the group.
+  EXPECT_EQ(0, seen.count({2, 0}));
+}
+
+TEST(SubsetPermuter, SamplesSpacesTooLargeToNumber) {
+  vector<disk_write> log;
+  for (unsigned int i = 0; i < 80; ++i) {
+    log.push_back(MakeBio(i * 8, 4096));
+  }
+  SubsetPermuter p;
+  p.InitDataVector(&log);
+
+  EXPECT_EQ(0, p.NumStates());
+  CrashStateEntries res;
+  for (unsigned int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(p.GenerateCrashState(res));
+    ASSERT_FALSE(res.empty());
+    // Disjoint bios are placed in log order.
+    EXPECT_TRUE(std::is_sorted(res.begin(), res.end()));
+    EXPECT_EQ(res.end(), std::adjacent_find(res.begin(), res.end()));
+    EXPECT_GT(80, res.back());
+  }
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,135 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "../../code/results/ResultCache.h"
+#include "../../code/utils/Fingerprint.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::string;
+
+using fs_testing::utils::Fingerprint;
+using fs_testing::utils::FingerprintBuilder;
+
+class ResultCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    char temp_file[] = "/tmp/result_cacheXXXXXX";
+    const int temp_fd = mkstemp(temp_file);
+    ASSERT_TRUE(temp_fd > 0);
+    close(temp_fd);
+    path = temp_file;
+  }
+
+  void TearDown() {
+    unlink(path.c_str());
+  }
+
+  static Fingerprint Key(const string& name) {
+    FingerprintBuilder builder;
+    builder.Update(name);
+    return builder.Digest();
+  }
+
+  static CachedResult Result(const int fs_check_return) {
+    CachedResult res = {};
+    res.fs_check_return = fs_check_return;
+    res.fs_error = 2;
+    res.data_error = 4;
+    return res;
+  }
+
+  string path;
+};
+
+TEST_F(ResultCacheTest, ReopenSeesAppendedResults) {
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path));
+  EXPECT_EQ(0, cache.Size());
+  EXPECT_TRUE(cache.Append(Key("a"), Result(1)));
+  EXPECT_TRUE(cache.Append(Key("b"), Result(2)));
+  cache.Close();
+
+  ResultCache reopened;
+  ASSERT_TRUE(reopened.Open(path));
+  EXPECT_EQ(2, reopened.Size());
+  CachedResult res;
+  ASSERT_TRUE(reopened.Lookup(Key("b"), &res));
+  EXPECT_EQ(2, res.fs_check_return);
+  EXPECT_EQ(2, res.fs_error);
+  EXPECT_EQ(4, res.data_error);
+  EXPECT_FALSE(reopened.Lookup(Key("c"), &res));
+}
+
+TEST_F(ResultCacheTest, InterleavedAppenders) {
+  ResultCache first;
+  ResultCache second;
+  ASSERT_TRUE(first.Open(path));
+  ASSERT_TRUE(second.Open(path));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(first.Append(Key("first" + std::to_string(i)), Result(i)));
+    EXPECT_TRUE(second.Append(Key("second" + std::to_string(i)), Result(i)));
+  }
+
+  ResultCache reopened;
+  ASSERT_TRUE(reopened.Open(path));
+  EXPECT_EQ(20, reopened.Size());
+}
+
+TEST_F(ResultCacheTest, SkipsTornRecord) {
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path));
+  EXPECT_TRUE(cache.Append(Key("a"), Result(1)));
+  cache.Close();
+
+  // Pretend an appender died part way through its record.
+  const int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+  ASSERT_TRUE(fd > 0);
+  const char garbage[sizeof(CachedResult) / 2] = {1};
+  EXPECT_EQ((ssize_t) sizeof(garbage), write(fd, garbage, sizeof(garbage)));
+  close(fd);
+
+  ASSERT_TRUE(cache.Open(path));
+  EXPECT_EQ(1, cache.Size());
+  EXPECT_TRUE(cache.Append(Key("b"), Result(2)));
+  cache.Close();
+
+  ASSERT_TRUE(cache.Open(path));
+  EXPECT_EQ(2, cache.Size());
+}
+
+TEST_F(ResultCacheTest, CompactDropsRepeats) {
+  ResultCache first;
+  ResultCache second;
+  ASSERT_TRUE(first.Open(path));
+  ASSERT_TRUE(second.Open(path));
+  EXPECT_TRUE(first.Append(Key("a"), Result(1)));
+  EXPECT_TRUE(second.Append(Key("a"), Result(2)));
+  EXPECT_TRUE(second.Append(Key("b"), Result(3)));
+  first.Close();
+  second.Close();
+
+  unsigned int kept = 0;
+  unsigned int dropped = 0;
+  ASSERT_TRUE(ResultCache::Compact(path, &kept, &dropped));
+  EXPECT_EQ(2, kept);
+  EXPECT_EQ(1, dropped);
+
+  struct stat info;
+  ASSERT_EQ(0, stat(path.c_str(), &info));
+  ResultCache compacted;
+  ASSERT_TRUE(compacted.Open(path));
+  CachedResult res;
+  ASSERT_TRUE(compacted.Lookup(Key("a"), &res));
+  EXPECT_EQ(2, res.fs_check_return);
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "../../code/results/ResultLog.h"
+#include "../../code/results/TestSuiteResult.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::string;
+
+TEST(ResultLog, RoundTrip) {
+  char temp_file[] = "/tmp/result_logXXXXXX";
+  const int temp_fd = mkstemp(temp_file);
+  ASSERT_TRUE(temp_fd > 0);
+  close(temp_fd);
+  const string path(temp_file);
+
+  ResultWriter writer;
+  ASSERT_TRUE(writer.Open(path));
+  // Enough records to go through the buffer a few times.
+  const unsigned int num_records = 5000;
+  for (unsigned int i = 0; i < num_records; ++i) {
+    ResultRecord record;
+    memset(&record, 0, sizeof(record));
+    record.state_id = i;
+    record.fs_error = (i % 2) ? FileSystemTestResult::kCheck : 0;
+    record.source = ResultRecord::kChecked;
+    record.stage_us[ResultRecord::kFsckStage] = i;
+    EXPECT_TRUE(writer.Append(&record,
+          (i % 2) ? "fsck output " + std::to_string(i) : ""));
+  }
+  EXPECT_TRUE(writer.Close());
+
+  ResultReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  ResultRecord record;
+  TestSuiteResult totals;
+  string log;
+  unsigned int read = 0;
+  while (reader.Next(&record)) {
+    EXPECT_EQ(read, record.state_id);
+    EXPECT_EQ(read, record.stage_us[ResultRecord::kFsckStage]);
+    ASSERT_TRUE(reader.ReadFsckLog(record, &log));
+    EXPECT_EQ((read % 2) ? "fsck output " + std::to_string(read) : "", log);
+    totals.AddRecord(record);
+    ++read;
+  }
+  EXPECT_EQ(num_records, read);
+  EXPECT_EQ(num_records, totals.GetCompleted());
+
+  unlink(path.c_str());
+  unlink((path + ".fsck").c_str());
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -63,7 +63,7 @@ TEST(DiskWrite, Serialize_Deserialize) {
   EXPECT_EQ(test_write.metadata.bi_flags, read.metadata.bi_flags);
   EXPECT_EQ(test_write.metadata.bi_rw, read.metadata.bi_rw);
   EXPECT_EQ(0,
-      memcmp(test_write.get_data().get(), read.get_data().get(),
+      memcmp(test_write.get_data(), read.get_data(),
           test_write.metadata.size));
 }
 
@@ -133,7 +133,7 @@ TEST(DiskWrite, Serialize_Deserialize_Epoch) {
     EXPECT_EQ(epoch.at(i).metadata.bi_flags, read.at(i).metadata.bi_flags);
     EXPECT_EQ(epoch.at(i).metadata.bi_rw, read.at(i).metadata.bi_rw);
     EXPECT_EQ(0,
-        memcmp(epoch.at(i).get_data().get(), read.at(i).get_data().get(),
+        memcmp(epoch.at(i).get_data(), read.at(i).get_data(),
             epoch.at(i).metadata.size));
   }
 }
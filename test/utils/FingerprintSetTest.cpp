@@ -0,0 +1,63 @@
+#include <cstdint>
+
+#include "../../code/utils/Fingerprint.h"
+#include "../../code/utils/FingerprintSet.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using fs_testing::utils::Fingerprint;
+using fs_testing::utils::FingerprintBuilder;
+using fs_testing::utils::FingerprintSet;
+
+Fingerprint MakeFingerprint(const uint64_t i) {
+  FingerprintBuilder builder;
+  builder.Update(&i, sizeof(i));
+  return builder.Digest();
+}
+
+TEST(FingerprintSet, InsertsOnce) {
+  FingerprintSet set;
+  EXPECT_FALSE(set.Contains(MakeFingerprint(1)));
+  EXPECT_TRUE(set.Insert(MakeFingerprint(1)));
+  EXPECT_FALSE(set.Insert(MakeFingerprint(1)));
+  EXPECT_TRUE(set.Contains(MakeFingerprint(1)));
+  EXPECT_FALSE(set.Contains(MakeFingerprint(2)));
+  EXPECT_EQ(1, set.Size());
+
+  // The all zero fingerprint marks empty slots but can still be stored.
+  EXPECT_FALSE(set.Contains(Fingerprint()));
+  EXPECT_TRUE(set.Insert(Fingerprint()));
+  EXPECT_TRUE(set.Contains(Fingerprint()));
+  EXPECT_EQ(2, set.Size());
+
+  set.Clear();
+  EXPECT_EQ(0, set.Size());
+  EXPECT_FALSE(set.Contains(MakeFingerprint(1)));
+}
+
+TEST(FingerprintSet, KeepsEntriesWhenGrowing) {
+  for (const unsigned int bloom_bits : {0, 8}) {
+    FingerprintSet set(bloom_bits);
+    const size_t initial = set.MemoryUsage();
+    for (uint64_t i = 0; i < 100000; ++i) {
+      ASSERT_TRUE(set.Insert(MakeFingerprint(i)));
+    }
+    EXPECT_EQ(100000, set.Size());
+    EXPECT_LT(initial, set.MemoryUsage());
+    // At most 4/3 of a slot per entry after doubling, plus the filter.
+    EXPECT_GE((16 + bloom_bits / 8) * 100000 * 8 / 3, set.MemoryUsage());
+    for (uint64_t i = 0; i < 100000; ++i) {
+      ASSERT_TRUE(set.Contains(MakeFingerprint(i)));
+    }
+    unsigned int found = 0;
+    for (uint64_t i = 100000; i < 200000; ++i) {
+      found += set.Contains(MakeFingerprint(i));
+    }
+    EXPECT_EQ(0, found);
+  }
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "../../code/utils/LatencyHistogram.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::chrono::nanoseconds;
+using std::chrono::microseconds;
+using std::string;
+using std::ostringstream;
+
+using fs_testing::utils::LatencyHistogram;
+
+TEST(LatencyHistogram, Empty) {
+  LatencyHistogram hist;
+  EXPECT_EQ(0, hist.Count());
+  EXPECT_EQ(0, hist.Total().count());
+  EXPECT_EQ(0, hist.Min().count());
+  EXPECT_EQ(0, hist.Percentile(99).count());
+}
+
+// Small values each get their own bucket so they come back exactly.
+TEST(LatencyHistogram, SmallValuesExact) {
+  LatencyHistogram hist;
+  for (unsigned int i = 1; i <= 20; ++i) {
+    hist.Record(nanoseconds(i));
+  }
+  EXPECT_EQ(20, hist.Count());
+  EXPECT_EQ(210, hist.Total().count());
+  EXPECT_EQ(1, hist.Min().count());
+  EXPECT_EQ(20, hist.Max().count());
+  EXPECT_EQ(10, hist.Percentile(50).count());
+  EXPECT_EQ(18, hist.Percentile(90).count());
+  EXPECT_EQ(20, hist.Percentile(100).count());
+}
+
+TEST(LatencyHistogram, RelativeError) {
+  LatencyHistogram hist;
+  // 1us to 1000s, one of each.
+  for (unsigned long i = 1; i <= 1000; ++i) {
+    hist.Record(microseconds(i * i * i));
+  }
+  for (const unsigned int p : {10, 50, 90, 99}) {
+    const double expected =
+        nanoseconds(microseconds(p * 10 * p * 10 * p * 10)).count();
+    const double actual = hist.Percentile(p).count();
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected * 1.04);
+  }
+  EXPECT_EQ(nanoseconds(microseconds(1000000000)).count(),
+      hist.Percentile(100).count());
+}
+
+TEST(LatencyHistogram, Merge) {
+  LatencyHistogram a;
+  LatencyHistogram b;
+  for (unsigned int i = 0; i < 100; ++i) {
+    a.Record(microseconds(1));
+    b.Record(microseconds(1000));
+  }
+  a.Merge(b);
+  EXPECT_EQ(200, a.Count());
+  EXPECT_EQ(nanoseconds(microseconds(1)).count(), a.Min().count());
+  EXPECT_EQ(nanoseconds(microseconds(1000)).count(), a.Max().count());
+  EXPECT_LE(a.Percentile(50).count(),
+      nanoseconds(microseconds(1)).count() * 1.04);
+  EXPECT_EQ(nanoseconds(microseconds(1000)).count(), a.Percentile(51).count());
+}
+
+TEST(LatencyHistogram, Json) {
+  LatencyHistogram hist;
+  hist.Record(nanoseconds(5));
+  hist.Record(nanoseconds(5));
+  ostringstream os;
+  hist.PrintJson(os);
+  EXPECT_EQ(string("{\"count\": 2, \"total_ns\": 10, \"min_ns\": 5, "
+        "\"p50_ns\": 5, \"p90_ns\": 5, \"p99_ns\": 5, \"max_ns\": 5, "
+        "\"buckets\": [[5, 5, 2]]}"), os.str());
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../../code/utils/LogArena.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+using std::vector;
+
+using fs_testing::utils::LogArena;
+
+TEST(LogArena, AllocationsAreAlignedAndDisjoint) {
+  LogArena arena;
+  EXPECT_EQ(NULL, arena.Allocate(0));
+
+  char* a = arena.Allocate(1);
+  char* b = arena.Allocate(700);
+  char* c = arena.Allocate(4096);
+  ASSERT_NE((char*) NULL, a);
+  ASSERT_NE((char*) NULL, b);
+  ASSERT_NE((char*) NULL, c);
+  for (char* p : {a, b, c}) {
+    EXPECT_EQ(0, (uintptr_t) p % LogArena::kAlignment);
+  }
+  EXPECT_LE(a + 1, b);
+  EXPECT_LE(b + 700, c);
+  EXPECT_EQ(1, arena.NumSlabs());
+}
+
+TEST(LogArena, CopiesData) {
+  LogArena arena;
+  vector<char> data(3000);
+  for (unsigned int i = 0; i < data.size(); ++i) {
+    data.at(i) = i % 251;
+  }
+  const char* copy = arena.Copy(data.data(), data.size());
+  ASSERT_NE((const char*) NULL, copy);
+  EXPECT_EQ(0, memcmp(data.data(), copy, data.size()));
+}
+
+TEST(LogArena, GrowsBySlab) {
+  LogArena arena;
+  const size_t chunk = LogArena::kSlabSize / 8;
+  for (unsigned int i = 0; i < 8; ++i) {
+    ASSERT_NE((char*) NULL, arena.Allocate(chunk));
+  }
+  EXPECT_EQ(1, arena.NumSlabs());
+  ASSERT_NE((char*) NULL, arena.Allocate(1));
+  EXPECT_EQ(2, arena.NumSlabs());
+
+  // Data bigger than a slab gets its own and later data still fits in the
+  // current one.
+  char* big = arena.Allocate(LogArena::kSlabSize + 1);
+  ASSERT_NE((char*) NULL, big);
+  big[LogArena::kSlabSize] = 1;
+  EXPECT_EQ(3, arena.NumSlabs());
+  ASSERT_NE((char*) NULL, arena.Allocate(1));
+  EXPECT_EQ(3, arena.NumSlabs());
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,48 @@
+// Hack to allow us to determine different bio flags based on kernel code. This
+// must now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <vector>
+
+#include "../../code/utils/LogView.h"
+#include "../../code/utils/utils.h"
+#include "TestBios.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+using std::vector;
+
+using fs_testing::utils::disk_write;
+using fs_testing::utils::LogView;
+
+TEST(LogView, MatchesLog) {
+  vector<disk_write> log = {
+    MakeBio(8, 4096, REQ_WRITE),
+    MakeBio(16, 512, REQ_WRITE | REQ_META | REQ_SYNC),
+    MakeBio(0, 0, REQ_WRITE | REQ_FLUSH),
+    MakeBio(24, 1024, REQ_WRITE | REQ_FUA | REQ_FLUSH_SEQ),
+  };
+  LogView view;
+  view.Build(log);
+
+  ASSERT_EQ(log.size(), view.Size());
+  for (unsigned int i = 0; i < log.size(); ++i) {
+    disk_write& dw = log.at(i);
+    EXPECT_EQ(dw.metadata.write_sector, view.Sector(i));
+    EXPECT_EQ(dw.metadata.size, view.Bytes(i));
+    EXPECT_EQ(dw.get_data(), view.Data(i));
+    EXPECT_EQ(dw.has_write_flag(), view.Is(i, LogView::kWrite));
+    EXPECT_EQ(dw.is_barrier_write(), view.Is(i, LogView::kBarrier));
+    EXPECT_EQ(dw.is_meta(), view.Is(i, LogView::kMeta));
+    EXPECT_EQ(dw.has_flush_flag(), view.Is(i, LogView::kFlush));
+    EXPECT_EQ(dw.has_flush_seq_flag(), view.Is(i, LogView::kFlushSeq));
+    EXPECT_EQ(dw.has_FUA_flag(), view.Is(i, LogView::kFUA));
+    EXPECT_EQ(dw.is_async_write(), view.Is(i, LogView::kAsync));
+  }
+  EXPECT_EQ(LogView::kWrite | LogView::kAsync, view.Flags(0));
+  EXPECT_TRUE(view.Is(3, LogView::kBarrier));
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,79 @@
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../../code/utils/ProcessRunner.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+
+using std::string;
+using std::vector;
+
+using fs_testing::utils::ProcessResult;
+using fs_testing::utils::ProcessRunner;
+
+TEST(ProcessRunner, CapturesOutput) {
+  const ProcessRunner runner(4096);
+  ProcessResult result;
+  // Both stdout and stderr end up in the output.
+  ASSERT_EQ(0, runner.Run({"sh", "-c", "echo out; echo err >&2"}, "",
+        &result));
+  EXPECT_TRUE(WIFEXITED(result.status));
+  EXPECT_EQ(0, WEXITSTATUS(result.status));
+  EXPECT_EQ("out\nerr\n", result.output);
+  EXPECT_FALSE(result.output_truncated);
+}
+
+TEST(ProcessRunner, TruncatesOutput) {
+  const ProcessRunner runner(10);
+  ProcessResult result;
+  // Much more output than fits in a pipe, so the child only finishes if all of
+  // it is drained.
+  ASSERT_EQ(0, runner.Run(
+        {"sh", "-c", "head -c 1000000 /dev/zero | tr '\\0' a"}, "", &result));
+  EXPECT_EQ(0, WEXITSTATUS(result.status));
+  EXPECT_EQ(string(10, 'a'), result.output);
+  EXPECT_TRUE(result.output_truncated);
+}
+
+TEST(ProcessRunner, FeedsInput) {
+  const ProcessRunner runner(1 << 20);
+  ProcessResult result;
+  // Bigger than a pipe holds, so input and output have to be interleaved.
+  const string input(200000, 'b');
+  ASSERT_EQ(0, runner.Run({"cat"}, input, &result));
+  EXPECT_EQ(0, WEXITSTATUS(result.status));
+  EXPECT_EQ(input, result.output);
+}
+
+TEST(ProcessRunner, MeasuresChild) {
+  const ProcessRunner runner(4096);
+  ProcessResult result;
+  ASSERT_EQ(0, runner.Run({"sleep", "0.1"}, "", &result));
+  EXPECT_EQ(0, WEXITSTATUS(result.status));
+  EXPECT_LE(std::chrono::milliseconds(100), result.wall_time);
+  // The child took up some memory even if it barely ran.
+  EXPECT_LT(0, result.usage.ru_maxrss);
+}
+
+TEST(ProcessRunner, ReportsExitStatus) {
+  const ProcessRunner runner(4096);
+  ProcessResult result;
+  ASSERT_EQ(0, runner.Run({"sh", "-c", "exit 3"}, "", &result));
+  EXPECT_TRUE(WIFEXITED(result.status));
+  EXPECT_EQ(3, WEXITSTATUS(result.status));
+
+  // A child that exits without reading its input doesn't take us down.
+  ASSERT_EQ(0, runner.Run({"true"}, string(200000, 'c'), &result));
+  EXPECT_EQ(0, WEXITSTATUS(result.status));
+
+  EXPECT_EQ(-1, runner.Run({"/does/not/exist"}, "", &result));
+  EXPECT_EQ(-1, runner.Run(vector<string>(), "", &result));
+}
+
+}  // namespace test
+}  // namespace fs_testing
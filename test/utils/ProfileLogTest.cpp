@@ -0,0 +1,134 @@
+#include <linux/blk_types.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../../code/utils/ProfileLog.h"
+#include "../../code/utils/utils.h"
+#include "gtest/gtest.h"
+
+namespace fs_testing {
+namespace test {
+using std::ofstream;
+using std::string;
+using std::vector;
+
+using fs_testing::utils::disk_write;
+using fs_testing::utils::LoadProfile;
+using fs_testing::utils::ProfileHeader;
+using fs_testing::utils::SaveProfile;
+
+class ProfileLog : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char temp_file[] = "/tmp/profile_logXXXXXX";
+    const int fd = mkstemp(temp_file);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path = temp_file;
+
+    for (unsigned int i = 0; i < 3; ++i) {
+      disk_write_op_meta meta;
+      meta.bi_flags = REQ_WRITE;
+      meta.bi_rw = REQ_WRITE | (i == 1 ? REQ_FUA : 0);
+      meta.write_sector = 8 * i;
+      meta.size = 512 * (i + 1) + 7;
+      vector<char> data(meta.size, 'a' + i);
+      log.emplace_back(meta, data.data());
+    }
+    disk_write_op_meta flush;
+    flush.bi_flags = 0;
+    flush.bi_rw = REQ_FLUSH;
+    flush.write_sector = 0;
+    flush.size = 0;
+    log.emplace_back(flush, (const char*) NULL);
+  }
+
+  virtual void TearDown() {
+    unlink(path.c_str());
+  }
+
+  string path;
+  vector<disk_write> log;
+};
+
+TEST_F(ProfileLog, RoundTrip) {
+  ASSERT_TRUE(SaveProfile(path, "ext4", log));
+
+  string fs_type;
+  string error;
+  vector<disk_write> loaded;
+  ASSERT_TRUE(LoadProfile(path, &fs_type, &loaded, &error)) << error;
+  EXPECT_EQ("ext4", fs_type);
+  ASSERT_EQ(log.size(), loaded.size());
+  for (unsigned int i = 0; i < log.size(); ++i) {
+    EXPECT_EQ(log.at(i), loaded.at(i));
+  }
+  // Data is mapped from the file, so each write is sector aligned.
+  EXPECT_EQ(0, (uintptr_t) loaded.at(0).get_data() % 512);
+}
+
+TEST_F(ProfileLog, LoadsTextProfile) {
+  ofstream output(path, std::ofstream::trunc);
+  for (const disk_write& dw : log) {
+    disk_write::serialize(output, dw);
+  }
+  output.close();
+
+  string fs_type = "ext4";
+  string error;
+  vector<disk_write> loaded;
+  ASSERT_TRUE(LoadProfile(path, &fs_type, &loaded, &error)) << error;
+  EXPECT_EQ("ext4", fs_type);
+  ASSERT_EQ(log.size(), loaded.size());
+  for (unsigned int i = 0; i < log.size(); ++i) {
+    EXPECT_EQ(log.at(i), loaded.at(i));
+  }
+}
+
+TEST_F(ProfileLog, DetectsCorruptData) {
+  ASSERT_TRUE(SaveProfile(path, "ext4", log));
+
+  // Flip a byte in the data of the last write.
+  const int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  const off_t end = lseek(fd, 0, SEEK_END);
+  char c;
+  ASSERT_EQ(1, pread(fd, &c, 1, end - 1));
+  c ^= 0xff;
+  ASSERT_EQ(1, pwrite(fd, &c, 1, end - 1));
+  close(fd);
+
+  string fs_type;
+  string error;
+  vector<disk_write> loaded;
+  EXPECT_FALSE(LoadProfile(path, &fs_type, &loaded, &error));
+  EXPECT_FALSE(error.empty());
+  EXPECT_TRUE(loaded.empty());
+}
+
+TEST_F(ProfileLog, DetectsCorruptHeader) {
+  ASSERT_TRUE(SaveProfile(path, "ext4", log));
+
+  const int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  const char other[] = "xfs";
+  ASSERT_EQ((ssize_t) sizeof(other), pwrite(fd, other, sizeof(other),
+        offsetof(ProfileHeader, fs_type)));
+  close(fd);
+
+  string fs_type;
+  string error;
+  vector<disk_write> loaded;
+  EXPECT_FALSE(LoadProfile(path, &fs_type, &loaded, &error));
+  EXPECT_TRUE(loaded.empty());
+}
+
+}  // namespace test
+}  // namespace fs_testing
@@ -0,0 +1,32 @@
+#ifndef TEST_UTILS_TEST_BIOS_H
+#define TEST_UTILS_TEST_BIOS_H
+
+// Hack to allow us to determine different bio flags based on kernel code. This
+// must now be compiled with kernel headers.
+#include <linux/blk_types.h>
+
+#include <vector>
+
+#include "../../code/utils/utils.h"
+
+namespace fs_testing {
+namespace test {
+
+// Bio writing size bytes at sector, with every byte of its payload set to fill
+// so that it can be told apart from other bios on disk.
+inline fs_testing::utils::disk_write MakeBio(const unsigned long int sector,
+    const unsigned int size, const unsigned long int flags = REQ_WRITE,
+    const char fill = 'a') {
+  struct disk_write_op_meta meta = {};
+  meta.bi_flags = flags;
+  meta.bi_rw = flags;
+  meta.write_sector = sector;
+  meta.size = size;
+  std::vector<char> data(size, fill);
+  return fs_testing::utils::disk_write(meta, data.data());
+}
+
+}  // namespace test
+}  // namespace fs_testing
+
+#endif  // TEST_UTILS_TEST_BIOS_H